@@ -8,7 +8,66 @@
 #define DGFX_RESOLUTION_W_DEFUALT 512
 #define DGFX_RESOLUTION_H_DEFAULT 324
 
+#define DGFX_TILE_W_DEFAULT 32
+#define DGFX_TILE_H_DEFAULT 16
+
+#define DGFX_QUEUE_DEPTH_DEFAULT 3
+
+// busy-wait iterations before a thread blocks on frame dispatch / completion
+#define DGFX_SPIN_ITERATIONS 4096
+
+// --backend processes: how often a blocked main process checks whether a worker process died
+#define DGFX_PROCESS_POLL_MS 100
+
+// --remote: tile requests kept in flight on each connection, hiding the network round trip
+#define DGFX_REMOTE_PIPELINE 4
+
+// --serve: largest frame and tile sides a coordinator may ask for, which bound what a connection allocates
+#define DGFX_REMOTE_MAX_SIDE 16384
+#define DGFX_REMOTE_MAX_TILE 4096
+
+// jit.opt.start() arguments every worker's state starts with, --jit-opt adds to them. luajit's default
+// machine code limit (512 KB) is too small for scripts like example_animated_3d.lua, which then fall back to
+// the interpreter. "" keeps luajit's defaults.
+#define DGFX_JIT_OPT_DEFAULT "maxtrace=4000,maxmcode=16384"
+
+// --warmup: frames rendered and thrown away in realtime, render and bench modes before output or timing begins
+#define DGFX_WARMUP_DEFAULT 2
+
+// --gc idle/step: KB worth of collector work per step between frames, the first step of a frame grows with what
+// the script allocated during it
+#define DGFX_GC_STEP_KB 256
+
+// --balance adaptive: how much shorter the slowest worker's share must get before tiles change hands, which
+// moves them away from the pages they first touched
+#define DGFX_REBALANCE_MIN_GAIN 0.05
+
+// --jobs auto: frames timed per worker count, and the minimum speedup a doubling of workers must bring
+#define DGFX_CALIBRATION_FRAMES 3
+#define DGFX_CALIBRATION_MIN_GAIN 0.10
+
+// --script-cache: directory compiled scripts are kept in between runs, NULL compiles on every start
+#define DGFX_SCRIPT_CACHE_DEFAULT NULL
+
+// --aot: compiler command building translated scripts into plugins, and where it finds dgfx_plugin.h.
+// -ffp-contract=off keeps the compiler from fusing multiplies and adds, which luajit never does, so the
+// compiled script rounds exactly like the lua one
+#define DGFX_AOT_CC "cc -std=c99 -O3 -march=native -fno-math-errno -ffp-contract=off -shared -fPIC"
+#define DGFX_AOT_INCLUDE "."
+
+// --trace: pixels of a row evaluated together, in doubles like luajit's numbers. 32 is a default tile row, four
+// avx-512 or eight avx2 registers per node: fewer and the per-node dispatch costs more than the arithmetic.
+// programs with more nodes than DGFX_TRACE_MAX_NODES (long unrolled loops) run on luajit
+#define DGFX_TRACE_LANES 32
+#define DGFX_TRACE_MAX_NODES 16384
+
+// pixels a --trace program and a script's `depends` claim are checked on before they are trusted
+#define DGFX_SAMPLE_POINTS 64
+
 #define DGFX_RESOURCE_LUA_WORKER_CB "resources/lua/worker_cb.lua"
+#define DGFX_RESOURCE_LUA_AOT "resources/lua/aot.lua"
+#define DGFX_RESOURCE_LUA_TRACE "resources/lua/trace.lua"
+#define DGFX_RESOURCE_LUA_MATH "resources/lua/math.lua"
 #define DGFX_RESOURCE_FONT "resources/SpaceMono-Regular.ttf"
 
 #endif
@@ -1,19 +1,44 @@
+#include <arpa/inet.h>
+#include <linux/futex.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <dirent.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <inttypes.h>
 #include <limits.h>
+#include <math.h>
 #include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdarg.h>
 #include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <strings.h>
 #include <time.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include <lauxlib.h>
 #include <lua.h>
+#include <luajit.h>
 #include <lualib.h>
 
 #include <SDL3/SDL.h>
@@ -29,8 +54,21 @@
 #include <ketopt.h>
 
 #include "config.h"
+#include "dgfx_plugin.h"
+#include "dgfx_math.h"
 
 #define SARRLEN(arr) (sizeof (arr) / sizeof (arr[0]))
+#define DGFX_CACHE_LINE 64
+#define DGFX_CACHE_ALIGNED __attribute__ ((aligned (DGFX_CACHE_LINE)))
+#define DGFX_CACHE_ROUND(n) (((n) + DGFX_CACHE_LINE - 1) & ~(size_t)(DGFX_CACHE_LINE - 1))
+
+#if defined(__x86_64__) || defined(__i386__)
+#define DGFX_CPU_RELAX() __builtin_ia32_pause ()
+#elif defined(__aarch64__)
+#define DGFX_CPU_RELAX() __asm__ __volatile__ ("yield")
+#else
+#define DGFX_CPU_RELAX() ((void)0)
+#endif
 #define UNREACHABLE                                                                                                    \
     do                                                                                                                 \
     {                                                                                                                  \
@@ -42,9 +80,66 @@ enum
 {
     MODE_SINGLE = 0,
     MODE_REALTIME,
-    MODE_RENDER
+    MODE_RENDER,
+    MODE_BENCH
+};
+const char *_mode_strings[] = {
+    [MODE_SINGLE] = "single", [MODE_REALTIME] = "realtime", [MODE_RENDER] = "render", [MODE_BENCH] = "bench"
+};
+
+enum
+{
+    WRITE_PATH_FFI = 0,
+    WRITE_PATH_STRING
+};
+const char *_write_path_strings[] = { [WRITE_PATH_FFI] = "ffi", [WRITE_PATH_STRING] = "string" };
+
+enum
+{
+    TONEMAP_NONE = 0,
+    TONEMAP_REINHARD,
+    TONEMAP_ACES
+};
+const char *_tonemap_strings[] = { [TONEMAP_NONE] = "none", [TONEMAP_REINHARD] = "reinhard", [TONEMAP_ACES] = "aces" };
+
+enum
+{
+    GC_IDLE = 0, // collector stopped while shading, stepped after each job until the next one arrives
+    GC_STEP,     // collector stopped while shading, one bounded step after each frame
+    GC_LUA       // collector runs whenever lua decides to, mid-tile included
+};
+const char *_gc_strings[] = { [GC_IDLE] = "idle", [GC_STEP] = "step", [GC_LUA] = "lua" };
+
+enum
+{
+    AFFINITY_NONE = 0,
+    AFFINITY_COMPACT,
+    AFFINITY_SCATTER,
+    AFFINITY_LIST
+};
+enum
+{
+    BALANCE_STATIC = 0,
+    BALANCE_ADAPTIVE
+};
+const char *_balance_strings[] = { [BALANCE_STATIC] = "static", [BALANCE_ADAPTIVE] = "adaptive" };
+
+enum
+{
+    PARALLEL_TILES = 0,
+    PARALLEL_FRAMES
+};
+const char *_parallel_strings[] = { [PARALLEL_TILES] = "tiles", [PARALLEL_FRAMES] = "frames" };
+
+enum
+{
+    BACKEND_THREADS = 0,
+    BACKEND_PROCESSES
 };
-const char *_mode_strings[] = { [MODE_SINGLE] = "single", [MODE_REALTIME] = "realtime", [MODE_RENDER] = "render" };
+const char *_backend_strings[] = { [BACKEND_THREADS] = "threads", [BACKEND_PROCESSES] = "processes" };
+
+const char *_affinity_strings[]
+    = { [AFFINITY_NONE] = "none", [AFFINITY_COMPACT] = "compact", [AFFINITY_SCATTER] = "scatter" };
 
 struct
 {
@@ -55,6 +150,28 @@ struct
     size_t worker_n;
     size_t frame_count;
     uint32_t fps;
+    uint32_t tile_w, tile_h;
+    size_t queue_depth;
+    int affinity;
+    const char *affinity_list; // cpulist for AFFINITY_LIST
+    int balance;
+    int parallel;
+    int backend;
+    int write_path;
+    bool hdr;        // scripts write float pixels, quantized in C
+    bool hdr_output; // single mode: keep the float frame and write it as .hdr
+    float exposure;  // stops
+    int tonemap;
+    const char **remotes;     // --remote addresses, one remote worker each
+    const char *serve_addr;   // --serve
+    bool serve_public;        // --serve-public: let --serve listen on more than loopback
+    const char *script_cache; // directory keeping compiled scripts between runs, NULL to always compile
+    bool startup_times;       // print how long workers took to start
+    int gc;
+    const char *jit_opt; // --jit-opt, applied after DGFX_JIT_OPT_DEFAULT
+    size_t warmup;       // frames rendered and thrown away before anything is timed or shown
+    bool aot;            // --aot: translate the script to C and shade with the compiled plugin when possible
+    bool trace;          // --trace: record rgb's arithmetic and evaluate it in C when possible
 } dgfx_config = { .w = DGFX_RESOLUTION_W_DEFUALT,
                   .h = DGFX_RESOLUTION_H_DEFAULT,
                   .mode = 0,
@@ -62,382 +179,4203 @@ struct
                   .output_path = DGFX_OUTPUT_PATH_DEFAULT,
                   .worker_n = 1,
                   .fps = 120,
-                  .frame_count = 3600 };
+                  .frame_count = 3600,
+                  .tile_w = DGFX_TILE_W_DEFAULT,
+                  .tile_h = DGFX_TILE_H_DEFAULT,
+                  .queue_depth = DGFX_QUEUE_DEPTH_DEFAULT,
+                  .affinity = AFFINITY_NONE,
+                  .affinity_list = NULL,
+                  .balance = BALANCE_ADAPTIVE,
+                  .parallel = PARALLEL_TILES,
+                  .backend = BACKEND_THREADS,
+                  .write_path = WRITE_PATH_FFI,
+                  .hdr = false,
+                  .hdr_output = false,
+                  .exposure = 0.0f,
+                  .tonemap = TONEMAP_NONE,
+                  .remotes = NULL,
+                  .serve_addr = NULL,
+                  .serve_public = false,
+                  .script_cache = DGFX_SCRIPT_CACHE_DEFAULT,
+                  .startup_times = false,
+                  .gc = GC_IDLE,
+                  .jit_opt = NULL,
+                  .warmup = DGFX_WARMUP_DEFAULT,
+                  .aot = false,
+                  .trace = false };
+
+struct dgfx_tile
+{
+    uint32_t x, y;
+    uint32_t w, h;
+};
+
+enum
+{
+    JOB_TILES = 0,    // shade one frame, tiles shared between workers
+    JOB_FIRST_TOUCH,  // zero own tiles instead of shading, see dgfx_pixels_first_touch
+    JOB_FRAMES,       // every worker renders whole frames on its own, see dgfx_render_frames
+    JOB_RETIRE        // workers past `active_n` exit, the others have nothing to do, see dgfx_workers_retire
+};
+
+// frame dispatch shared by the main thread and all workers.
+// the two futex words live on separate cache lines: workers hammer `pending`, while `epoch` is read-mostly.
+struct dgfx_frame_sync
+{
+    _Atomic uint32_t epoch DGFX_CACHE_ALIGNED; // bumped by main thread to publish a frame
+    _Atomic uint32_t epoch_sleepers;           // workers blocked in futex on `epoch`
+    int job;
+    double t_param;
+    size_t active_n; // workers taking part in the frame, the rest stay parked
+    bool should_exit;
+
+    // JOB_FRAMES: frames [0, frame_count) are claimed one at a time and submitted to `ring`
+    struct dgfx_frame_ring *ring;
+    _Atomic size_t next_frame;
+    size_t frame_count;
+
+    _Atomic uint32_t pending DGFX_CACHE_ALIGNED; // worker threads still shading the current frame
+    _Atomic uint32_t pending_sleepers;           // main thread blocked in futex on `pending`
+    _Atomic bool failed;
+
+    _Atomic uint32_t startup_sleepers; // main thread blocked on a worker's `startup`
+};
+
+// --trace: operations of a recorded rgb, see resources/lua/trace.lua. nullary ones first, then the ones taking
+// `a` and `b`, then the ones taking `a`.
+enum
+{
+    TRACE_OP_CONST = 0,
+    TRACE_OP_X,
+    TRACE_OP_Y,
+    TRACE_OP_T,
+    TRACE_OP_ADD,
+    TRACE_OP_SUB,
+    TRACE_OP_MUL,
+    TRACE_OP_DIV,
+    TRACE_OP_MOD,
+    TRACE_OP_POW,
+    TRACE_OP_MIN,
+    TRACE_OP_MAX,
+    TRACE_OP_FMOD,
+    TRACE_OP_ATAN2,
+    TRACE_OP_LDEXP,
+    TRACE_OP_UNM,
+    TRACE_OP_ABS,
+    TRACE_OP_FLOOR,
+    TRACE_OP_CEIL,
+    TRACE_OP_SQRT,
+    TRACE_OP_EXP,
+    TRACE_OP_LOG,
+    TRACE_OP_LOG2,
+    TRACE_OP_LOG10,
+    TRACE_OP_SIN,
+    TRACE_OP_COS,
+    TRACE_OP_TAN,
+    TRACE_OP_ASIN,
+    TRACE_OP_ACOS,
+    TRACE_OP_ATAN,
+    TRACE_OP_SINH,
+    TRACE_OP_COSH,
+    TRACE_OP_TANH,
+    TRACE_OP_N
+};
+const char *_trace_op_strings[] = {
+    [TRACE_OP_CONST] = "const", [TRACE_OP_X] = "x",         [TRACE_OP_Y] = "y",         [TRACE_OP_T] = "t",
+    [TRACE_OP_ADD] = "add",     [TRACE_OP_SUB] = "sub",     [TRACE_OP_MUL] = "mul",     [TRACE_OP_DIV] = "div",
+    [TRACE_OP_MOD] = "mod",     [TRACE_OP_POW] = "pow",     [TRACE_OP_MIN] = "min",     [TRACE_OP_MAX] = "max",
+    [TRACE_OP_FMOD] = "fmod",   [TRACE_OP_ATAN2] = "atan2", [TRACE_OP_LDEXP] = "ldexp", [TRACE_OP_UNM] = "unm",
+    [TRACE_OP_ABS] = "abs",     [TRACE_OP_FLOOR] = "floor", [TRACE_OP_CEIL] = "ceil",   [TRACE_OP_SQRT] = "sqrt",
+    [TRACE_OP_EXP] = "exp",     [TRACE_OP_LOG] = "log",     [TRACE_OP_LOG2] = "log2",   [TRACE_OP_LOG10] = "log10",
+    [TRACE_OP_SIN] = "sin",     [TRACE_OP_COS] = "cos",     [TRACE_OP_TAN] = "tan",     [TRACE_OP_ASIN] = "asin",
+    [TRACE_OP_ACOS] = "acos",   [TRACE_OP_ATAN] = "atan",   [TRACE_OP_SINH] = "sinh",   [TRACE_OP_COSH] = "cosh",
+    [TRACE_OP_TANH] = "tanh"
+};
+
+// what a value changes with: a --trace node's, computed once per tile, row or packet accordingly, and the
+// whole script's (dgfx_ctx.depends)
+enum
+{
+    DEPENDS_X = 1 << 0,
+    DEPENDS_Y = 1 << 1,
+    DEPENDS_T = 1 << 2,
+    DEPENDS_ALL = DEPENDS_X | DEPENDS_Y | DEPENDS_T
+};
+
+enum
+{
+    TRACE_STAGE_TILE = 0,
+    TRACE_STAGE_ROW,
+    TRACE_STAGE_PACKET,
+    TRACE_STAGE_N
+};
+
+struct dgfx_trace_node
+{
+    uint8_t op;
+    uint8_t deps;
+    uint32_t a, b; // operand nodes, always earlier ones
+    double k;      // TRACE_OP_CONST
+};
+
+struct dgfx_cpu
+{
+    int cpu;
+    int node;
+    int package;
+    int core;
+    int core_rank; // index of the physical core inside its node
+    int sibling;   // index of this hardware thread among the ones sharing its core
+};
+
+struct dgfx_worker;
+
+struct
+{
+    uint8_t *pixels;
+    size_t pitch;    // bytes per framebuffer row
+    uint8_t *target; // process backend: where `pixels` is copied after each frame
+    size_t target_pitch;
+    void *shared; // one mapping holding sync, workers, tile_order, tile_cost (and pixels for processes)
+    float *hdr_frame; // --hdr with .hdr output: the whole float frame, 4 floats per pixel
+    float *setup_cache;           // setup()/shade() scripts: one block of cached setup values per tile
+    _Atomic uint8_t *setup_ready; // per tile, set once its block is filled
+    size_t setup_floats;          // values setup() returns per pixel, 0 for plain rgb scripts
+    size_t setup_size;
+    int setup_fd; // process backend: memfd behind setup_cache, created before workers are forked
+    size_t shared_size;
+    _Atomic bool worker_lost; // a worker process died or a remote worker disconnected during the last frame
+    const char *script; // script source received by --serve, loaded instead of input_path
+    size_t script_len;
+    char *script_name;
+    uint8_t *script_bc;    // input_path compiled once by the main thread, loaded by every worker (stb_ds array)
+    uint8_t *worker_cb_bc; // same for DGFX_RESOURCE_LUA_WORKER_CB
+    uint8_t *math_bc;      // and DGFX_RESOURCE_LUA_MATH
+    void *plugin_handle;   // -i shader.so: the dlopen()ed plugin, shading in place of lua
+    const struct dgfx_plugin *plugin;
+    struct dgfx_trace_node *trace; // --trace: rgb as recorded by DGFX_RESOURCE_LUA_TRACE, NULL when it runs on lua
+    uint32_t *trace_stage[TRACE_STAGE_N]; // the nodes of each stage in evaluation order (stb_ds arrays)
+    uint32_t trace_out[3];                // nodes holding r, g and b
+    uint8_t depends; // DEPENDS_* bits of what the picture changes with, see dgfx_depends_load
+    uint8_t *still;  // scripts that don't depend on t: their frame, shaded once and copied from then on
+    uint8_t **still_out; // framebuffers already holding `still`, which later frames leave alone (stb_ds array)
+    struct dgfx_worker *workers;
+    size_t worker_n;
+    struct dgfx_tile *tiles;
+    uint32_t *tile_order; // tiles grouped by owning worker, each worker's run is one deque
+    float *tile_cost;     // seconds each tile took in the last frame
+    bool tile_cost_valid; // last frame completed with the current partition
+    struct dgfx_frame_sync *sync;
+    struct dgfx_cpu *cpus; // pinning order, empty when affinity is off
+    // dgfx_sched_rebalance scratch (stb_ds arrays): owner of every tile, tiles by cost, per-node heaps of worker
+    // loads and, per worker, its node's slice of them
+    uint32_t *sched_owner;
+    uint32_t *sched_sorted;
+    struct dgfx_load *sched_heap;
+    struct dgfx_sched_group *sched_group;
+} dgfx_ctx = {
+    .target = NULL,
+    .shared = NULL,
+    .setup_cache = NULL,
+    .setup_ready = NULL,
+    .setup_floats = 0,
+    .setup_fd = -1,
+    .script = NULL,
+    .script_bc = NULL,
+    .worker_cb_bc = NULL,
+    .math_bc = NULL,
+    .plugin_handle = NULL,
+    .plugin = NULL,
+    .trace = NULL,
+    .depends = DEPENDS_ALL,
+    .still = NULL,
+    .still_out = NULL,
+    .sync = NULL,
+    .cpus = NULL,
+    .workers = NULL,
+    .worker_n = 0,
+    .pixels = NULL,
+    .pitch = 0,
+    .tiles = NULL,
+    .tile_order = NULL,
+    .tile_cost = NULL,
+    .tile_cost_valid = false,
+    .sched_owner = NULL,
+    .sched_sorted = NULL,
+    .sched_heap = NULL,
+    .sched_group = NULL,
+};
+
+enum
+{
+    STARTUP_PENDING = 0,
+    STARTUP_READY,
+    STARTUP_FAILED
+};
+
+// parts of dgfx_worker_lua_init timed for --startup-times
+enum
+{
+    STARTUP_STAGE_STATE = 0, // lua state, libraries, dgfx table
+    STARTUP_STAGE_LOAD,      // user script bytecode
+    STARTUP_STAGE_RUN,       // user script top level
+    STARTUP_STAGE_RESOLVE,   // worker callbacks
+    STARTUP_STAGE_N
+};
+const char *_startup_stage_strings[] = { [STARTUP_STAGE_STATE] = "state",
+                                         [STARTUP_STAGE_LOAD] = "load",
+                                         [STARTUP_STAGE_RUN] = "run",
+                                         [STARTUP_STAGE_RESOLVE] = "resolve" };
 
 struct dgfx_worker
 {
-    uint8_t id;
+    size_t id;
     pthread_t thrd;
     lua_State *L;
 
-    uint8_t **pixels; // points to dgfx_ctx.pixels
-    size_t start_idx;
-    size_t work_len;  // pixel count assigned to worker
-    size_t work_done; // count of pixels already done
-
-    double t_param;
+    int cpu;  // pinned cpu, -1 when not pinned
+    int node; // NUMA node of `cpu`
+    _Atomic uint32_t startup;
 
     int lua_cb_ref;
+    size_t setup_floats; // values the script's setup() returns, 0 without one
+    void *plugin_state;  // what the plugin's init() handed back for this worker
 
-    pthread_mutex_t mutex;
-    pthread_cond_t work_cond;
-    pthread_cond_t done_cond;
+    // filled in by the worker while it starts, read by the main thread once it reported
+    double startup_time[STARTUP_STAGE_N];
+    char startup_error[256];
 
-    bool has_work;
-    bool work_complete;
-    bool should_exit;
-    bool thread_running;
+    // garbage collector telemetry, written by the worker after each job (or frame, in JOB_FRAMES)
+    _Atomic uint64_t gc_ns;      // time spent in the collector
+    _Atomic uint32_t gc_heap_kb; // lua heap size once it was done
+
+    uint32_t tile_first; // initial deque contents (range of dgfx_ctx.tile_order), restored every frame
+    uint32_t tile_count;
+
+    bool thread_running; // worker 0 has no thread, it is driven by the main thread
+    pid_t pid;           // process backend, 0 for worker 0
+    bool dead;           // process exited and was reaped, only touched by the main process
+
+    float *hdr_tile; // --hdr: one tile of float pixels, quantized into the framebuffer after shading
+    double *trace_regs; // --trace: DGFX_TRACE_LANES values of every node
+
+    const char *remote;  // address of the `dgfx --serve` this worker forwards tiles to, NULL for local workers
+    int sock;            // -1 once the connection is lost
+    uint8_t *remote_buf; // one tile of pixels as received
+
+    // tile deque: positions [head, tail) in dgfx_ctx.tile_order, packed as head << 32 | tail.
+    // owner pops from the head, idle workers steal from the tail.
+    _Atomic uint64_t tile_range DGFX_CACHE_ALIGNED;
+
+    size_t tiles_done DGFX_CACHE_ALIGNED; // count of tiles shaded by this worker in current frame
+    _Atomic uint32_t done_epoch;          // last epoch this worker finished, set after it counted down `pending`
 };
 
-void *
-dgfx_worker_work (void *arg)
+double
+dgfx_time_now (void)
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// worker processes share the futex words through a memfd mapping, so they can't use the private ops
+void
+dgfx_futex_wait (_Atomic uint32_t *addr, uint32_t val, int timeout_ms)
 {
-    struct dgfx_worker *w = arg;
+    struct timespec timeout = { .tv_sec = timeout_ms / 1000, .tv_nsec = (timeout_ms % 1000) * 1000000L };
+    int op = dgfx_config.backend == BACKEND_PROCESSES ? FUTEX_WAIT : FUTEX_WAIT_PRIVATE;
+    syscall (SYS_futex, (uint32_t *)addr, op, val, timeout_ms < 0 ? NULL : &timeout, NULL, 0);
+}
 
-    while (true)
-    {
-        pthread_mutex_lock (&w->mutex);
+void
+dgfx_futex_wake (_Atomic uint32_t *addr, _Atomic uint32_t *sleepers, int n)
+{
+    int op = dgfx_config.backend == BACKEND_PROCESSES ? FUTEX_WAKE : FUTEX_WAKE_PRIVATE;
+    if (atomic_load (sleepers) != 0)
+        syscall (SYS_futex, (uint32_t *)addr, op, n, NULL, NULL, 0);
+}
 
-        while (!w->has_work && !w->should_exit)
-        {
-            pthread_cond_wait (&w->work_cond, &w->mutex);
-        }
+// spins for a while, then sleeps until *addr != val or `timeout_ms` passes (never, when negative).
+// returns the new value, which is still `val` on timeout.
+uint32_t
+dgfx_wait_change (_Atomic uint32_t *addr, uint32_t val, _Atomic uint32_t *sleepers, int timeout_ms)
+{
+    uint32_t cur;
 
-        if (w->should_exit)
+    for (int i = 0; i < DGFX_SPIN_ITERATIONS; ++i)
+    {
+        cur = atomic_load_explicit (addr, memory_order_acquire);
+        if (cur != val)
+            return cur;
+        DGFX_CPU_RELAX ();
+    }
+
+    atomic_fetch_add (sleepers, 1);
+    while ((cur = atomic_load (addr)) == val)
+    {
+        dgfx_futex_wait (addr, val, timeout_ms);
+        if (timeout_ms >= 0)
         {
-            pthread_mutex_unlock (&w->mutex);
+            cur = atomic_load (addr);
             break;
         }
+    }
+    atomic_fetch_sub (sleepers, 1);
 
-        w->work_complete = false;
-        w->work_done = 0;
-        pthread_mutex_unlock (&w->mutex);
+    return cur;
+}
 
-        lua_rawgeti (w->L, LUA_REGISTRYINDEX, w->lua_cb_ref);
+// parses kernel cpulist format ("0-3,8,10-12") into `out`
+bool
+dgfx_cpulist_parse (const char *str, int **out)
+{
+    const char *p = str;
 
-        lua_pushnumber (w->L, (lua_Number)w->t_param);
+    while (*p && *p != '\n')
+    {
+        char *endptr = NULL;
+        long first = strtol (p, &endptr, 10);
+        if (endptr == p || first < 0)
+            return false;
 
-        if (lua_pcall (w->L, 1, 1, 0) != LUA_OK)
+        long last = first;
+        p = endptr;
+        if (*p == '-')
         {
-            fprintf (stderr, "Lua error in worker %u: %s\n", w->id, lua_tostring (w->L, -1));
-            lua_pop (w->L, 1);
-            pthread_exit (NULL);
+            last = strtol (p + 1, &endptr, 10);
+            if (endptr == p + 1 || last < first)
+                return false;
+            p = endptr;
         }
 
-        size_t ret_len = 0;
-        const char *buf = lua_tolstring (w->L, -1, &ret_len);
-        uint8_t *pixels = *(w->pixels);
+        for (long cpu = first; cpu <= last; ++cpu)
+            arrput (*out, (int)cpu);
 
-        size_t expected = w->work_len * 4;
-        if (ret_len != expected)
+        if (*p == ',')
         {
-            size_t copy_len = ret_len < expected ? ret_len : expected;
-            size_t byte_offset = w->start_idx * 4;
-            memcpy (pixels + byte_offset, buf, copy_len);
-            if (copy_len < expected)
-                memset (pixels + byte_offset + copy_len, 0, expected - copy_len);
+            p++;
+            if (!*p || *p == '\n') // "0-3," is missing its last entry
+                return false;
         }
-        else
+        else if (*p && *p != '\n')
+            return false;
+    }
+
+    return true;
+}
+
+int
+dgfx_sysfs_read_int (const char *path, int fallback)
+{
+    FILE *f = fopen (path, "r");
+    if (!f)
+        return fallback;
+
+    int v = fallback;
+    if (fscanf (f, "%d", &v) != 1)
+        v = fallback;
+    fclose (f);
+    return v;
+}
+
+// fills `node_of[cpu]` from /sys/devices/system/node; everything stays on node 0 without NUMA support
+void
+dgfx_cpu_nodes (int *node_of, size_t len)
+{
+    memset (node_of, 0, len * sizeof (int));
+
+    DIR *dir = opendir ("/sys/devices/system/node");
+    if (!dir)
+        return;
+
+    struct dirent *ent;
+    while ((ent = readdir (dir)))
+    {
+        int node;
+        if (sscanf (ent->d_name, "node%d", &node) != 1)
+            continue;
+
+        char path[128];
+        snprintf (path, sizeof (path), "/sys/devices/system/node/node%d/cpulist", node);
+
+        FILE *f = fopen (path, "r");
+        if (!f)
+            continue;
+
+        char buf[4096];
+        int *cpus = NULL;
+        if (fgets (buf, sizeof (buf), f) && dgfx_cpulist_parse (buf, &cpus))
         {
-            size_t byte_offset = w->start_idx * 4;
-            memcpy (pixels + byte_offset, buf, expected);
+            for (size_t i = 0; i < arrlenu (cpus); ++i)
+                if ((size_t)cpus[i] < len)
+                    node_of[cpus[i]] = node;
         }
+        arrfree (cpus);
+        fclose (f);
+    }
 
-        lua_pop (w->L, 1);
+    closedir (dir);
+}
 
-        pthread_mutex_lock (&w->mutex);
-        w->work_done = w->work_len;
-        w->has_work = false;
-        w->work_complete = true;
-        pthread_cond_signal (&w->done_cond);
-        pthread_mutex_unlock (&w->mutex);
-    }
+int
+dgfx_cpu_cmp_compact (const void *a, const void *b)
+{
+    const struct dgfx_cpu *x = a, *y = b;
+    if (x->node != y->node)
+        return x->node - y->node;
+    if (x->package != y->package)
+        return x->package - y->package;
+    if (x->core != y->core)
+        return x->core - y->core;
+    return x->cpu - y->cpu;
+}
 
-    pthread_exit (NULL);
+// spread over nodes first, then over physical cores, SMT siblings last
+int
+dgfx_cpu_cmp_scatter (const void *a, const void *b)
+{
+    const struct dgfx_cpu *x = a, *y = b;
+    if (x->sibling != y->sibling)
+        return x->sibling - y->sibling;
+    if (x->core_rank != y->core_rank)
+        return x->core_rank - y->core_rank;
+    if (x->node != y->node)
+        return x->node - y->node;
+    return x->cpu - y->cpu;
 }
 
+// builds the cpu order workers are pinned in; worker `i` gets dgfx_ctx.cpus[i % len]
 bool
-dgfx_worker_init (struct dgfx_worker *w, uint8_t id, uint8_t **pixels, size_t start_idx, size_t work_len)
+dgfx_affinity_init (void)
 {
-    if (!w || !pixels)
-        UNREACHABLE;
+    arrfree (dgfx_ctx.cpus);
 
-    w->id = id;
-    w->pixels = pixels;
-    w->start_idx = start_idx;
-    w->work_len = work_len;
+    if (dgfx_config.affinity == AFFINITY_NONE)
+        return true;
 
-    if (pthread_mutex_init (&w->mutex, NULL) != 0)
+    static int node_of[CPU_SETSIZE];
+    dgfx_cpu_nodes (node_of, CPU_SETSIZE);
+
+    cpu_set_t allowed;
+    CPU_ZERO (&allowed);
+    if (sched_getaffinity (0, sizeof (allowed), &allowed) != 0)
     {
+        perror ("sched_getaffinity");
         return false;
     }
 
-    if (pthread_cond_init (&w->work_cond, NULL) != 0)
+    if (dgfx_config.affinity == AFFINITY_LIST)
     {
-        pthread_mutex_destroy (&w->mutex);
-        return false;
+        int *list = NULL;
+        dgfx_cpulist_parse (dgfx_config.affinity_list, &list); // validated while parsing arguments
+
+        for (size_t i = 0; i < arrlenu (list); ++i)
+        {
+            if (list[i] >= CPU_SETSIZE || !CPU_ISSET (list[i], &allowed))
+            {
+                fprintf (stderr, "CPU %d from affinity list is not available to this process\n", list[i]);
+                arrfree (list);
+                return false;
+            }
+            struct dgfx_cpu c = { .cpu = list[i], .node = node_of[list[i]] };
+            arrput (dgfx_ctx.cpus, c);
+        }
+
+        arrfree (list);
+        return true;
     }
 
-    if (pthread_cond_init (&w->done_cond, NULL) != 0)
+    struct dgfx_cpu *topo = NULL;
+    char path[128];
+
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
     {
-        pthread_cond_destroy (&w->work_cond);
-        pthread_mutex_destroy (&w->mutex);
-        return false;
-    }
+        if (!CPU_ISSET (cpu, &allowed))
+            continue;
 
-    w->has_work = false;
-    w->work_complete = false;
-    w->should_exit = false;
-    w->thread_running = false;
+        struct dgfx_cpu c = { .cpu = cpu, .node = node_of[cpu] };
 
-    w->L = luaL_newstate ();
-    if (!w->L)
-        return false;
-    luaL_openlibs (w->L);
+        snprintf (path, sizeof (path), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+        c.package = dgfx_sysfs_read_int (path, 0);
+        snprintf (path, sizeof (path), "/sys/devices/system/cpu/cpu%d/topology/core_id", cpu);
+        c.core = dgfx_sysfs_read_int (path, cpu);
 
-    lua_newtable (w->L); // dgfx
+        arrput (topo, c);
+    }
 
-    lua_pushinteger (w->L, dgfx_config.w);
-    lua_setfield (w->L, -2, "width");
+    qsort (topo, arrlenu (topo), sizeof (*topo), dgfx_cpu_cmp_compact);
 
-    lua_pushinteger (w->L, dgfx_config.h);
-    lua_setfield (w->L, -2, "height");
+    // core ids are sparse and per package, so rank cores inside each node and number SMT siblings
+    for (size_t i = 0; i < arrlenu (topo); ++i)
+    {
+        struct dgfx_cpu *prev = i ? &topo[i - 1] : NULL;
+        bool same_node = prev && prev->node == topo[i].node;
+        bool same_core = same_node && prev->package == topo[i].package && prev->core == topo[i].core;
 
-    lua_newtable (w->L); // worker
+        topo[i].core_rank = same_core ? prev->core_rank : (same_node ? prev->core_rank + 1 : 0);
+        topo[i].sibling = same_core ? prev->sibling + 1 : 0;
+    }
 
-    lua_pushinteger (w->L, start_idx);
-    lua_setfield (w->L, -2, "start");
+    if (dgfx_config.affinity == AFFINITY_SCATTER)
+        qsort (topo, arrlenu (topo), sizeof (*topo), dgfx_cpu_cmp_scatter);
 
-    lua_pushinteger (w->L, work_len);
-    lua_setfield (w->L, -2, "len");
+    dgfx_ctx.cpus = topo;
+    return true;
+}
 
-    lua_pushinteger (w->L, id);
-    lua_setfield (w->L, -2, "id");
+// pins the calling thread according to the affinity policy
+void
+dgfx_affinity_apply (struct dgfx_worker *w)
+{
+    w->cpu = -1;
+    w->node = 0;
 
-    lua_setfield (w->L, -2, "worker");
+    if (arrlenu (dgfx_ctx.cpus) == 0)
+        return;
 
-    lua_setglobal (w->L, "dgfx");
+    const struct dgfx_cpu *c = &dgfx_ctx.cpus[w->id % arrlenu (dgfx_ctx.cpus)];
 
-    // fprintf(stdout, "id: %u, start: %lu, len: %lu\n", id, start_idx, work_len);
+    cpu_set_t set;
+    CPU_ZERO (&set);
+    CPU_SET (c->cpu, &set);
 
-    if (luaL_loadfile (w->L, dgfx_config.input_path) != 0)
+    int err = pthread_setaffinity_np (pthread_self (), sizeof (set), &set);
+    if (err != 0)
     {
-        fprintf (stderr, "lua load error: %s\n", lua_tostring (w->L, -1));
-        goto dgfx_worker_init_oopsie;
+        fprintf (stderr, "Failed to pin worker %zu to CPU %d: %s\n", w->id, c->cpu, strerror (err));
+        return;
     }
 
-    if (lua_pcall (w->L, 0, 0, 0) != 0)
-    {
-        fprintf (stderr, "lua runtime error: %s\n", lua_tostring (w->L, -1));
-        goto dgfx_worker_init_oopsie;
-    }
+    w->cpu = c->cpu;
+    w->node = c->node;
+}
 
-    lua_getglobal (w->L, "rgb");
-    if (!lua_isfunction (w->L, -1))
-    {
-        fprintf (stderr, "lua user script must define rgb(n,m,t) function\n");
-        goto dgfx_worker_init_oopsie;
-    }
-    lua_pop (w->L, 1);
+// ring of frame buffers between the renderer and the encoder pipe.
+// frame `f` lives in slot `f % depth`; the writer drains slots strictly in frame order.
+struct dgfx_frame_ring
+{
+    uint8_t *frames;
+    bool *ready;
+    size_t depth;
+    size_t frame_size;
 
-    if (luaL_loadfile (w->L, DGFX_RESOURCE_LUA_WORKER_CB) != 0)
-    {
-        fprintf (stderr, "lua load error: %s\n", lua_tostring (w->L, -1));
-        goto dgfx_worker_init_oopsie;
-    }
+    size_t next_write; // next frame the writer will send
+    bool closed;       // producer is done, writer drains what is left and exits
+    bool failed;       // writer could not send a frame, producer should stop
 
-    if (lua_pcall (w->L, 0, 0, 0) != 0)
+    int fd;
+    pthread_t writer;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t slot_free;
+    pthread_cond_t slot_ready;
+};
+
+bool
+dgfx_write_all (int fd, const uint8_t *buf, size_t len)
+{
+    while (len > 0)
     {
-        fprintf (stderr, "lua runtime error: %s\n", lua_tostring (w->L, -1));
-        goto dgfx_worker_init_oopsie;
+        ssize_t n = write (fd, buf, len);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        buf += n;
+        len -= n;
     }
+    return true;
+}
 
-    lua_getglobal (w->L, "__dgfx_worker_cb");
-    if (!lua_isfunction (w->L, -1))
+void *
+dgfx_frame_ring_writer (void *arg)
+{
+    struct dgfx_frame_ring *ring = arg;
+
+    pthread_mutex_lock (&ring->mutex);
+    while (true)
     {
-        fprintf (stderr, "lua script must define __dgfx_worker_cb\n");
-        goto dgfx_worker_init_oopsie;
-    }
-    w->lua_cb_ref = luaL_ref (w->L, LUA_REGISTRYINDEX);
+        size_t slot = ring->next_write % ring->depth;
 
-    int err = pthread_create (&w->thrd, NULL, dgfx_worker_work, w);
-    if (err != 0)
-        goto dgfx_worker_init_oopsie;
+        while (!ring->ready[slot] && !ring->closed)
+            pthread_cond_wait (&ring->slot_ready, &ring->mutex);
 
-    w->thread_running = true;
+        if (!ring->ready[slot])
+            break;
 
-    return true;
+        pthread_mutex_unlock (&ring->mutex);
+        bool ok = dgfx_write_all (ring->fd, ring->frames + slot * ring->frame_size, ring->frame_size);
+        pthread_mutex_lock (&ring->mutex);
 
-dgfx_worker_init_oopsie:
-    lua_close (w->L);
-    pthread_cond_destroy (&w->done_cond);
-    pthread_cond_destroy (&w->work_cond);
-    pthread_mutex_destroy (&w->mutex);
-    return false;
+        if (!ok)
+        {
+            perror ("write to pipe");
+            ring->failed = true;
+            pthread_cond_broadcast (&ring->slot_free);
+            break;
+        }
+
+        ring->ready[slot] = false;
+        ring->next_write++;
+        pthread_cond_broadcast (&ring->slot_free);
+    }
+    pthread_mutex_unlock (&ring->mutex);
+
+    return NULL;
 }
 
 bool
-dgfx_worker_start_work (struct dgfx_worker *w, double cur_t)
+dgfx_frame_ring_init (struct dgfx_frame_ring *ring, int fd, size_t depth, size_t frame_size)
 {
-    pthread_mutex_lock (&w->mutex);
+    *ring = (struct dgfx_frame_ring){ .depth = depth, .frame_size = frame_size, .fd = fd };
 
-    if (!w->thread_running)
+    ring->frames = malloc (depth * frame_size);
+    ring->ready = calloc (depth, sizeof (bool));
+    if (!ring->frames || !ring->ready)
     {
-        pthread_mutex_unlock (&w->mutex);
-        return false;
+        perror ("malloc");
+        goto dgfx_frame_ring_init_oopsie;
     }
 
-    w->t_param = cur_t;
-    w->has_work = true;
-    pthread_cond_signal (&w->work_cond);
+    if (pthread_mutex_init (&ring->mutex, NULL) != 0)
+        goto dgfx_frame_ring_init_oopsie;
 
-    pthread_mutex_unlock (&w->mutex);
-    return true;
-}
+    if (pthread_cond_init (&ring->slot_free, NULL) != 0)
+    {
+        pthread_mutex_destroy (&ring->mutex);
+        goto dgfx_frame_ring_init_oopsie;
+    }
 
-bool
-dgfx_worker_wait_completion (struct dgfx_worker *w)
-{
-    pthread_mutex_lock (&w->mutex);
+    if (pthread_cond_init (&ring->slot_ready, NULL) != 0)
+    {
+        pthread_cond_destroy (&ring->slot_free);
+        pthread_mutex_destroy (&ring->mutex);
+        goto dgfx_frame_ring_init_oopsie;
+    }
 
-    while (!w->work_complete && w->thread_running)
+    if (pthread_create (&ring->writer, NULL, dgfx_frame_ring_writer, ring) != 0)
     {
-        pthread_cond_wait (&w->done_cond, &w->mutex);
+        pthread_cond_destroy (&ring->slot_ready);
+        pthread_cond_destroy (&ring->slot_free);
+        pthread_mutex_destroy (&ring->mutex);
+        goto dgfx_frame_ring_init_oopsie;
     }
 
-    bool success = w->work_complete && (w->work_done == w->work_len);
-    pthread_mutex_unlock (&w->mutex);
+    return true;
 
-    return success;
+dgfx_frame_ring_init_oopsie:
+    free (ring->ready);
+    free (ring->frames);
+    return false;
 }
 
-void
-dgfx_worker_shutdown (struct dgfx_worker *w)
+// blocks until frame's slot has been drained; NULL if the writer gave up
+uint8_t *
+dgfx_frame_ring_acquire (struct dgfx_frame_ring *ring, size_t frame)
 {
-    if (!w->thread_running)
-    {
-        return;
-    }
-
-    pthread_mutex_lock (&w->mutex);
-    w->should_exit = true;
-    pthread_cond_signal (&w->work_cond);
-    pthread_mutex_unlock (&w->mutex);
-
-    pthread_join (w->thrd, NULL);
-    w->thread_running = false;
+    pthread_mutex_lock (&ring->mutex);
+    while (frame >= ring->next_write + ring->depth && !ring->failed)
+        pthread_cond_wait (&ring->slot_free, &ring->mutex);
+    bool failed = ring->failed;
+    pthread_mutex_unlock (&ring->mutex);
 
-    luaL_unref (w->L, LUA_REGISTRYINDEX, w->lua_cb_ref);
-    lua_close (w->L);
+    return failed ? NULL : ring->frames + (frame % ring->depth) * ring->frame_size;
+}
 
-    pthread_cond_destroy (&w->done_cond);
-    pthread_cond_destroy (&w->work_cond);
-    pthread_mutex_destroy (&w->mutex);
+// wakes producers blocked in acquire after a frame failed to render
+void
+dgfx_frame_ring_abort (struct dgfx_frame_ring *ring)
+{
+    pthread_mutex_lock (&ring->mutex);
+    ring->failed = true;
+    pthread_cond_broadcast (&ring->slot_free);
+    pthread_mutex_unlock (&ring->mutex);
 }
 
-struct
+void
+dgfx_frame_ring_submit (struct dgfx_frame_ring *ring, size_t frame)
 {
-    uint8_t *pixels;
-    struct dgfx_worker *workers;
-} dgfx_ctx = {
-    .workers = NULL,
-    .pixels = NULL,
-};
+    pthread_mutex_lock (&ring->mutex);
+    ring->ready[frame % ring->depth] = true;
+    pthread_cond_signal (&ring->slot_ready);
+    pthread_mutex_unlock (&ring->mutex);
+}
 
+// flushes submitted frames and stops the writer
 bool
-dgfx_init (uint8_t *init_pixels)
+dgfx_frame_ring_deinit (struct dgfx_frame_ring *ring)
 {
-    dgfx_ctx.pixels = init_pixels;
+    pthread_mutex_lock (&ring->mutex);
+    ring->closed = true;
+    pthread_cond_signal (&ring->slot_ready);
+    pthread_mutex_unlock (&ring->mutex);
 
-    size_t total_pixels = dgfx_config.w * dgfx_config.h;
-    size_t n_workers = dgfx_config.worker_n ? dgfx_config.worker_n : 1;
+    pthread_join (ring->writer, NULL);
 
-    arrsetcap (dgfx_ctx.workers, n_workers);
+    bool ok = !ring->failed;
 
-    for (size_t i = 0; i < n_workers; ++i)
-    {
-        size_t per = total_pixels / n_workers;
-        size_t start = i * per;
-        if (i == n_workers - 1)
-            per = total_pixels - start;
+    pthread_cond_destroy (&ring->slot_ready);
+    pthread_cond_destroy (&ring->slot_free);
+    pthread_mutex_destroy (&ring->mutex);
+    free (ring->ready);
+    free (ring->frames);
 
-        arrput (dgfx_ctx.workers, (struct dgfx_worker){ 0 });
-        struct dgfx_worker *w = &dgfx_ctx.workers[arrlenu (dgfx_ctx.workers) - 1];
+    return ok;
+}
 
-        if (!dgfx_worker_init (w, (uint8_t)i, &dgfx_ctx.pixels, start, per))
-        {
-            for (size_t j = 0; j < arrlenu (dgfx_ctx.workers); ++j)
-                dgfx_worker_shutdown (&dgfx_ctx.workers[j]);
+#define DGFX_RANGE_PACK(head, tail) (((uint64_t)(head) << 32) | (uint32_t)(tail))
+#define DGFX_RANGE_HEAD(range) ((uint32_t)((range) >> 32))
+#define DGFX_RANGE_TAIL(range) ((uint32_t)(range))
 
-            arrfree (dgfx_ctx.workers);
+bool
+dgfx_deque_pop_front (_Atomic uint64_t *range, uint32_t *tile_idx)
+{
+    uint64_t r = atomic_load_explicit (range, memory_order_relaxed);
+
+    while (DGFX_RANGE_HEAD (r) < DGFX_RANGE_TAIL (r))
+    {
+        uint64_t next = DGFX_RANGE_PACK (DGFX_RANGE_HEAD (r) + 1, DGFX_RANGE_TAIL (r));
+        if (atomic_compare_exchange_weak_explicit (range, &r, next, memory_order_relaxed, memory_order_relaxed))
+        {
+            *tile_idx = DGFX_RANGE_HEAD (r);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool
+dgfx_deque_pop_back (_Atomic uint64_t *range, uint32_t *tile_idx)
+{
+    uint64_t r = atomic_load_explicit (range, memory_order_relaxed);
+
+    while (DGFX_RANGE_HEAD (r) < DGFX_RANGE_TAIL (r))
+    {
+        uint64_t next = DGFX_RANGE_PACK (DGFX_RANGE_HEAD (r), DGFX_RANGE_TAIL (r) - 1);
+        if (atomic_compare_exchange_weak_explicit (range, &r, next, memory_order_relaxed, memory_order_relaxed))
+        {
+            *tile_idx = DGFX_RANGE_TAIL (r) - 1;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// next tile for worker `w`: own deque first, then steal from the others, starting at the neighbour.
+// deques are only refilled between frames, so once every deque is empty the frame is fully handed out.
+bool
+dgfx_sched_next (struct dgfx_worker *w, uint32_t *tile_idx)
+{
+    uint32_t pos;
+
+    if (dgfx_deque_pop_front (&w->tile_range, &pos))
+    {
+        *tile_idx = dgfx_ctx.tile_order[pos];
+        return true;
+    }
+
+    size_t n = dgfx_ctx.sync->active_n;
+    for (size_t k = 1; k < n; ++k)
+    {
+        struct dgfx_worker *victim = &dgfx_ctx.workers[(w->id + k) % n];
+        if (dgfx_deque_pop_back (&victim->tile_range, &pos))
+        {
+            *tile_idx = dgfx_ctx.tile_order[pos];
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// top left pixel of `tile` in a framebuffer
+uint8_t *
+dgfx_tile_pixels (const struct dgfx_tile *tile, uint8_t *pixels, size_t pitch)
+{
+    return pixels + tile->y * pitch + (size_t)tile->x * 4;
+}
+
+// fills a frame of which dgfx_tiles_build only had the part that changes shaded: a pixel per row when the script
+// doesn't depend on x, a row when it doesn't depend on y. `size` is the bytes per pixel, 4 or 16 for floats.
+void
+dgfx_broadcast (void *pixels, size_t pitch, size_t size)
+{
+    uint8_t *p = pixels;
+    size_t row = dgfx_config.w * size;
+
+    if (!(dgfx_ctx.depends & DEPENDS_X))
+    {
+        // doubling the filled part, so a row takes log2 (w) copies
+        size_t rows = dgfx_ctx.depends & DEPENDS_Y ? dgfx_config.h : 1;
+        for (size_t y = 0; y < rows; ++y)
+            for (size_t done = size; done < row; done *= 2)
+                memcpy (p + y * pitch + done, p + y * pitch, done < row - done ? done : row - done);
+    }
+
+    if (!(dgfx_ctx.depends & DEPENDS_Y))
+        for (size_t y = 1; y < dgfx_config.h; ++y)
+            memcpy (p + y * pitch, p, row);
+}
+
+// tiles in a frame, like arrlenu (dgfx_ctx.tiles), which --serve does not build
+size_t
+dgfx_tile_count (void)
+{
+    size_t tiles_x = (dgfx_config.w + dgfx_config.tile_w - 1) / dgfx_config.tile_w;
+    size_t tiles_y = (dgfx_config.h + dgfx_config.tile_h - 1) / dgfx_config.tile_h;
+    return tiles_x * tiles_y;
+}
+
+// position of `tile` in dgfx_ctx.tiles, computed from its origin so tiles received by --serve map the same way
+size_t
+dgfx_tile_index (const struct dgfx_tile *tile)
+{
+    size_t tiles_x = (dgfx_config.w + dgfx_config.tile_w - 1) / dgfx_config.tile_w;
+    return (size_t)(tile->y / dgfx_config.tile_h) * tiles_x + tile->x / dgfx_config.tile_w;
+}
+
+// setup()/shade() scripts: room for every tile's setup values, tile after tile. inside a tile's block the values
+// are split by index (all first values, then all second ...), so shade() reads `setup_floats` sequential streams.
+// blocks are filled by whichever worker shades the tile first, and pages nobody touches are never backed.
+// with processes it lives in `setup_fd`, so a tile is set up once no matter who shades it later. worker processes
+// are forked before anyone knows its size, so each maps it on first use, after dgfx_setup_cache_init sized it.
+bool
+dgfx_setup_cache_map (size_t setup_floats)
+{
+    size_t n_tiles = dgfx_tile_count ();
+    size_t ready_size = DGFX_CACHE_ROUND (n_tiles);
+    size_t size = ready_size + n_tiles * setup_floats * dgfx_config.tile_w * dgfx_config.tile_h * sizeof (float);
+
+    void *mem = dgfx_ctx.setup_fd >= 0
+                    ? mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, dgfx_ctx.setup_fd, 0)
+                    : mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED)
+    {
+        perror ("mmap");
+        return false;
+    }
+
+    dgfx_ctx.setup_ready = mem;
+    dgfx_ctx.setup_cache = (float *)((uint8_t *)mem + ready_size);
+    dgfx_ctx.setup_size = size;
+    return true;
+}
+
+bool
+dgfx_setup_cache_init (size_t setup_floats)
+{
+    dgfx_ctx.setup_floats = setup_floats;
+
+    if (dgfx_ctx.setup_fd >= 0)
+    {
+        size_t n_tiles = dgfx_tile_count ();
+        size_t size
+            = DGFX_CACHE_ROUND (n_tiles) + n_tiles * setup_floats * dgfx_config.tile_w * dgfx_config.tile_h * sizeof (float);
+        if (ftruncate (dgfx_ctx.setup_fd, size) != 0)
+        {
+            perror ("ftruncate");
+            return false;
+        }
+    }
+
+    return dgfx_setup_cache_map (setup_floats);
+}
+
+void
+dgfx_setup_cache_deinit (void)
+{
+    if (dgfx_ctx.setup_ready)
+        munmap ((void *)dgfx_ctx.setup_ready, dgfx_ctx.setup_size);
+    if (dgfx_ctx.setup_fd >= 0)
+        close (dgfx_ctx.setup_fd);
+    dgfx_ctx.setup_fd = -1;
+    dgfx_ctx.setup_ready = NULL;
+    dgfx_ctx.setup_cache = NULL;
+    dgfx_ctx.setup_floats = 0;
+}
+
+float
+dgfx_tonemap (float v)
+{
+    switch (dgfx_config.tonemap)
+    {
+    case TONEMAP_REINHARD:
+        return v / (1.0f + v);
+    case TONEMAP_ACES: // Narkowicz's fit of the ACES filmic curve
+        return v * (2.51f * v + 0.03f) / (v * (2.43f * v + 0.59f) + 0.14f);
+    default:
+        return v;
+    }
+}
+
+#if defined(__SSE2__)
+__m128
+dgfx_tonemap4 (__m128 v)
+{
+    switch (dgfx_config.tonemap)
+    {
+    case TONEMAP_REINHARD:
+        return _mm_div_ps (v, _mm_add_ps (_mm_set1_ps (1.0f), v));
+    case TONEMAP_ACES: {
+        __m128 num = _mm_mul_ps (v, _mm_add_ps (_mm_mul_ps (_mm_set1_ps (2.51f), v), _mm_set1_ps (0.03f)));
+        __m128 den = _mm_add_ps (_mm_mul_ps (v, _mm_add_ps (_mm_mul_ps (_mm_set1_ps (2.43f), v), _mm_set1_ps (0.59f))),
+                                 _mm_set1_ps (0.14f));
+        return _mm_div_ps (num, den);
+    }
+    default:
+        return v;
+    }
+}
+#endif
+
+// float r, g, b, x pixels to 8 bit rgba: exposure, tone mapping, clamp to [0, 1] (NaN becomes 0), round.
+// `src_pitch` counts floats, `dst_pitch` bytes.
+void
+dgfx_quantize_tile (const float *src, size_t src_pitch, uint8_t *dst, size_t dst_pitch, uint32_t w, uint32_t h)
+{
+    float scale = exp2f (dgfx_config.exposure);
+
+#if defined(__SSE2__)
+    const __m128 v_scale = _mm_set1_ps (scale), v_zero = _mm_setzero_ps (), v_one = _mm_set1_ps (1.0f),
+                 v_255 = _mm_set1_ps (255.0f);
+    const __m128i rgb_mask = _mm_set1_epi32 (0x00FFFFFF), alpha = _mm_set1_epi32 ((int)0xFF000000);
+#endif
+
+    for (uint32_t y = 0; y < h; ++y, src += src_pitch, dst += dst_pitch)
+    {
+        uint32_t x = 0;
+
+#if defined(__SSE2__)
+        for (; x + 4 <= w; x += 4) // 4 pixels per iteration, one vector each
+        {
+            __m128i q[4];
+            for (int i = 0; i < 4; ++i)
+            {
+                __m128 v = dgfx_tonemap4 (_mm_mul_ps (_mm_loadu_ps (src + (x + i) * 4), v_scale));
+                v = _mm_min_ps (_mm_max_ps (v, v_zero), v_one); // max first: it returns 0 for NaN
+                q[i] = _mm_cvtps_epi32 (_mm_mul_ps (v, v_255));
+            }
+
+            __m128i packed = _mm_packus_epi16 (_mm_packs_epi32 (q[0], q[1]), _mm_packs_epi32 (q[2], q[3]));
+            packed = _mm_or_si128 (_mm_and_si128 (packed, rgb_mask), alpha);
+            _mm_storeu_si128 ((__m128i *)(dst + x * 4), packed);
+        }
+#endif
+
+        for (; x < w; ++x)
+        {
+            for (int c = 0; c < 3; ++c)
+            {
+                float v = dgfx_tonemap (src[x * 4 + c] * scale);
+                v = v > 0.0f ? v : 0.0f;
+                v = v < 1.0f ? v : 1.0f;
+                dst[x * 4 + c] = (uint8_t)lrintf (v * 255.0f);
+            }
+            dst[x * 4 + 3] = 255;
+        }
+    }
+}
+
+// where a tile's float pixels go before they are quantized: the kept frame with .hdr output, the worker's
+// scratch tile otherwise. `*pitch` counts floats.
+float *
+dgfx_worker_float_tile (struct dgfx_worker *w, const struct dgfx_tile *tile, size_t *pitch)
+{
+    if (dgfx_ctx.hdr_frame)
+    {
+        *pitch = dgfx_config.w * 4;
+        return dgfx_ctx.hdr_frame + tile->y * *pitch + (size_t)tile->x * 4;
+    }
+
+    if (!w->hdr_tile)
+        w->hdr_tile = malloc ((size_t)dgfx_config.tile_w * dgfx_config.tile_h * 4 * sizeof (float));
+    if (!w->hdr_tile)
+    {
+        perror ("malloc");
+        return NULL;
+    }
+
+    *pitch = (size_t)tile->w * 4;
+    return w->hdr_tile;
+}
+
+// plugins always shade floats, without --hdr they are only clamped on the way into `dst`
+bool
+dgfx_worker_shade_tile_plugin (struct dgfx_worker *w, const struct dgfx_tile *tile, double t, uint8_t *dst,
+                               size_t pitch)
+{
+    size_t src_pitch = 0;
+    float *src = dgfx_worker_float_tile (w, tile, &src_pitch);
+    if (!src)
+        return false;
+
+    int err = dgfx_ctx.plugin->shade_tile (w->plugin_state, t, tile->x, tile->y, tile->w, tile->h, src, src_pitch);
+    if (err != 0)
+    {
+        fprintf (stderr, "Plugin error in worker %zu: shade_tile returned %d\n", w->id, err);
+        return false;
+    }
+
+    dgfx_quantize_tile (src, src_pitch, dst, pitch, tile->w, tile->h);
+    return true;
+}
+
+// one pass over the nodes of a --trace stage. lanes hold consecutive pixels of a row, `x` is the first one's.
+// every operation is a loop over the lanes the compiler turns into vector instructions, built for avx-512 and
+// avx2 as well and picked at load time. math.* functions stay calls to the same libm luajit uses, one per lane.
+#define DGFX_TRACE_LANEWISE(expr)                                                                                      \
+    for (int l = 0; l < DGFX_TRACE_LANES; ++l)                                                                         \
+        d[l] = (expr);                                                                                                 \
+    break
+
+#if defined(__x86_64__) && defined(__GNUC__)
+__attribute__ ((target_clones ("default", "arch=x86-64-v3", "arch=x86-64-v4")))
+#endif
+void
+dgfx_trace_run (const struct dgfx_trace_node *nodes, const uint32_t *stage, size_t n, double *regs, double x, double y,
+                double t)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        const struct dgfx_trace_node *node = &nodes[stage[i]];
+        double *restrict d = regs + (size_t)stage[i] * DGFX_TRACE_LANES;
+        const double *restrict a = regs + (size_t)node->a * DGFX_TRACE_LANES;
+        const double *restrict b = regs + (size_t)node->b * DGFX_TRACE_LANES;
+
+        switch (node->op)
+        {
+        case TRACE_OP_CONST:
+            DGFX_TRACE_LANEWISE (node->k);
+        case TRACE_OP_X:
+            DGFX_TRACE_LANEWISE (x + l);
+        case TRACE_OP_Y:
+            DGFX_TRACE_LANEWISE (y);
+        case TRACE_OP_T:
+            DGFX_TRACE_LANEWISE (t);
+        case TRACE_OP_ADD:
+            DGFX_TRACE_LANEWISE (a[l] + b[l]);
+        case TRACE_OP_SUB:
+            DGFX_TRACE_LANEWISE (a[l] - b[l]);
+        case TRACE_OP_MUL:
+            DGFX_TRACE_LANEWISE (a[l] * b[l]);
+        case TRACE_OP_DIV:
+            DGFX_TRACE_LANEWISE (a[l] / b[l]);
+        case TRACE_OP_MOD: // lua's, the result takes the divisor's sign
+            DGFX_TRACE_LANEWISE (a[l] - floor (a[l] / b[l]) * b[l]);
+        case TRACE_OP_POW:
+            DGFX_TRACE_LANEWISE (pow (a[l], b[l]));
+        case TRACE_OP_MIN: // operand order of luajit's minsd/maxsd, for NaNs and signed zeros
+            DGFX_TRACE_LANEWISE (a[l] < b[l] ? a[l] : b[l]);
+        case TRACE_OP_MAX:
+            DGFX_TRACE_LANEWISE (a[l] > b[l] ? a[l] : b[l]);
+        case TRACE_OP_FMOD:
+            DGFX_TRACE_LANEWISE (fmod (a[l], b[l]));
+        case TRACE_OP_ATAN2:
+            DGFX_TRACE_LANEWISE (atan2 (a[l], b[l]));
+        case TRACE_OP_LDEXP:
+            DGFX_TRACE_LANEWISE (ldexp (a[l], (int)b[l]));
+        case TRACE_OP_UNM:
+            DGFX_TRACE_LANEWISE (-a[l]);
+        case TRACE_OP_ABS:
+            DGFX_TRACE_LANEWISE (fabs (a[l]));
+        case TRACE_OP_FLOOR:
+            DGFX_TRACE_LANEWISE (floor (a[l]));
+        case TRACE_OP_CEIL:
+            DGFX_TRACE_LANEWISE (ceil (a[l]));
+        case TRACE_OP_SQRT:
+            DGFX_TRACE_LANEWISE (sqrt (a[l]));
+        case TRACE_OP_EXP:
+            DGFX_TRACE_LANEWISE (exp (a[l]));
+        case TRACE_OP_LOG:
+            DGFX_TRACE_LANEWISE (log (a[l]));
+        case TRACE_OP_LOG2:
+            DGFX_TRACE_LANEWISE (log2 (a[l]));
+        case TRACE_OP_LOG10:
+            DGFX_TRACE_LANEWISE (log10 (a[l]));
+        case TRACE_OP_SIN:
+            DGFX_TRACE_LANEWISE (sin (a[l]));
+        case TRACE_OP_COS:
+            DGFX_TRACE_LANEWISE (cos (a[l]));
+        case TRACE_OP_TAN:
+            DGFX_TRACE_LANEWISE (tan (a[l]));
+        case TRACE_OP_ASIN:
+            DGFX_TRACE_LANEWISE (asin (a[l]));
+        case TRACE_OP_ACOS:
+            DGFX_TRACE_LANEWISE (acos (a[l]));
+        case TRACE_OP_ATAN:
+            DGFX_TRACE_LANEWISE (atan (a[l]));
+        case TRACE_OP_SINH:
+            DGFX_TRACE_LANEWISE (sinh (a[l]));
+        case TRACE_OP_COSH:
+            DGFX_TRACE_LANEWISE (cosh (a[l]));
+        case TRACE_OP_TANH:
+            DGFX_TRACE_LANEWISE (tanh (a[l]));
+        default:
+            UNREACHABLE;
+        }
+    }
+}
+
+// the --trace program for pixel row `y` of `t`, starting at `x`: runs the stages from `first` on, earlier ones
+// still hold their values
+void
+dgfx_trace_eval (double *regs, int first, double x, double y, double t)
+{
+    for (int s = first; s < TRACE_STAGE_N; ++s)
+        dgfx_trace_run (dgfx_ctx.trace, dgfx_ctx.trace_stage[s], arrlenu (dgfx_ctx.trace_stage[s]), regs, x, y, t);
+}
+
+// writes the first `lanes` pixels of a --trace packet's output as rgba bytes, like the ffi write path's uint8_t
+// stores: clamped to [0, 255], NaN to 0, and truncated (see aot_out in DGFX_RESOURCE_LUA_AOT)
+#if defined(__x86_64__) && defined(__GNUC__)
+__attribute__ ((target_clones ("default", "arch=x86-64-v3", "arch=x86-64-v4")))
+#endif
+void
+dgfx_trace_store (const double *const out[3], uint8_t *restrict p, uint32_t lanes)
+{
+    int32_t q[3][DGFX_TRACE_LANES];
+    for (int c = 0; c < 3; ++c)
+    {
+        for (int l = 0; l < DGFX_TRACE_LANES; ++l)
+        {
+            double v = out[c][l] * 255.0;
+            v = v > 0.0 ? v : 0.0;
+            v = v < 255.0 ? v : 255.0;
+            q[c][l] = (int32_t)v;
+        }
+    }
+
+    uint8_t rgba[DGFX_TRACE_LANES][4];
+    for (int l = 0; l < DGFX_TRACE_LANES; ++l)
+    {
+        for (int c = 0; c < 3; ++c)
+            rgba[l][c] = (uint8_t)q[c][l];
+        rgba[l][3] = 255;
+    }
+    memcpy (p, rgba, (size_t)lanes * 4);
+}
+
+// --hdr counterpart of dgfx_trace_store, into a float tile for dgfx_quantize_tile
+void
+dgfx_trace_store_float (const double *const out[3], float *restrict p, uint32_t lanes)
+{
+    for (uint32_t l = 0; l < lanes; ++l)
+    {
+        for (int c = 0; c < 3; ++c)
+            p[l * 4 + c] = (float)out[c][l];
+    }
+}
+
+// --trace counterpart of dgfx_worker_shade_tile_plugin. what only depends on t is computed once per tile, what
+// only depends on y and t once per row, the rest once per DGFX_TRACE_LANES pixels. bytes are stored like the ffi
+// write path's, with --hdr the floats go through dgfx_quantize_tile.
+bool
+dgfx_worker_shade_tile_trace (struct dgfx_worker *w, const struct dgfx_tile *tile, double t, uint8_t *dst,
+                              size_t pitch)
+{
+    size_t src_pitch = 0;
+    float *src = dgfx_config.hdr ? dgfx_worker_float_tile (w, tile, &src_pitch) : NULL;
+    if (dgfx_config.hdr && !src)
+        return false;
+
+    double *regs = w->trace_regs;
+    const double *out[3];
+    for (int c = 0; c < 3; ++c)
+        out[c] = regs + (size_t)dgfx_ctx.trace_out[c] * DGFX_TRACE_LANES;
+
+    // the first packet of a row is evaluated with the row's stage, the first row with the tile's
+    dgfx_trace_eval (regs, TRACE_STAGE_TILE, tile->x, tile->y, t);
+    for (uint32_t y = 0; y < tile->h; ++y)
+    {
+        if (y > 0)
+            dgfx_trace_eval (regs, TRACE_STAGE_ROW, tile->x, tile->y + y, t);
+
+        for (uint32_t x = 0; x < tile->w; x += DGFX_TRACE_LANES)
+        {
+            if (x > 0)
+                dgfx_trace_eval (regs, TRACE_STAGE_PACKET, tile->x + x, tile->y + y, t);
+
+            uint32_t lanes = tile->w - x < DGFX_TRACE_LANES ? tile->w - x : DGFX_TRACE_LANES;
+            if (src)
+                dgfx_trace_store_float (out, src + y * src_pitch + x * 4, lanes);
+            else
+                dgfx_trace_store (out, dst + y * pitch + x * 4, lanes);
+        }
+    }
+
+    if (src)
+        dgfx_quantize_tile (src, src_pitch, dst, pitch, tile->w, tile->h);
+    return true;
+}
+
+// `dst` is the tile's top left pixel, `pitch` the distance between its rows
+bool
+dgfx_worker_shade_tile (struct dgfx_worker *w, const struct dgfx_tile *tile, double t, uint8_t *dst, size_t pitch)
+{
+    if (dgfx_ctx.plugin)
+        return dgfx_worker_shade_tile_plugin (w, tile, t, dst, pitch);
+    if (dgfx_ctx.trace)
+        return dgfx_worker_shade_tile_trace (w, tile, t, dst, pitch);
+
+    if (w->setup_floats && !dgfx_ctx.setup_cache && !dgfx_setup_cache_map (w->setup_floats))
+        return false;
+
+    lua_rawgeti (w->L, LUA_REGISTRYINDEX, w->lua_cb_ref);
+
+    lua_pushnumber (w->L, (lua_Number)t);
+    lua_pushinteger (w->L, tile->x);
+    lua_pushinteger (w->L, tile->y);
+    lua_pushinteger (w->L, tile->w);
+    lua_pushinteger (w->L, tile->h);
+
+    float *src = NULL;
+    size_t src_pitch = 0;
+
+    if (dgfx_config.hdr) // floats go to the kept frame, or to a scratch tile, then get quantized into `dst`
+    {
+        src = dgfx_worker_float_tile (w, tile, &src_pitch);
+        if (!src)
+        {
+            lua_pop (w->L, 6);
+            return false;
+        }
+
+        lua_pushlightuserdata (w->L, src);
+        lua_pushinteger (w->L, src_pitch);
+    }
+
+    bool ffi = dgfx_config.write_path == WRITE_PATH_FFI;
+    if (ffi && !dgfx_config.hdr) // the callback stores straight into the framebuffer
+    {
+        lua_pushlightuserdata (w->L, dst);
+        lua_pushinteger (w->L, pitch);
+    }
+
+    bool returns_string = !ffi && !dgfx_config.hdr;
+    int nargs = returns_string ? 5 : 7;
+
+    // setup()/shade(): the tile's block of cached setup values, and whether it still has to be filled.
+    // two workers filling the same block at once (--parallel frames) store the same values, so no lock.
+    size_t tile_idx = 0;
+    bool fill = false;
+    if (dgfx_ctx.setup_cache)
+    {
+        if (returns_string)
+        {
+            lua_pushnil (w->L);
+            lua_pushnil (w->L);
+        }
+
+        tile_idx = dgfx_tile_index (tile);
+        fill = !atomic_load_explicit (&dgfx_ctx.setup_ready[tile_idx], memory_order_acquire);
+        lua_pushlightuserdata (w->L, dgfx_ctx.setup_cache
+                                         + tile_idx * w->setup_floats * dgfx_config.tile_w * dgfx_config.tile_h);
+        lua_pushboolean (w->L, fill);
+        nargs = 9;
+    }
+
+    if (lua_pcall (w->L, nargs, returns_string ? 1 : 0, 0) != LUA_OK)
+    {
+        fprintf (stderr, "Lua error in worker %zu: %s\n", w->id, lua_tostring (w->L, -1));
+        lua_pop (w->L, 1);
+        return false;
+    }
+
+    if (fill)
+        atomic_store_explicit (&dgfx_ctx.setup_ready[tile_idx], 1, memory_order_release);
+
+    if (dgfx_config.hdr)
+        dgfx_quantize_tile (src, src_pitch, dst, pitch, tile->w, tile->h);
+
+    if (!returns_string)
+        return true;
+
+    size_t ret_len = 0;
+    const char *buf = lua_tolstring (w->L, -1, &ret_len);
+    if (!buf)
+        buf = "";
+
+    size_t row_len = (size_t)tile->w * 4;
+
+    for (uint32_t row = 0; row < tile->h; ++row, dst += pitch)
+    {
+        size_t offset = row * row_len;
+        size_t copy_len = offset < ret_len ? ret_len - offset : 0;
+        if (copy_len > row_len)
+            copy_len = row_len;
+
+        memcpy (dst, buf + offset, copy_len);
+        if (copy_len < row_len)
+            memset (dst + copy_len, 0, row_len - copy_len);
+    }
+
+    lua_pop (w->L, 1);
+    return true;
+}
+
+// remote workers: the coordinator connects to `dgfx --serve` processes and drives each connection from a thread
+// that schedules tiles like any local worker. all integers on the wire are big endian.
+#define DGFX_REMOTE_MAGIC 0x44474658 // "DGFX"
+#define DGFX_REMOTE_VERSION 2
+
+// coordinator -> server, followed by `name_len` bytes of script path and `script_len` bytes of script.
+// answered with a status word, 0 once the server's lua state is ready.
+struct dgfx_remote_hello
+{
+    uint32_t magic, version;
+    uint32_t w, h;
+    uint32_t tile_w, tile_h;
+    uint32_t id;
+    uint32_t hdr, tonemap, exposure; // exposure holds the bits of a float
+    uint32_t name_len, script_len;
+};
+
+// answered with a status word, followed by w * h * 4 bytes of pixels when it is 0
+struct dgfx_remote_request
+{
+    uint32_t t_hi, t_lo; // bits of the double `t`
+    uint32_t x, y, w, h;
+};
+
+bool
+dgfx_send_all (int fd, const void *buf, size_t len)
+{
+    const uint8_t *p = buf;
+    while (len > 0)
+    {
+        ssize_t n = send (fd, p, len, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool
+dgfx_recv_all (int fd, void *buf, size_t len)
+{
+    uint8_t *p = buf;
+    while (len > 0)
+    {
+        ssize_t n = recv (fd, p, len, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+// 127.0.0.0/8, ::1 and ::ffff:127.0.0.0/104
+bool
+dgfx_addr_loopback (const struct sockaddr *sa)
+{
+    if (sa->sa_family == AF_INET)
+        return ntohl (((const struct sockaddr_in *)sa)->sin_addr.s_addr) >> 24 == 127;
+
+    if (sa->sa_family == AF_INET6)
+    {
+        const struct in6_addr *a = &((const struct sockaddr_in6 *)sa)->sin6_addr;
+        return IN6_IS_ADDR_LOOPBACK (a) || (IN6_IS_ADDR_V4MAPPED (a) && a->s6_addr[12] == 127);
+    }
+
+    return false;
+}
+
+// "unix:<path>" or "<host>:<port>" ("[<ipv6>]:<port>"). connects, or listens when `serve` is set.
+int
+dgfx_socket_open (const char *addr, bool serve)
+{
+    if (strncmp (addr, "unix:", 5) == 0)
+    {
+        struct sockaddr_un sun = { .sun_family = AF_UNIX };
+        if (strlen (addr + 5) >= sizeof (sun.sun_path))
+        {
+            fprintf (stderr, "Socket path too long: %s\n", addr + 5);
+            return -1;
+        }
+        strcpy (sun.sun_path, addr + 5);
+
+        int fd = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+        {
+            perror ("socket");
+            return -1;
+        }
+
+        if (serve)
+            unlink (sun.sun_path);
+
+        int err = serve ? bind (fd, (struct sockaddr *)&sun, sizeof (sun))
+                        : connect (fd, (struct sockaddr *)&sun, sizeof (sun));
+        if (err == 0 && serve)
+            err = listen (fd, SOMAXCONN);
+        if (err != 0)
+        {
+            fprintf (stderr, "%s: %s\n", addr, strerror (errno));
+            close (fd);
+            return -1;
+        }
+
+        return fd;
+    }
+
+    const char *colon = strrchr (addr, ':');
+    if (!colon)
+    {
+        fprintf (stderr, "Invalid address: %s\n", addr);
+        return -1;
+    }
+
+    char host[256];
+    if (addr[0] == '[' && colon > addr && colon[-1] == ']')
+        snprintf (host, sizeof (host), "%.*s", (int)(colon - addr - 2), addr + 1);
+    else
+        snprintf (host, sizeof (host), "%.*s", (int)(colon - addr), addr);
+
+    // without a host, a server listens on every interface when it was told to, on 127.0.0.1 otherwise: clients
+    // asking for "localhost" try it after ::1
+    if (!host[0] && serve && !dgfx_config.serve_public)
+        strcpy (host, "127.0.0.1");
+
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM, .ai_flags = serve ? AI_PASSIVE : 0 };
+    struct addrinfo *res = NULL;
+    int gai = getaddrinfo (host[0] ? host : NULL, colon + 1, &hints, &res);
+    if (gai != 0)
+    {
+        fprintf (stderr, "%s: %s\n", addr, gai_strerror (gai));
+        return -1;
+    }
+
+    int fd = -1, err = 0;
+    for (struct addrinfo *ai = res; ai; ai = ai->ai_next)
+    {
+        if (serve && !dgfx_config.serve_public && !dgfx_addr_loopback (ai->ai_addr))
+        {
+            fprintf (stderr, "%s: not a loopback address. --serve runs any script sent to it, without asking who sent "
+                             "it; add --serve-public to listen there anyway\n",
+                     addr);
+            freeaddrinfo (res);
+            return -1;
+        }
+
+        fd = socket (ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd < 0)
+        {
+            err = errno;
+            continue;
+        }
+
+        // requests are small and pipelined, don't let nagle hold them back
+        int one = 1;
+        setsockopt (fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof (one));
+        if (serve)
+            setsockopt (fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof (one));
+
+        if (serve ? bind (fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen (fd, SOMAXCONN) == 0
+                  : connect (fd, ai->ai_addr, ai->ai_addrlen) == 0)
+            break;
+
+        err = errno;
+        close (fd);
+        fd = -1;
+    }
+    freeaddrinfo (res);
+
+    if (fd < 0)
+        fprintf (stderr, "%s: %s\n", addr, strerror (err));
+    return fd;
+}
+
+// records why `w` could not start, reported together with the other workers' errors by dgfx_workers_wait
+void
+dgfx_worker_fail (struct dgfx_worker *w, const char *fmt, ...)
+{
+    va_list ap;
+    va_start (ap, fmt);
+    vsnprintf (w->startup_error, sizeof (w->startup_error), fmt, ap);
+    va_end (ap);
+}
+
+// whole file into the stb_ds array `*out`
+bool
+dgfx_file_read (const char *path, char **out)
+{
+    FILE *f = fopen (path, "rb");
+    if (!f)
+    {
+        perror (path);
+        return false;
+    }
+
+    char chunk[4096];
+    size_t n;
+    while ((n = fread (chunk, 1, sizeof (chunk), f)) > 0)
+        memcpy (arraddnptr (*out, n), chunk, n);
+
+    bool ok = !ferror (f);
+    if (!ok)
+        perror (path);
+    fclose (f);
+    return ok;
+}
+
+// connects `w` to its server and has it build a lua state from our script, resolution and tile size.
+// the server gets the source rather than our bytecode, its luajit build may differ.
+bool
+dgfx_remote_connect (struct dgfx_worker *w)
+{
+    char *script = NULL;
+    if (!dgfx_file_read (dgfx_config.input_path, &script))
+    {
+        dgfx_worker_fail (w, "could not read %s", dgfx_config.input_path);
+        arrfree (script);
+        return false;
+    }
+
+    bool ok = false;
+    size_t name_len = strlen (dgfx_config.input_path);
+    uint32_t exposure_bits;
+    memcpy (&exposure_bits, &dgfx_config.exposure, sizeof (exposure_bits));
+    struct dgfx_remote_hello hello = {
+        .magic = htonl (DGFX_REMOTE_MAGIC),
+        .version = htonl (DGFX_REMOTE_VERSION),
+        .w = htonl (dgfx_config.w),
+        .h = htonl (dgfx_config.h),
+        .tile_w = htonl (dgfx_config.tile_w),
+        .tile_h = htonl (dgfx_config.tile_h),
+        .id = htonl (w->id),
+        .hdr = htonl (dgfx_config.hdr),
+        .tonemap = htonl (dgfx_config.tonemap),
+        .exposure = htonl (exposure_bits),
+        .name_len = htonl (name_len),
+        .script_len = htonl (arrlenu (script)),
+    };
+
+    w->sock = dgfx_socket_open (w->remote, false);
+    if (w->sock < 0)
+    {
+        dgfx_worker_fail (w, "could not connect to %s", w->remote);
+        goto dgfx_remote_connect_oopsie;
+    }
+
+    uint32_t status;
+    if (!dgfx_send_all (w->sock, &hello, sizeof (hello))
+        || !dgfx_send_all (w->sock, dgfx_config.input_path, name_len)
+        || !dgfx_send_all (w->sock, script, arrlenu (script)) || !dgfx_recv_all (w->sock, &status, sizeof (status)))
+    {
+        dgfx_worker_fail (w, "%s: handshake failed", w->remote);
+        goto dgfx_remote_connect_oopsie;
+    }
+
+    if (ntohl (status) != 0)
+    {
+        dgfx_worker_fail (w, "%s failed to load the script", w->remote);
+        goto dgfx_remote_connect_oopsie;
+    }
+
+    w->remote_buf = malloc ((size_t)dgfx_config.tile_w * dgfx_config.tile_h * 4);
+    ok = w->remote_buf != NULL;
+
+dgfx_remote_connect_oopsie:
+    arrfree (script);
+    if (!ok && w->sock >= 0)
+    {
+        close (w->sock);
+        w->sock = -1;
+    }
+    return ok;
+}
+
+bool
+dgfx_remote_send_tile (struct dgfx_worker *w, const struct dgfx_tile *tile, double t)
+{
+    uint64_t bits;
+    memcpy (&bits, &t, sizeof (bits));
+
+    struct dgfx_remote_request req = {
+        .t_hi = htonl (bits >> 32),
+        .t_lo = htonl ((uint32_t)bits),
+        .x = htonl (tile->x),
+        .y = htonl (tile->y),
+        .w = htonl (tile->w),
+        .h = htonl (tile->h),
+    };
+
+    return dgfx_send_all (w->sock, &req, sizeof (req));
+}
+
+// shades the tiles `next` hands out on the remote end. up to DGFX_REMOTE_PIPELINE requests are in flight,
+// so the round trip overlaps with the server shading the previous tiles.
+bool
+dgfx_remote_shade_tiles (struct dgfx_worker *w, bool (*next) (struct dgfx_worker *, uint32_t *, void *), void *arg,
+                         double t, uint8_t *pixels, size_t pitch)
+{
+    uint32_t queue[DGFX_REMOTE_PIPELINE];
+    size_t head = 0, queued = 0;
+    bool ok = true, more = true;
+    double last = dgfx_time_now ();
+
+    while (true)
+    {
+        while (ok && more && queued < DGFX_REMOTE_PIPELINE)
+        {
+            uint32_t tile_idx;
+            if (!next (w, &tile_idx, arg))
+            {
+                more = false;
+                break;
+            }
+
+            if (!dgfx_remote_send_tile (w, &dgfx_ctx.tiles[tile_idx], t))
+                goto dgfx_remote_shade_tiles_oopsie;
+            queue[(head + queued++) % DGFX_REMOTE_PIPELINE] = tile_idx;
+        }
+
+        if (queued == 0)
+            break;
+
+        uint32_t tile_idx = queue[head];
+        head = (head + 1) % DGFX_REMOTE_PIPELINE;
+        queued--;
+
+        const struct dgfx_tile *tile = &dgfx_ctx.tiles[tile_idx];
+
+        uint32_t status;
+        if (!dgfx_recv_all (w->sock, &status, sizeof (status)))
+            goto dgfx_remote_shade_tiles_oopsie;
+
+        if (ntohl (status) != 0) // keep draining, so the stream stays in sync for the next frame
+        {
+            fprintf (stderr, "Remote worker %zu (%s) failed to shade tile at %u,%u\n", w->id, w->remote, tile->x,
+                     tile->y);
+            ok = false;
+            continue;
+        }
+
+        size_t row_len = (size_t)tile->w * 4;
+        if (!dgfx_recv_all (w->sock, w->remote_buf, row_len * tile->h))
+            goto dgfx_remote_shade_tiles_oopsie;
+
+        uint8_t *dst = dgfx_tile_pixels (tile, pixels, pitch);
+        for (uint32_t row = 0; row < tile->h; ++row, dst += pitch)
+            memcpy (dst, w->remote_buf + row * row_len, row_len);
+
+        // with several tiles in flight, the time since the previous reply is what this one cost
+        double now = dgfx_time_now ();
+        dgfx_ctx.tile_cost[tile_idx] = now - last;
+        last = now;
+        w->tiles_done++;
+    }
+
+    return ok;
+
+dgfx_remote_shade_tiles_oopsie:
+    fprintf (stderr, "Remote worker %zu (%s): connection lost\n", w->id, w->remote);
+    close (w->sock);
+    w->sock = -1;
+    dgfx_ctx.worker_lost = true;
+    return false;
+}
+
+bool
+dgfx_sched_next_cb (struct dgfx_worker *w, uint32_t *tile_idx, void *arg)
+{
+    (void)arg;
+    return dgfx_sched_next (w, tile_idx);
+}
+
+// every tile in order, `arg` is the position
+bool
+dgfx_tiles_next_cb (struct dgfx_worker *w, uint32_t *tile_idx, void *arg)
+{
+    (void)w;
+    size_t *pos = arg;
+    if (*pos >= arrlenu (dgfx_ctx.tiles))
+        return false;
+    *tile_idx = (*pos)++;
+    return true;
+}
+
+// shades tiles until every deque is drained
+bool
+dgfx_worker_run_frame (struct dgfx_worker *w)
+{
+    w->tiles_done = 0;
+
+    if (w->remote) // a lost remote worker does nothing, the others steal its deque
+        return w->sock < 0
+               || dgfx_remote_shade_tiles (w, dgfx_sched_next_cb, NULL, dgfx_ctx.sync->t_param, dgfx_ctx.pixels,
+                                           dgfx_ctx.pitch);
+
+    uint32_t tile_idx;
+    while (dgfx_sched_next (w, &tile_idx))
+    {
+        const struct dgfx_tile *tile = &dgfx_ctx.tiles[tile_idx];
+        double start = dgfx_time_now ();
+
+        if (!dgfx_worker_shade_tile (w, tile, dgfx_ctx.sync->t_param,
+                                     dgfx_tile_pixels (tile, dgfx_ctx.pixels, dgfx_ctx.pitch), dgfx_ctx.pitch))
+            return false;
+
+        dgfx_ctx.tile_cost[tile_idx] = dgfx_time_now () - start;
+        w->tiles_done++;
+    }
+
+    return true;
+}
+
+bool
+dgfx_worker_first_touch (struct dgfx_worker *w)
+{
+    for (uint32_t i = w->tile_first; i < w->tile_first + w->tile_count; ++i)
+    {
+        const struct dgfx_tile *tile = &dgfx_ctx.tiles[dgfx_ctx.tile_order[i]];
+        uint8_t *dst = dgfx_tile_pixels (tile, dgfx_ctx.pixels, dgfx_ctx.pitch);
+        for (uint32_t row = 0; row < tile->h; ++row, dst += dgfx_ctx.pitch)
+            memset (dst, 0, (size_t)tile->w * 4);
+    }
+
+    w->tiles_done = w->tile_count;
+    return true;
+}
+
+// runs the collector work a worker put off while shading (see GC_IDLE, GC_STEP): one step paying for what was
+// allocated since the last call, at least DGFX_GC_STEP_KB, then with GC_IDLE more steps while `idle` says nothing
+// else is waiting for the worker, up to a finished cycle. render and bench modes leave no idle time, so the first
+// step alone has to keep up with the script's allocations, as lua's own pacing would. stepping lets lua restart
+// the collector, so it is stopped again afterwards.
+void
+dgfx_worker_gc (struct dgfx_worker *w, bool (*idle) (void *), void *arg)
+{
+    if (!w->L)
+        return;
+
+    if (dgfx_config.gc != GC_LUA)
+    {
+        double start = dgfx_time_now ();
+
+        int heap_kb = lua_gc (w->L, LUA_GCCOUNT, 0);
+        int allocated_kb = heap_kb - (int)atomic_load_explicit (&w->gc_heap_kb, memory_order_relaxed);
+        int step_kb = allocated_kb > DGFX_GC_STEP_KB ? allocated_kb : DGFX_GC_STEP_KB;
+
+        bool cycle_done = lua_gc (w->L, LUA_GCSTEP, step_kb) != 0;
+        while (dgfx_config.gc == GC_IDLE && !cycle_done && idle && idle (arg))
+            cycle_done = lua_gc (w->L, LUA_GCSTEP, DGFX_GC_STEP_KB) != 0;
+        lua_gc (w->L, LUA_GCSTOP, 0);
+
+        atomic_store_explicit (&w->gc_ns, (uint64_t)((dgfx_time_now () - start) * 1e9), memory_order_relaxed);
+    }
+
+    atomic_store_explicit (&w->gc_heap_kb, lua_gc (w->L, LUA_GCCOUNT, 0), memory_order_relaxed);
+}
+
+// idle test for worker threads and processes: no newer job than `*arg` was published
+bool
+dgfx_worker_gc_idle (void *arg)
+{
+    return atomic_load_explicit (&dgfx_ctx.sync->epoch, memory_order_relaxed) == *(uint32_t *)arg;
+}
+
+// claims whole frames until all are rendered; the ring puts them back in order for the encoder
+bool
+dgfx_worker_run_frames (struct dgfx_worker *w)
+{
+    struct dgfx_frame_sync *sync = dgfx_ctx.sync;
+    size_t pitch = dgfx_config.w * sizeof (uint32_t);
+
+    while (!atomic_load (&sync->failed))
+    {
+        size_t frame = atomic_fetch_add (&sync->next_frame, 1);
+        if (frame >= sync->frame_count)
+            return true;
+
+        uint8_t *pixels = dgfx_frame_ring_acquire (sync->ring, frame);
+        if (!pixels)
+            return false;
+
+        double t = (double)frame / dgfx_config.fps;
+        bool ok = true;
+
+        if (w->remote)
+        {
+            size_t pos = 0;
+            ok = w->sock >= 0 && dgfx_remote_shade_tiles (w, dgfx_tiles_next_cb, &pos, t, pixels, pitch);
+        }
+        else
+        {
+            for (size_t i = 0; ok && i < arrlenu (dgfx_ctx.tiles); ++i)
+            {
+                const struct dgfx_tile *tile = &dgfx_ctx.tiles[i];
+                ok = dgfx_worker_shade_tile (w, tile, t, dgfx_tile_pixels (tile, pixels, pitch), pitch);
+            }
+        }
+
+        if (!ok)
+        {
+            fprintf (stderr, "Frame %zu generation failed\n", frame);
+            dgfx_frame_ring_abort (sync->ring);
+            return false;
+        }
+
+        dgfx_broadcast (pixels, pitch, 4);
+        dgfx_frame_ring_submit (sync->ring, frame);
+        dgfx_worker_gc (w, NULL, NULL);
+    }
+
+    return false;
+}
+
+bool
+dgfx_worker_run_job (struct dgfx_worker *w)
+{
+    switch (dgfx_ctx.sync->job)
+    {
+    case JOB_TILES:
+        return dgfx_worker_run_frame (w);
+    case JOB_FIRST_TOUCH:
+        return dgfx_worker_first_touch (w);
+    case JOB_FRAMES:
+        return dgfx_worker_run_frames (w);
+    case JOB_RETIRE:
+        return true;
+    default:
+        UNREACHABLE;
+    }
+}
+
+uint64_t
+dgfx_fnv1a (uint64_t h, const void *data, size_t len)
+{
+    const uint8_t *p = data;
+    for (size_t i = 0; i < len; ++i)
+        h = (h ^ p[i]) * 0x100000001b3ULL;
+    return h;
+}
+
+int
+dgfx_chunk_writer (lua_State *L, const void *p, size_t sz, void *ud)
+{
+    (void)L;
+    uint8_t **out = ud;
+    memcpy (arraddnptr (*out, sz), p, sz);
+    return 0;
+}
+
+// compiles the lua file at `path` into bytecode in the stb_ds array `*out`. with --script-cache, the bytecode is
+// looked up by a hash of the source (and the luajit build, which bytecode is specific to) before compiling, and
+// stored after. a cache that can't be read or written only costs the compile.
+bool
+dgfx_chunk_compile (lua_State *L, const char *path, uint8_t **out)
+{
+    bool ok = false;
+    char *src = NULL;
+    char name[PATH_MAX + 2];
+    char cache_path[PATH_MAX] = "";
+
+    snprintf (name, sizeof (name), "@%s", path);
+    if (!dgfx_file_read (path, &src))
+        goto dgfx_chunk_compile_oopsie;
+
+    if (dgfx_config.script_cache)
+    {
+        size_t ptr_size = sizeof (void *);
+        uint64_t key = dgfx_fnv1a (0xcbf29ce484222325ULL, LUAJIT_VERSION, sizeof (LUAJIT_VERSION));
+        key = dgfx_fnv1a (key, &ptr_size, sizeof (ptr_size));
+        key = dgfx_fnv1a (key, name, strlen (name) + 1); // the name ends up in the bytecode's debug info
+        key = dgfx_fnv1a (key, src, arrlenu (src));
+        snprintf (cache_path, sizeof (cache_path), "%s/%016" PRIx64 ".bc", dgfx_config.script_cache, key);
+
+        // a cached chunk is only taken if it loads, so a truncated file gets compiled over
+        if (access (cache_path, R_OK) == 0 && dgfx_file_read (cache_path, (char **)out)
+            && luaL_loadbuffer (L, (const char *)*out, arrlenu (*out), name) == 0)
+        {
+            lua_pop (L, 1);
+            ok = true;
+            goto dgfx_chunk_compile_oopsie;
+        }
+        lua_settop (L, 0);
+        arrfree (*out);
+    }
+
+    if (luaL_loadbuffer (L, src, arrlenu (src), name) != 0)
+    {
+        fprintf (stderr, "lua load error: %s\n", lua_tostring (L, -1));
+        lua_pop (L, 1);
+        goto dgfx_chunk_compile_oopsie;
+    }
+
+    lua_dump (L, dgfx_chunk_writer, out);
+    lua_pop (L, 1);
+    ok = true;
+
+    if (cache_path[0])
+    {
+        // written aside and renamed, so a concurrent run never reads half a file
+        char tmp_path[PATH_MAX + 32];
+        snprintf (tmp_path, sizeof (tmp_path), "%s.%d", cache_path, (int)getpid ());
+
+        mkdir (dgfx_config.script_cache, 0755);
+        int fd = open (tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        bool written = fd >= 0 && dgfx_write_all (fd, *out, arrlenu (*out));
+        if (fd >= 0)
+            close (fd);
+        if (!written || rename (tmp_path, cache_path) != 0)
+        {
+            fprintf (stderr, "Could not write script cache %s: %s\n", cache_path, strerror (errno));
+            unlink (tmp_path);
+        }
+    }
+
+dgfx_chunk_compile_oopsie:
+    arrfree (src);
+    return ok;
+}
+
+// parses the script and the worker callbacks once, instead of once per worker
+bool
+dgfx_chunks_compile (void)
+{
+    lua_State *L = luaL_newstate ();
+    if (!L)
+        return false;
+
+    bool ok = dgfx_chunk_compile (L, dgfx_config.input_path, &dgfx_ctx.script_bc)
+              && dgfx_chunk_compile (L, DGFX_RESOURCE_LUA_WORKER_CB, &dgfx_ctx.worker_cb_bc)
+              && dgfx_chunk_compile (L, DGFX_RESOURCE_LUA_MATH, &dgfx_ctx.math_bc);
+
+    lua_close (L);
+    return ok;
+}
+
+// loads bytecode from dgfx_chunks_compile when there is some, the source at `path` otherwise
+int
+dgfx_chunk_load (lua_State *L, const uint8_t *bc, const char *path)
+{
+    if (!bc)
+        return luaL_loadfile (L, path);
+
+    char name[PATH_MAX + 2];
+    snprintf (name, sizeof (name), "@%s", path);
+    return luaL_loadbuffer (L, (const char *)bc, arrlenu (bc), name);
+}
+
+// passes `opts`, comma separated jit.opt.start() arguments ("hotloop=8,maxmcode=8192,-loop", like luajit -O),
+// to the worker's state
+bool
+dgfx_worker_jit_opt (struct dgfx_worker *w, const char *opts)
+{
+    lua_getglobal (w->L, "require");
+    lua_pushliteral (w->L, "jit.opt");
+    if (lua_pcall (w->L, 1, 1, 0) != 0)
+    {
+        dgfx_worker_fail (w, "jit.opt: %s", lua_tostring (w->L, -1));
+        return false;
+    }
+    lua_getfield (w->L, -1, "start");
+    lua_remove (w->L, -2);
+
+    int n = 0;
+    for (const char *p = opts; *p;)
+    {
+        size_t len = strcspn (p, ",");
+        if (len > 0)
+        {
+            lua_pushlstring (w->L, p, len);
+            n++;
+        }
+        p += len + (p[len] == ',');
+    }
+
+    if (lua_pcall (w->L, n, 0, 0) != 0)
+    {
+        dgfx_worker_fail (w, "jit.opt %s: %s", opts, lua_tostring (w->L, -1));
+        return false;
+    }
+
+    return true;
+}
+
+// the `dgfx` table scripts see, for worker `id`. false with the error on top of the stack when dgfx.math,
+// dgfx.lut and dgfx.shared (see dgfx_math.h) don't load.
+bool
+dgfx_lua_globals (lua_State *L, size_t id, int cpu, int node)
+{
+    lua_newtable (L); // dgfx
+
+    lua_pushinteger (L, dgfx_config.w);
+    lua_setfield (L, -2, "width");
+
+    lua_pushinteger (L, dgfx_config.h);
+    lua_setfield (L, -2, "height");
+
+    lua_pushboolean (L, dgfx_config.hdr);
+    lua_setfield (L, -2, "hdr");
+
+    lua_newtable (L); // worker
+
+    lua_pushinteger (L, dgfx_config.tile_w);
+    lua_setfield (L, -2, "tile_w");
+
+    lua_pushinteger (L, dgfx_config.tile_h);
+    lua_setfield (L, -2, "tile_h");
+
+    lua_pushinteger (L, id);
+    lua_setfield (L, -2, "id");
+
+    lua_pushinteger (L, cpu);
+    lua_setfield (L, -2, "cpu");
+
+    lua_pushinteger (L, node);
+    lua_setfield (L, -2, "node");
+
+    lua_setfield (L, -2, "worker");
+
+    if (dgfx_chunk_load (L, dgfx_ctx.math_bc, DGFX_RESOURCE_LUA_MATH) != 0)
+        return false;
+    lua_pushlightuserdata (L, (void *)&dgfx_math);
+    lua_pushstring (L, dgfx_math_cdef);
+    if (lua_pcall (L, 2, 3, 0) != 0)
+        return false;
+    lua_setfield (L, -4, "shared");
+    lua_setfield (L, -3, "lut");
+    lua_setfield (L, -2, "math");
+
+    lua_setglobal (L, "dgfx");
+    return true;
+}
+
+// builds the worker's lua state. runs on the thread that will own it, so with affinity enabled
+// the state is allocated on that thread's NUMA node. every stage's duration goes to `startup_time`.
+bool
+dgfx_worker_lua_init (struct dgfx_worker *w)
+{
+    double start = dgfx_time_now ();
+
+    w->L = luaL_newstate ();
+    if (!w->L)
+    {
+        dgfx_worker_fail (w, "could not create lua state");
+        return false;
+    }
+    luaL_openlibs (w->L);
+
+    // before anything is compiled. scripts can call jit.opt.start() themselves on top, they run in every worker.
+    if ((DGFX_JIT_OPT_DEFAULT[0] && !dgfx_worker_jit_opt (w, DGFX_JIT_OPT_DEFAULT))
+        || (dgfx_config.jit_opt && !dgfx_worker_jit_opt (w, dgfx_config.jit_opt)))
+        goto dgfx_worker_lua_init_oopsie;
+
+    if (!dgfx_lua_globals (w->L, w->id, w->cpu, w->node))
+    {
+        dgfx_worker_fail (w, "lua load error: %s", lua_tostring (w->L, -1));
+        goto dgfx_worker_lua_init_oopsie;
+    }
+
+    double now = dgfx_time_now ();
+    w->startup_time[STARTUP_STAGE_STATE] = now - start;
+    start = now;
+
+    int err = dgfx_ctx.script ? luaL_loadbuffer (w->L, dgfx_ctx.script, dgfx_ctx.script_len, dgfx_ctx.script_name)
+                              : dgfx_chunk_load (w->L, dgfx_ctx.script_bc, dgfx_config.input_path);
+    if (err != 0)
+    {
+        dgfx_worker_fail (w, "lua load error: %s", lua_tostring (w->L, -1));
+        goto dgfx_worker_lua_init_oopsie;
+    }
+
+    now = dgfx_time_now ();
+    w->startup_time[STARTUP_STAGE_LOAD] = now - start;
+    start = now;
+
+    if (lua_pcall (w->L, 0, 0, 0) != 0)
+    {
+        dgfx_worker_fail (w, "lua runtime error: %s", lua_tostring (w->L, -1));
+        goto dgfx_worker_lua_init_oopsie;
+    }
+
+    now = dgfx_time_now ();
+    w->startup_time[STARTUP_STAGE_RUN] = now - start;
+    start = now;
+
+    lua_getglobal (w->L, "rgb");
+    lua_getglobal (w->L, "rgb_row");
+    lua_getglobal (w->L, "setup");
+    lua_getglobal (w->L, "shade");
+    bool two_phase = lua_isfunction (w->L, -1) && lua_isfunction (w->L, -2);
+    if (!lua_isfunction (w->L, -3) && !lua_isfunction (w->L, -4) && !two_phase)
+    {
+        dgfx_worker_fail (w, "lua user script must define rgb(n,m,t), rgb_row(y,x0,x1,t,row) or setup(x,y) and "
+                             "shade(x,y,t,f,...) functions");
+        goto dgfx_worker_lua_init_oopsie;
+    }
+    lua_pop (w->L, 4);
+
+    if (dgfx_chunk_load (w->L, dgfx_ctx.worker_cb_bc, DGFX_RESOURCE_LUA_WORKER_CB) != 0)
+    {
+        dgfx_worker_fail (w, "lua load error: %s", lua_tostring (w->L, -1));
+        goto dgfx_worker_lua_init_oopsie;
+    }
+
+    if (lua_pcall (w->L, 0, 0, 0) != 0)
+    {
+        dgfx_worker_fail (w, "lua runtime error: %s", lua_tostring (w->L, -1));
+        goto dgfx_worker_lua_init_oopsie;
+    }
+
+    // worker_cb.lua probes how many values setup() returns, dgfx_workers_wait checks all workers agree
+    lua_getglobal (w->L, "dgfx");
+    lua_getfield (w->L, -1, "setup_floats");
+    w->setup_floats = lua_isnumber (w->L, -1) ? (size_t)lua_tointeger (w->L, -1) : 0;
+    lua_pop (w->L, 2);
+
+    const char *cb = dgfx_config.write_path == WRITE_PATH_FFI ? "__dgfx_worker_cb_ffi" : "__dgfx_worker_cb";
+    if (dgfx_config.hdr)
+        cb = "__dgfx_worker_cb_hdr";
+    lua_getglobal (w->L, cb);
+    if (!lua_isfunction (w->L, -1))
+    {
+        dgfx_worker_fail (w, "lua script must define %s", cb);
+        goto dgfx_worker_lua_init_oopsie;
+    }
+    w->lua_cb_ref = luaL_ref (w->L, LUA_REGISTRYINDEX);
+
+    w->startup_time[STARTUP_STAGE_RESOLVE] = dgfx_time_now () - start;
+
+    // from here on, garbage is only collected between jobs, see dgfx_worker_gc
+    if (dgfx_config.gc != GC_LUA)
+        lua_gc (w->L, LUA_GCSTOP, 0);
+    atomic_store (&w->gc_ns, 0);
+    atomic_store (&w->gc_heap_kb, lua_gc (w->L, LUA_GCCOUNT, 0));
+    return true;
+
+dgfx_worker_lua_init_oopsie:
+    lua_close (w->L);
+    w->L = NULL;
+    return false;
+}
+
+// plugin counterpart of dgfx_worker_lua_init, also run on the thread or in the process that shades with it
+bool
+dgfx_worker_plugin_init (struct dgfx_worker *w)
+{
+    double start = dgfx_time_now ();
+    struct dgfx_plugin_info info = { .width = dgfx_config.w,
+                                     .height = dgfx_config.h,
+                                     .tile_w = dgfx_config.tile_w,
+                                     .tile_h = dgfx_config.tile_h,
+                                     .worker_id = w->id,
+                                     .hdr = dgfx_config.hdr };
+
+    w->plugin_state = NULL;
+    if (dgfx_ctx.plugin->init)
+    {
+        int err = dgfx_ctx.plugin->init (&info, &w->plugin_state);
+        if (err != 0)
+        {
+            dgfx_worker_fail (w, "plugin init returned %d", err);
+            return false;
+        }
+    }
+
+    w->startup_time[STARTUP_STAGE_RUN] = dgfx_time_now () - start;
+    return true;
+}
+
+// --trace: the worker only needs room for the program's values, allocated on its own thread like a lua state
+bool
+dgfx_worker_trace_init (struct dgfx_worker *w)
+{
+    size_t size = DGFX_CACHE_ROUND (arrlenu (dgfx_ctx.trace) * DGFX_TRACE_LANES * sizeof (double));
+    if (posix_memalign ((void **)&w->trace_regs, DGFX_CACHE_LINE, size) != 0)
+    {
+        w->trace_regs = NULL;
+        dgfx_worker_fail (w, "could not allocate %zu bytes for the traced program", size);
+        return false;
+    }
+    return true;
+}
+
+// only for workers whose init succeeded
+void
+dgfx_worker_plugin_fini (struct dgfx_worker *w)
+{
+    if (dgfx_ctx.plugin && dgfx_ctx.plugin->fini && atomic_load (&w->startup) == STARTUP_READY)
+        dgfx_ctx.plugin->fini (w->plugin_state);
+    w->plugin_state = NULL;
+}
+
+// sets up whatever shades the worker's tiles: the plugin, the traced program or a lua state
+bool
+dgfx_worker_shader_init (struct dgfx_worker *w)
+{
+    if (dgfx_ctx.plugin)
+        return dgfx_worker_plugin_init (w);
+    return dgfx_ctx.trace ? dgfx_worker_trace_init (w) : dgfx_worker_lua_init (w);
+}
+
+// worker side of the pool: reports startup, then runs every published job until told to exit
+void
+dgfx_worker_loop (struct dgfx_worker *w)
+{
+    struct dgfx_frame_sync *sync = dgfx_ctx.sync;
+    uint32_t epoch = atomic_load (&sync->epoch); // no frame is published before startup is reported
+
+    // a remote worker's thread only waits on its socket, it neither needs a cpu nor a lua state of its own
+    if (!w->remote)
+        dgfx_affinity_apply (w);
+
+    bool ok = w->remote ? dgfx_remote_connect (w) : dgfx_worker_shader_init (w);
+    atomic_store (&w->startup, ok ? STARTUP_READY : STARTUP_FAILED);
+    dgfx_futex_wake (&w->startup, &sync->startup_sleepers, 1);
+    if (!ok)
+        return;
+
+    while (true)
+    {
+        epoch = dgfx_wait_change (&sync->epoch, epoch, &sync->epoch_sleepers, -1);
+
+        if (sync->should_exit)
+            break;
+
+        if (w->id >= sync->active_n)
+        {
+            if (sync->job == JOB_RETIRE)
+                break;
+            continue;
+        }
+
+        if (!dgfx_worker_run_job (w))
+            atomic_store (&sync->failed, true);
+
+        if (atomic_fetch_sub (&sync->pending, 1) == 1)
+            dgfx_futex_wake (&sync->pending, &sync->pending_sleepers, 1);
+        atomic_store (&w->done_epoch, epoch);
+
+        // JOB_FRAMES collects after every frame it renders instead
+        if (sync->job == JOB_TILES)
+            dgfx_worker_gc (w, dgfx_worker_gc_idle, &epoch);
+    }
+}
+
+void *
+dgfx_worker_work (void *arg)
+{
+    dgfx_worker_loop (arg);
+    pthread_exit (NULL);
+}
+
+// forks a worker process. everything it shares with the main process is in `dgfx_ctx.shared`,
+// the rest (tiles, cpus, config) is an unchanging copy made at fork time.
+bool
+dgfx_worker_spawn (struct dgfx_worker *w)
+{
+    pid_t parent = getpid ();
+
+    fflush (NULL); // or the child would write out whatever stdio still buffers once more
+    pid_t pid = fork ();
+    if (pid == -1)
+    {
+        perror ("fork");
+        return false;
+    }
+
+    if (pid == 0) // child
+    {
+        prctl (PR_SET_PDEATHSIG, SIGKILL);
+        if (getppid () != parent)
+            _exit (1);
+
+        dgfx_worker_loop (w);
+
+        dgfx_worker_plugin_fini (w);
+        if (w->L)
+            lua_close (w->L);
+        _exit (0);
+    }
+
+    w->pid = pid;
+    return true;
+}
+
+// true once the worker's process is gone. reports how it went down when it is first noticed.
+bool
+dgfx_worker_reap (struct dgfx_worker *w)
+{
+    if (w->dead)
+        return true;
+    if (w->pid == 0)
+        return false;
+
+    int status;
+    if (waitpid (w->pid, &status, WNOHANG) != w->pid)
+        return false;
+
+    w->dead = true;
+    if (WIFSIGNALED (status))
+        fprintf (stderr, "Worker %zu (pid %d) killed by signal %d (%s)\n", w->id, (int)w->pid, WTERMSIG (status),
+                 strsignal (WTERMSIG (status)));
+    else
+        fprintf (stderr, "Worker %zu (pid %d) exited with status %d\n", w->id, (int)w->pid, WEXITSTATUS (status));
+
+    return true;
+}
+
+// starts worker `id` building its lua state (or connecting, for remote workers) without waiting for it,
+// dgfx_workers_wait does that for all of them. worker 0's state is built by the main thread in dgfx_init.
+bool
+dgfx_worker_init (struct dgfx_worker *w, size_t id)
+{
+    if (!w)
+        UNREACHABLE;
+
+    w->id = id;
+    atomic_init (&w->tile_range, 0);
+    atomic_init (&w->startup, STARTUP_PENDING);
+
+    w->thread_running = false;
+    w->pid = 0;
+    w->dead = false;
+    w->cpu = -1;
+    w->hdr_tile = NULL;
+    w->trace_regs = NULL;
+    w->remote = NULL;
+    w->sock = -1;
+    w->remote_buf = NULL;
+    w->setup_floats = 0;
+    w->plugin_state = NULL;
+    memset (w->startup_time, 0, sizeof (w->startup_time));
+    w->startup_error[0] = 0;
+    atomic_init (&w->gc_ns, 0);
+    atomic_init (&w->gc_heap_kb, 0);
+
+    // main thread renders worker 0 share. it isn't pinned: ffmpeg, the frame ring writer and every other thread
+    // or process started from it would inherit a single cpu shared with worker 0
+    if (id == 0)
+        return true;
+
+    // remote workers come after the local ones, their threads connect
+    size_t local_n = dgfx_config.worker_n ? dgfx_config.worker_n : 1;
+    if (id >= local_n)
+        w->remote = dgfx_config.remotes[id - local_n];
+
+    if (dgfx_config.backend == BACKEND_PROCESSES && !w->remote)
+    {
+        if (!dgfx_worker_spawn (w))
+            return false;
+    }
+    else
+    {
+        int err = pthread_create (&w->thrd, NULL, dgfx_worker_work, w);
+        if (err != 0)
+            return false;
+
+        w->thread_running = true;
+    }
+
+    return true;
+}
+
+// startup barrier: waits until every worker reported, then prints why the ones that failed did, each distinct
+// error once with the list of workers it came from. true when all of them are ready.
+bool
+dgfx_workers_wait (void)
+{
+    size_t failed = 0;
+
+    for (size_t i = 0; i < dgfx_ctx.worker_n; ++i)
+    {
+        struct dgfx_worker *w = &dgfx_ctx.workers[i];
+
+        // a process can die before reporting, so poll for that instead of sleeping for good
+        int timeout_ms = w->pid ? DGFX_PROCESS_POLL_MS : -1;
+
+        uint32_t state;
+        while ((state = atomic_load (&w->startup)) == STARTUP_PENDING)
+        {
+            dgfx_wait_change (&w->startup, state, &dgfx_ctx.sync->startup_sleepers, timeout_ms);
+            if (atomic_load (&w->startup) == STARTUP_PENDING && dgfx_worker_reap (w))
+            {
+                dgfx_worker_fail (w, "exited while starting");
+                atomic_store (&w->startup, STARTUP_FAILED);
+            }
+        }
+
+        if (state != STARTUP_READY)
+            failed++;
+    }
+
+    for (size_t i = 0; i < dgfx_ctx.worker_n; ++i)
+    {
+        struct dgfx_worker *w = &dgfx_ctx.workers[i];
+        if (atomic_load (&w->startup) == STARTUP_READY)
+            continue;
+
+        bool reported = false;
+        for (size_t j = 0; j < i && !reported; ++j)
+            reported = atomic_load (&dgfx_ctx.workers[j].startup) != STARTUP_READY
+                       && strcmp (dgfx_ctx.workers[j].startup_error, w->startup_error) == 0;
+        if (reported)
+            continue;
+
+        fprintf (stderr, "Worker %zu", i);
+        for (size_t j = i + 1; j < dgfx_ctx.worker_n; ++j)
+            if (atomic_load (&dgfx_ctx.workers[j].startup) != STARTUP_READY
+                && strcmp (dgfx_ctx.workers[j].startup_error, w->startup_error) == 0)
+                fprintf (stderr, ", %zu", j);
+        fprintf (stderr, ": %s\n", w->startup_error[0] ? w->startup_error : "failed to start");
+    }
+
+    if (failed)
+    {
+        fprintf (stderr, "%zu of %zu workers failed to start\n", failed, dgfx_ctx.worker_n);
+        return false;
+    }
+
+    // every worker has to lay out the setup cache the same way
+    for (size_t i = 1; i < dgfx_ctx.worker_n; ++i)
+    {
+        struct dgfx_worker *w = &dgfx_ctx.workers[i];
+        if (!w->remote && w->setup_floats != dgfx_ctx.workers[0].setup_floats)
+        {
+            fprintf (stderr, "setup() returned %zu values in worker %zu, but %zu in worker 0\n", w->setup_floats, i,
+                     dgfx_ctx.workers[0].setup_floats);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// --startup-times: how long each worker spent in each part of building its lua state
+void
+dgfx_startup_report (double total)
+{
+    printf ("Started %zu workers in %.2f ms\n", dgfx_ctx.worker_n, total * 1e3);
+    printf ("%-8s", "worker");
+    for (int s = 0; s < STARTUP_STAGE_N; ++s)
+        printf ("%10s", _startup_stage_strings[s]);
+    printf ("  (ms)\n");
+
+    for (size_t i = 0; i < dgfx_ctx.worker_n; ++i)
+    {
+        struct dgfx_worker *w = &dgfx_ctx.workers[i];
+        printf ("%-8zu", i);
+        if (w->remote)
+        {
+            printf ("  remote %s\n", w->remote);
+            continue;
+        }
+
+        for (int s = 0; s < STARTUP_STAGE_N; ++s)
+            printf ("%10.2f", w->startup_time[s] * 1e3);
+        printf ("\n");
+    }
+}
+
+// joins a worker's thread or process, which must have left dgfx_worker_loop, then releases its state
+void
+dgfx_worker_stop (struct dgfx_worker *w)
+{
+    if (w->thread_running)
+    {
+        pthread_join (w->thrd, NULL);
+        w->thread_running = false;
+    }
+
+    if (w->remote)
+    {
+        if (w->sock >= 0)
+            close (w->sock);
+        w->sock = -1;
+        free (w->remote_buf);
+        w->remote_buf = NULL;
+    }
+
+    if (w->pid) // its lua state belongs to the worker process
+    {
+        if (!w->dead)
+            waitpid (w->pid, NULL, 0);
+        w->pid = 0;
+        return;
+    }
+
+    dgfx_worker_plugin_fini (w);
+    if (w->L)
+    {
+        luaL_unref (w->L, LUA_REGISTRYINDEX, w->lua_cb_ref);
+        lua_close (w->L);
+        w->L = NULL;
+    }
+
+    free (w->hdr_tile);
+    w->hdr_tile = NULL;
+    free (w->trace_regs);
+    w->trace_regs = NULL;
+}
+
+// joins all worker threads and processes, then releases per-worker state
+void
+dgfx_worker_shutdown_all (void)
+{
+    struct dgfx_frame_sync *sync = dgfx_ctx.sync;
+    if (!sync)
+        return;
+
+    sync->should_exit = true;
+    atomic_fetch_add (&sync->epoch, 1);
+    dgfx_futex_wake (&sync->epoch, &sync->epoch_sleepers, INT_MAX);
+
+    for (size_t i = 0; i < dgfx_ctx.worker_n; ++i)
+        dgfx_worker_stop (&dgfx_ctx.workers[i]);
+
+    dgfx_ctx.workers = NULL;
+    dgfx_ctx.worker_n = 0;
+}
+
+// everything workers write, or the main thread updates between frames, lives in one mapping. for the
+// process backend it is a memfd shared across fork(), so the same pointers are valid in every worker.
+bool
+dgfx_shared_init (size_t n_workers, size_t n_tiles)
+{
+    size_t sync_size = DGFX_CACHE_ROUND (sizeof (struct dgfx_frame_sync));
+    size_t workers_size = DGFX_CACHE_ROUND (n_workers * sizeof (struct dgfx_worker));
+    size_t order_size = DGFX_CACHE_ROUND (n_tiles * sizeof (uint32_t));
+    size_t cost_size = DGFX_CACHE_ROUND (n_tiles * sizeof (float));
+    size_t pixels_size = 0;
+    if (dgfx_config.backend == BACKEND_PROCESSES)
+        pixels_size = DGFX_CACHE_ROUND (dgfx_config.h * dgfx_ctx.pitch);
+    size_t hdr_size = 0;
+    if (dgfx_config.hdr_output)
+        hdr_size = DGFX_CACHE_ROUND (dgfx_config.h * dgfx_config.w * 4 * sizeof (float));
+
+    size_t size = sync_size + workers_size + order_size + cost_size + pixels_size + hdr_size;
+    void *shared = MAP_FAILED;
+
+    if (dgfx_config.backend == BACKEND_PROCESSES)
+    {
+        int fd = memfd_create ("dgfx", MFD_CLOEXEC);
+        if (fd < 0)
+        {
+            perror ("memfd_create");
+            return false;
+        }
+
+        if (ftruncate (fd, size) == 0)
+            shared = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        else
+            perror ("ftruncate");
+        close (fd);
+    }
+    else
+    {
+        shared = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+
+    if (shared == MAP_FAILED)
+    {
+        perror ("mmap");
+        return false;
+    }
+
+    // fresh mappings are zeroed, which is a valid initial state for all of it. page aligned, so every
+    // worker's deque stays on its own cache lines.
+    uint8_t *p = shared;
+    dgfx_ctx.sync = (struct dgfx_frame_sync *)p;
+    p += sync_size;
+    dgfx_ctx.workers = (struct dgfx_worker *)p;
+    p += workers_size;
+    dgfx_ctx.tile_order = (uint32_t *)p;
+    p += order_size;
+    dgfx_ctx.tile_cost = (float *)p;
+    p += cost_size;
+    if (pixels_size)
+        dgfx_ctx.pixels = p;
+    p += pixels_size;
+    if (hdr_size)
+        dgfx_ctx.hdr_frame = (float *)p;
+
+    dgfx_ctx.shared = shared;
+    dgfx_ctx.shared_size = size;
+    return true;
+}
+
+void
+dgfx_deinit (void)
+{
+    dgfx_worker_shutdown_all ();
+    arrfree (dgfx_ctx.tiles);
+    arrfree (dgfx_ctx.cpus);
+    arrfree (dgfx_ctx.sched_owner);
+    arrfree (dgfx_ctx.sched_sorted);
+    arrfree (dgfx_ctx.sched_heap);
+    arrfree (dgfx_ctx.sched_group);
+    arrfree (dgfx_ctx.script_bc);
+    arrfree (dgfx_ctx.worker_cb_bc);
+    arrfree (dgfx_ctx.math_bc);
+
+    dgfx_math_blocks_free ();
+
+    // after the workers, which may still be running its code
+    if (dgfx_ctx.plugin_handle)
+        dlclose (dgfx_ctx.plugin_handle);
+    dgfx_ctx.plugin_handle = NULL;
+    dgfx_ctx.plugin = NULL;
+    arrfree (dgfx_ctx.trace);
+    for (int i = 0; i < TRACE_STAGE_N; ++i)
+        arrfree (dgfx_ctx.trace_stage[i]);
+    free (dgfx_ctx.still);
+    dgfx_ctx.still = NULL;
+    arrfree (dgfx_ctx.still_out);
+    dgfx_ctx.depends = DEPENDS_ALL;
+
+    if (dgfx_ctx.shared)
+        munmap (dgfx_ctx.shared, dgfx_ctx.shared_size);
+    dgfx_setup_cache_deinit ();
+    dgfx_ctx.shared = NULL;
+    dgfx_ctx.sync = NULL;
+    dgfx_ctx.tile_order = NULL;
+    dgfx_ctx.tile_cost = NULL;
+    dgfx_ctx.hdr_frame = NULL;
+    if (dgfx_config.backend == BACKEND_PROCESSES)
+        dgfx_ctx.pixels = NULL;
+    dgfx_ctx.target = NULL;
+}
+
+// hands the tiles to the first `active_n` workers. must not be called while a frame is in flight.
+void
+dgfx_sched_partition (size_t active_n)
+{
+    size_t total_tiles = arrlenu (dgfx_ctx.tiles);
+
+    for (size_t i = 0; i < dgfx_ctx.worker_n; ++i)
+    {
+        struct dgfx_worker *w = &dgfx_ctx.workers[i];
+
+        if (i >= active_n)
+        {
+            w->tile_first = w->tile_count = 0;
+            continue;
+        }
+
+        // row-major tiles split into contiguous runs, so each worker starts on a compact band of the frame
+        size_t per = total_tiles / active_n;
+        size_t start = i * per;
+        if (i == active_n - 1)
+            per = total_tiles - start;
+
+        w->tile_first = start;
+        w->tile_count = per;
+    }
+
+    for (size_t i = 0; i < total_tiles; ++i)
+        dgfx_ctx.tile_order[i] = i;
+
+    dgfx_ctx.sync->active_n = active_n;
+    dgfx_ctx.tile_cost_valid = false;
+}
+
+int
+dgfx_tile_cmp_cost (const void *a, const void *b)
+{
+    float x = dgfx_ctx.tile_cost[*(const uint32_t *)a];
+    float y = dgfx_ctx.tile_cost[*(const uint32_t *)b];
+    if (x != y)
+        return x < y ? 1 : -1;
+    return *(const uint32_t *)a < *(const uint32_t *)b ? -1 : 1;
+}
+
+struct dgfx_sched_group
+{
+    uint32_t first, n;
+};
+
+struct dgfx_load
+{
+    double load;
+    size_t worker;
+    uint32_t tiles;
+};
+
+bool
+dgfx_load_less (const struct dgfx_load *a, const struct dgfx_load *b)
+{
+    return a->load < b->load || (a->load == b->load && a->worker < b->worker);
+}
+
+int
+dgfx_load_cmp_node (const void *a, const void *b)
+{
+    const struct dgfx_load *x = a, *y = b;
+    int nx = dgfx_ctx.workers[x->worker].node, ny = dgfx_ctx.workers[y->worker].node;
+    if (nx != ny)
+        return nx - ny;
+    return x->worker < y->worker ? -1 : 1;
+}
+
+// longest processing time first: tiles sorted by last frame's cost, each handed to the least loaded worker.
+// deques come out ordered longest first, so thieves (taking from the tail) only ever grab the cheap leftovers.
+// tiles only move between workers of one NUMA node, where their pixels were first touched, and only when that
+// shortens the slowest worker's share by DGFX_REBALANCE_MIN_GAIN; stealing evens out the rest.
+void
+dgfx_sched_rebalance (void)
+{
+    size_t n = dgfx_ctx.sync->active_n;
+    size_t total_tiles = arrlenu (dgfx_ctx.tiles);
+
+    arrsetlen (dgfx_ctx.sched_owner, total_tiles);
+    arrsetlen (dgfx_ctx.sched_sorted, total_tiles);
+    arrsetlen (dgfx_ctx.sched_heap, n);
+    arrsetlen (dgfx_ctx.sched_group, n);
+    uint32_t *owner = dgfx_ctx.sched_owner, *sorted = dgfx_ctx.sched_sorted;
+    struct dgfx_load *heap = dgfx_ctx.sched_heap;
+    struct dgfx_sched_group *group = dgfx_ctx.sched_group;
+
+    // who has each tile now, and the slowest share with that partition
+    double current = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        const struct dgfx_worker *w = &dgfx_ctx.workers[i];
+        double load = 0;
+        for (uint32_t pos = w->tile_first; pos < w->tile_first + w->tile_count; ++pos)
+        {
+            owner[dgfx_ctx.tile_order[pos]] = i;
+            load += dgfx_ctx.tile_cost[dgfx_ctx.tile_order[pos]];
+        }
+        if (load > current)
+            current = load;
+    }
+
+    // one heap per node, its workers next to each other
+    for (size_t i = 0; i < n; ++i)
+        heap[i] = (struct dgfx_load){ .load = 0, .worker = i, .tiles = 0 };
+    qsort (heap, n, sizeof (*heap), dgfx_load_cmp_node);
+
+    for (size_t first = 0, last; first < n; first = last)
+    {
+        int node = dgfx_ctx.workers[heap[first].worker].node;
+        for (last = first; last < n && dgfx_ctx.workers[heap[last].worker].node == node; ++last)
+            ;
+        for (size_t i = first; i < last; ++i)
+            group[heap[i].worker] = (struct dgfx_sched_group){ .first = first, .n = last - first };
+    }
+
+    for (size_t i = 0; i < total_tiles; ++i)
+        sorted[i] = i;
+    qsort (sorted, total_tiles, sizeof (uint32_t), dgfx_tile_cmp_cost);
+
+    for (size_t i = 0; i < total_tiles; ++i)
+    {
+        // the group's first slot is its least loaded worker; take the tile, then sift it down
+        struct dgfx_sched_group g = group[owner[sorted[i]]];
+        struct dgfx_load *h = heap + g.first;
+        owner[sorted[i]] = h[0].worker;
+        h[0].tiles++;
+        h[0].load += dgfx_ctx.tile_cost[sorted[i]];
+
+        for (size_t p = 0;;)
+        {
+            size_t l = 2 * p + 1, r = l + 1, m = p;
+            if (l < g.n && dgfx_load_less (&h[l], &h[m]))
+                m = l;
+            if (r < g.n && dgfx_load_less (&h[r], &h[m]))
+                m = r;
+            if (m == p)
+                break;
+
+            struct dgfx_load tmp = h[p];
+            h[p] = h[m];
+            h[m] = tmp;
+            p = m;
+        }
+    }
+
+    double balanced = 0;
+    for (size_t i = 0; i < n; ++i)
+        if (heap[i].load > balanced)
+            balanced = heap[i].load;
+    if (current <= balanced * (1.0 + DGFX_REBALANCE_MIN_GAIN))
+        return;
+
+    // lay the runs out back to back; within a run tiles keep the longest first order
+    for (size_t i = 0; i < n; ++i)
+        dgfx_ctx.workers[heap[i].worker].tile_count = heap[i].tiles;
+
+    uint32_t first = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        dgfx_ctx.workers[i].tile_first = first;
+        first += dgfx_ctx.workers[i].tile_count;
+        dgfx_ctx.workers[i].tile_count = 0;
+    }
+
+    for (size_t i = 0; i < total_tiles; ++i)
+    {
+        struct dgfx_worker *w = &dgfx_ctx.workers[owner[sorted[i]]];
+        dgfx_ctx.tile_order[w->tile_first + w->tile_count++] = sorted[i];
+    }
+}
+
+// -i shader.so: a native plugin instead of a lua script, see dgfx_plugin.h
+bool
+dgfx_plugin_path (const char *path)
+{
+    const char *ext = strrchr (path, '.');
+    return ext && strcmp (ext, ".so") == 0;
+}
+
+bool
+dgfx_plugin_load (const char *path)
+{
+    // dlopen() looks names without a slash up in the library path instead of the working directory
+    char local[PATH_MAX];
+    if (!strchr (path, '/'))
+    {
+        snprintf (local, sizeof (local), "./%s", path);
+        path = local;
+    }
+
+    dgfx_ctx.plugin_handle = dlopen (path, RTLD_NOW | RTLD_LOCAL);
+    if (!dgfx_ctx.plugin_handle)
+    {
+        fprintf (stderr, "Could not load plugin: %s\n", dlerror ());
+        return false;
+    }
+
+    const struct dgfx_plugin *plugin = dlsym (dgfx_ctx.plugin_handle, DGFX_PLUGIN_SYMBOL);
+    if (!plugin)
+    {
+        fprintf (stderr, "Plugin %s does not export \"" DGFX_PLUGIN_SYMBOL "\"\n", path);
+        goto dgfx_plugin_load_oopsie;
+    }
+
+    if (plugin->abi != DGFX_PLUGIN_ABI)
+    {
+        fprintf (stderr, "Plugin %s was built for ABI version %" PRIu32 ", this dgfx has version %d\n", path,
+                 plugin->abi, DGFX_PLUGIN_ABI);
+        goto dgfx_plugin_load_oopsie;
+    }
+
+    if (!plugin->shade_tile)
+    {
+        fprintf (stderr, "Plugin %s has no shade_tile function\n", path);
+        goto dgfx_plugin_load_oopsie;
+    }
+
+    dgfx_ctx.plugin = plugin;
+    return true;
+
+dgfx_plugin_load_oopsie: // --aot falls back to lua after a failed load
+    dlclose (dgfx_ctx.plugin_handle);
+    dgfx_ctx.plugin_handle = NULL;
+    return false;
+}
+
+// runs DGFX_AOT_CC on the translated script at `c_path`, building the plugin `so_path`. the command goes
+// through the shell so DGFX_AOT_CC can carry flags, the paths are passed as arguments and need no quoting.
+bool
+dgfx_aot_cc (const char *c_path, const char *so_path)
+{
+    pid_t pid = fork ();
+    if (pid < 0)
+    {
+        perror ("fork");
+        return false;
+    }
+
+    if (pid == 0)
+    {
+        execl ("/bin/sh", "sh", "-c", DGFX_AOT_CC " -I" DGFX_AOT_INCLUDE " -o \"$0\" \"$1\" -lm", so_path, c_path,
+               (char *)NULL);
+        perror ("execl");
+        _exit (127);
+    }
+
+    int status;
+    if (waitpid (pid, &status, 0) != pid)
+        return false;
+    return WIFEXITED (status) && WEXITSTATUS (status) == 0;
+}
+
+// DGFX_AOT_CC builds for the host cpu (-march=native), so a --script-cache shared between machines must not
+// hand a plugin to a cpu lacking the instructions it uses: `h` folded with the model and feature lines of the
+// first cpu in /proc/cpuinfo (x86 and arm names)
+uint64_t
+dgfx_aot_cpu_key (uint64_t h)
+{
+    static const char *const keys[] = { "vendor_id",   "cpu family", "model",    "model name",       "flags",
+                                        "CPU implementer", "CPU variant", "CPU part", "CPU architecture", "Features" };
+
+    FILE *f = fopen ("/proc/cpuinfo", "r");
+    if (!f)
+        return h;
+
+    char line[8192];
+    while (fgets (line, sizeof (line), f) && line[0] != '\n')
+    {
+        size_t len = strcspn (line, "\t:");
+        for (size_t i = 0; i < SARRLEN (keys); ++i)
+            if (len == strlen (keys[i]) && strncmp (line, keys[i], len) == 0)
+                h = dgfx_fnv1a (h, line, strlen (line));
+    }
+
+    fclose (f);
+    return h;
+}
+
+// --aot: DGFX_RESOURCE_LUA_AOT translates the script into a plugin's C source, which is built and loaded like a
+// -i shader.so. the plugin is kept as <hash of the source, compiler and cpu>.so in --script-cache, or built in a
+// temporary directory that is gone once it is loaded. a script the translator can't handle, or a compiler that
+// fails, only costs a warning: the script then runs on luajit.
+bool
+dgfx_aot_load (const char *path)
+{
+    bool ok = false;
+    char *src = NULL;
+    char name[PATH_MAX + 2];
+    char dir[PATH_MAX] = "";
+    char so_path[PATH_MAX + 32] = "";
+    char c_path[PATH_MAX + 32] = "";
+    char tmp_so_path[PATH_MAX + 48] = "";
+    char tmp_c_path[PATH_MAX + 48] = "";
+    bool tmp_dir = false;
+
+    lua_State *L = luaL_newstate ();
+    if (!L)
+        return false;
+    luaL_openlibs (L);
+
+    snprintf (name, sizeof (name), "@%s", path);
+    if (!dgfx_file_read (path, &src))
+        goto dgfx_aot_load_oopsie;
+
+    if (luaL_loadfile (L, DGFX_RESOURCE_LUA_AOT) != 0)
+    {
+        fprintf (stderr, "lua load error: %s\n", lua_tostring (L, -1));
+        goto dgfx_aot_load_oopsie;
+    }
+
+    lua_pushlstring (L, src, arrlenu (src));
+    lua_pushstring (L, name);
+    if (lua_pcall (L, 2, 1, 0) != 0)
+    {
+        fprintf (stderr, "Warning: --aot: %s. Running the script on luajit.\n", lua_tostring (L, -1));
+        goto dgfx_aot_load_oopsie;
+    }
+
+    size_t c_len;
+    const char *c_src = lua_tolstring (L, -1, &c_len);
+    uint32_t abi = DGFX_PLUGIN_ABI;
+    uint64_t key = dgfx_fnv1a (0xcbf29ce484222325ULL, DGFX_AOT_CC, sizeof (DGFX_AOT_CC));
+    key = dgfx_fnv1a (key, &abi, sizeof (abi));
+    key = dgfx_aot_cpu_key (key);
+    key = dgfx_fnv1a (key, c_src, c_len);
+
+    if (dgfx_config.script_cache)
+    {
+        snprintf (dir, sizeof (dir), "%s", dgfx_config.script_cache);
+        mkdir (dir, 0755);
+    }
+    else
+    {
+        snprintf (dir, sizeof (dir), "/tmp/dgfx-aot-XXXXXX");
+        if (!mkdtemp (dir))
+        {
+            perror ("mkdtemp");
+            goto dgfx_aot_load_oopsie;
+        }
+        tmp_dir = true;
+    }
+
+    snprintf (so_path, sizeof (so_path), "%s/%016" PRIx64 ".so", dir, key);
+    snprintf (c_path, sizeof (c_path), "%s/%016" PRIx64 ".c", dir, key);
+
+    if (access (so_path, R_OK) != 0)
+    {
+        // built aside and renamed, like dgfx_chunk_compile's cache. the source stays next to the plugin
+        snprintf (tmp_so_path, sizeof (tmp_so_path), "%s/%016" PRIx64 ".%d.so", dir, key, (int)getpid ());
+        snprintf (tmp_c_path, sizeof (tmp_c_path), "%s/%016" PRIx64 ".%d.c", dir, key, (int)getpid ());
+
+        int fd = open (tmp_c_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        bool written = fd >= 0 && dgfx_write_all (fd, (const uint8_t *)c_src, c_len);
+        if (fd >= 0)
+            close (fd);
+        if (!written)
+        {
+            fprintf (stderr, "Warning: --aot: could not write %s: %s. Running the script on luajit.\n", tmp_c_path,
+                     strerror (errno));
+            goto dgfx_aot_load_oopsie;
+        }
+
+        if (!dgfx_aot_cc (tmp_c_path, tmp_so_path) || rename (tmp_so_path, so_path) != 0
+            || rename (tmp_c_path, c_path) != 0)
+        {
+            fprintf (stderr, "Warning: --aot: building %s failed. Running the script on luajit.\n", tmp_c_path);
+            goto dgfx_aot_load_oopsie;
+        }
+    }
+
+    ok = dgfx_plugin_load (so_path);
+    if (!ok)
+        fprintf (stderr, "Warning: --aot: running the script on luajit.\n");
+
+dgfx_aot_load_oopsie:
+    if (tmp_so_path[0])
+        unlink (tmp_so_path);
+    if (tmp_c_path[0])
+        unlink (tmp_c_path);
+    // a loaded library outlives its file
+    if (tmp_dir)
+    {
+        unlink (so_path);
+        unlink (c_path);
+        rmdir (dir);
+    }
+    arrfree (src);
+    lua_close (L);
+    return ok;
+}
+
+// a scratch state of the script for the checks dgfx_init runs before the workers start, like a worker's but
+// without worker_cb.lua. the script's chunk is left on top, not run yet. NULL when it doesn't load, the workers
+// report that.
+lua_State *
+dgfx_script_state (void)
+{
+    lua_State *L = luaL_newstate ();
+    if (!L)
+        return NULL;
+    luaL_openlibs (L);
+
+    if (!dgfx_lua_globals (L, 0, -1, 0) || dgfx_chunk_load (L, dgfx_ctx.script_bc, dgfx_config.input_path) != 0)
+    {
+        lua_close (L);
+        return NULL;
+    }
+    return L;
+}
+
+// sample `i` of DGFX_SAMPLE_POINTS the scratch state checks use: a spread of pixels, the corners first, at a few
+// times
+void
+dgfx_sample_point (size_t i, double *x, double *y, double *t)
+{
+    const double ts[] = { 0.0, 0.37, 2.5, 61.125 };
+    *x = i < 4 ? (i & 1) * (dgfx_config.w - 1) : (i * 2654435761u) % dgfx_config.w;
+    *y = i < 4 ? (i >> 1) * (dgfx_config.h - 1) : (i * 40503u + 7) % dgfx_config.h;
+    *t = ts[i % SARRLEN (ts)];
+}
+
+// DGFX_RESOURCE_LUA_TRACE's result, on top of the stack of `L`, into dgfx_ctx.trace: the nodes with what they
+// depend on, and which stage computes each of them. false for a program this can't evaluate.
+bool
+dgfx_trace_read (lua_State *L)
+{
+    int prog = lua_gettop (L);
+    lua_getfield (L, prog, "op");
+    lua_getfield (L, prog, "a");
+    lua_getfield (L, prog, "b");
+    lua_getfield (L, prog, "k");
+    lua_getfield (L, prog, "out");
+
+    size_t n = lua_objlen (L, prog + 1);
+    for (size_t i = 0; i < n; ++i)
+    {
+        struct dgfx_trace_node node = { .op = TRACE_OP_N };
+
+        lua_rawgeti (L, prog + 1, i + 1);
+        const char *name = lua_tostring (L, -1);
+        for (int op = 0; name && op < TRACE_OP_N; ++op)
+            if (strcmp (name, _trace_op_strings[op]) == 0)
+                node.op = op;
+        lua_pop (L, 1);
+
+        lua_rawgeti (L, prog + 2, i + 1);
+        node.a = lua_tointeger (L, -1);
+        lua_rawgeti (L, prog + 3, i + 1);
+        node.b = lua_tointeger (L, -1);
+        lua_rawgeti (L, prog + 4, i + 1);
+        node.k = lua_tonumber (L, -1);
+        lua_pop (L, 3);
+
+        bool binary = node.op >= TRACE_OP_ADD && node.op < TRACE_OP_UNM;
+        if (node.op == TRACE_OP_N || (node.op >= TRACE_OP_ADD && node.a >= i) || (binary && node.b >= i))
+        {
+            fprintf (stderr, "Warning: --trace: node %zu (%s) is malformed. Running the script on luajit.\n", i,
+                     name ? name : "?");
+            lua_settop (L, prog);
+            return false;
+        }
+
+        if (node.op == TRACE_OP_X)
+            node.deps = DEPENDS_X;
+        else if (node.op == TRACE_OP_Y)
+            node.deps = DEPENDS_Y;
+        else if (node.op == TRACE_OP_T)
+            node.deps = DEPENDS_T;
+        else if (binary)
+            node.deps = dgfx_ctx.trace[node.a].deps | dgfx_ctx.trace[node.b].deps;
+        else if (node.op >= TRACE_OP_UNM)
+            node.deps = dgfx_ctx.trace[node.a].deps;
+
+        int stage = node.deps & DEPENDS_X ? TRACE_STAGE_PACKET
+                    : node.deps & DEPENDS_Y ? TRACE_STAGE_ROW
+                                              : TRACE_STAGE_TILE;
+        arrput (dgfx_ctx.trace, node);
+        arrput (dgfx_ctx.trace_stage[stage], i);
+    }
+
+    bool ok = true;
+    for (int c = 0; c < 3; ++c)
+    {
+        lua_rawgeti (L, prog + 5, c + 1);
+        dgfx_ctx.trace_out[c] = lua_tointeger (L, -1);
+        ok = ok && dgfx_ctx.trace_out[c] < n;
+        lua_pop (L, 1);
+    }
+
+    lua_settop (L, prog);
+    return ok;
+}
+
+// --trace: DGFX_RESOURCE_LUA_TRACE records what rgb computes in a state of its own, and the program is checked
+// against rgb on a few pixels before workers evaluate it instead of building lua states. scripts that can't be
+// traced, or whose program computes something else (state kept between calls, math.random, comparisons with
+// ==, which can't be intercepted), only cost a warning: they run on luajit.
+bool
+dgfx_trace_load (void)
+{
+    bool ok = false;
+    double *regs = NULL;
+
+    lua_State *L = dgfx_script_state ();
+    if (!L)
+        return false;
+
+    if (luaL_loadfile (L, DGFX_RESOURCE_LUA_TRACE) != 0)
+    {
+        fprintf (stderr, "lua load error: %s\n", lua_tostring (L, -1));
+        goto dgfx_trace_load_oopsie;
+    }
+    lua_insert (L, -2); // trace.lua, script
+
+    lua_pushinteger (L, DGFX_TRACE_MAX_NODES);
+    if (lua_pcall (L, 2, 2, 0) != 0)
+    {
+        fprintf (stderr, "Warning: --trace: %s. Running the script on luajit.\n", lua_tostring (L, -1));
+        goto dgfx_trace_load_oopsie;
+    }
+
+    lua_insert (L, -2); // rgb, program
+    if (!dgfx_trace_read (L))
+        goto dgfx_trace_load_oopsie;
+    lua_pop (L, 1);
+
+    regs = malloc (arrlenu (dgfx_ctx.trace) * DGFX_TRACE_LANES * sizeof (double));
+    if (!regs)
+    {
+        perror ("malloc");
+        goto dgfx_trace_load_oopsie;
+    }
+
+    for (size_t i = 0; i < DGFX_SAMPLE_POINTS; ++i)
+    {
+        double x, y, t;
+        dgfx_sample_point (i, &x, &y, &t);
+
+        dgfx_trace_eval (regs, TRACE_STAGE_TILE, x, y, t);
+
+        lua_pushvalue (L, -1);
+        lua_pushnumber (L, x);
+        lua_pushnumber (L, y);
+        lua_pushnumber (L, t);
+        if (lua_pcall (L, 3, 3, 0) != 0)
+        {
+            fprintf (stderr, "Warning: --trace: %s. Running the script on luajit.\n", lua_tostring (L, -1));
+            goto dgfx_trace_load_oopsie;
+        }
+
+        for (int c = 0; c < 3; ++c)
+        {
+            double want = lua_tonumber (L, c - 3);
+            double got = regs[(size_t)dgfx_ctx.trace_out[c] * DGFX_TRACE_LANES];
+            if (got != want && !(got != got && want != want))
+            {
+                fprintf (stderr,
+                         "Warning: --trace: the traced rgb (%g, %g, %g) returns %.17g as its %c value, the script "
+                         "%.17g. Running the script on luajit.\n",
+                         x, y, t, got, "rgb"[c], want);
+                goto dgfx_trace_load_oopsie;
+            }
+        }
+        lua_pop (L, 3);
+    }
+
+    ok = true;
+
+dgfx_trace_load_oopsie:
+    if (!ok)
+    {
+        arrfree (dgfx_ctx.trace);
+        for (int i = 0; i < TRACE_STAGE_N; ++i)
+            arrfree (dgfx_ctx.trace_stage[i]);
+    }
+    free (regs);
+    lua_close (L);
+    return ok;
+}
+
+// rgb (x, y, t) of the scratch state `L`, which has rgb at `rgb` and frame (or nil) at `frame`. false when the
+// script raises an error.
+bool
+dgfx_depends_rgb (lua_State *L, int rgb, int frame, double x, double y, double t, double out[3])
+{
+    int base = lua_gettop (L);
+    lua_pushvalue (L, rgb);
+    lua_pushnumber (L, x);
+    lua_pushnumber (L, y);
+    lua_pushnumber (L, t);
+    if (!lua_isnil (L, frame))
+    {
+        lua_pushvalue (L, frame);
+        lua_pushnumber (L, t);
+        if (lua_pcall (L, 1, 1, 0) != 0)
+            goto dgfx_depends_rgb_oopsie;
+    }
+
+    if (lua_pcall (L, lua_gettop (L) - base - 1, 3, 0) != 0)
+        goto dgfx_depends_rgb_oopsie;
+
+    for (int c = 0; c < 3; ++c)
+        out[c] = lua_tonumber (L, c - 3);
+    lua_settop (L, base);
+    return true;
+
+dgfx_depends_rgb_oopsie:
+    fprintf (stderr, "Warning: depends: %s. Shading every pixel of every frame.\n", lua_tostring (L, -1));
+    lua_settop (L, base);
+    return false;
+}
+
+// what the picture changes with, for dgfx_tiles_build and dgfx_doframe. a --trace program knows exactly. any other
+// script can say so itself with a global listing the arguments rgb uses, depends = "xy" for a still picture,
+// which is checked on DGFX_SAMPLE_POINTS pixels against the same pixels with each of the other arguments changed.
+// a claim rgb contradicts costs a warning and the script is shaded in full, every frame.
+// reading the global means running the script's top level here, on the main thread before any worker starts, for
+// every lua script whether or not it declares depends. that's one more run of whatever side effects it has and a
+// serial wait at startup, but it's also what builds the dgfx.shared and dgfx.lut blocks before worker processes fork.
+void
+dgfx_depends_load (void)
+{
+    if (dgfx_ctx.trace)
+    {
+        dgfx_ctx.depends = 0;
+        for (int c = 0; c < 3; ++c)
+            dgfx_ctx.depends |= dgfx_ctx.trace[dgfx_ctx.trace_out[c]].deps;
+        return;
+    }
+
+    lua_State *L = dgfx_script_state ();
+    if (!L)
+        return;
+    if (lua_pcall (L, 0, 0, 0) != 0) // the workers report it
+        goto dgfx_depends_load_oopsie;
+
+    lua_getglobal (L, "depends");
+    if (lua_isnil (L, -1))
+        goto dgfx_depends_load_oopsie;
+
+    const char *claim = lua_type (L, -1) == LUA_TSTRING ? lua_tostring (L, -1) : NULL;
+    uint8_t depends = 0;
+    for (const char *c = claim; c && *c; ++c)
+    {
+        if (*c == 'x' || *c == 'y' || *c == 't')
+            depends |= *c == 'x' ? DEPENDS_X : *c == 'y' ? DEPENDS_Y : DEPENDS_T;
+        else
+            claim = NULL;
+    }
+    if (!claim)
+    {
+        fprintf (stderr, "Warning: depends must be a string of the letters x, y and t. It's ignored.\n");
+        goto dgfx_depends_load_oopsie;
+    }
+
+    lua_getglobal (L, "rgb");
+    lua_getglobal (L, "frame");
+    int rgb = lua_gettop (L) - 1, frame = rgb + 1;
+    const char *other[] = { "rgb_row", "setup", "shade" };
+    bool checkable = lua_isfunction (L, rgb) && (lua_isnil (L, frame) || lua_isfunction (L, frame));
+    for (size_t i = 0; i < SARRLEN (other); ++i)
+    {
+        lua_getglobal (L, other[i]);
+        checkable = checkable && lua_isnil (L, -1);
+        lua_pop (L, 1);
+    }
+    if (!checkable)
+    {
+        fprintf (stderr, "Warning: depends can only be checked for rgb(n, m, t) and frame(t). It's ignored.\n");
+        goto dgfx_depends_load_oopsie;
+    }
+
+    for (size_t i = 0; i < DGFX_SAMPLE_POINTS; ++i)
+    {
+        double p[3], want[3];
+        dgfx_sample_point (i, &p[0], &p[1], &p[2]);
+        if (!dgfx_depends_rgb (L, rgb, frame, p[0], p[1], p[2], want))
+            goto dgfx_depends_load_oopsie;
+
+        // the next sample's value for every argument the claim leaves out
+        for (int a = 0; a < 3; ++a)
+        {
+            if (depends & (1 << a))
+                continue;
+
+            double q[3] = { p[0], p[1], p[2] }, next[3], got[3];
+            dgfx_sample_point ((i + 1) % DGFX_SAMPLE_POINTS, &next[0], &next[1], &next[2]);
+            q[a] = next[a];
+            if (!dgfx_depends_rgb (L, rgb, frame, q[0], q[1], q[2], got))
+                goto dgfx_depends_load_oopsie;
+
+            for (int c = 0; c < 3; ++c)
+            {
+                if (got[c] != want[c] && !(got[c] != got[c] && want[c] != want[c]))
+                {
+                    fprintf (stderr,
+                             "Warning: depends = \"%s\", but rgb (%g, %g, %g) and rgb (%g, %g, %g) differ. Shading "
+                             "every pixel of every frame.\n",
+                             claim, p[0], p[1], p[2], q[0], q[1], q[2]);
+                    goto dgfx_depends_load_oopsie;
+                }
+            }
+        }
+    }
+
+    dgfx_ctx.depends = depends;
+
+dgfx_depends_load_oopsie:
+    lua_close (L);
+}
+
+// splits the frame into tiles. a script that doesn't depend on x only gets the first column shaded, one that
+// doesn't depend on y only the first row, and dgfx_broadcast fills in the rest.
+void
+dgfx_tiles_build (void)
+{
+    uint32_t w = dgfx_ctx.depends & DEPENDS_X ? dgfx_config.w : 1;
+    uint32_t h = dgfx_ctx.depends & DEPENDS_Y ? dgfx_config.h : 1;
+
+    for (uint32_t y = 0; y < h; y += dgfx_config.tile_h)
+    {
+        for (uint32_t x = 0; x < w; x += dgfx_config.tile_w)
+        {
+            struct dgfx_tile tile = { .x = x, .y = y, .w = dgfx_config.tile_w, .h = dgfx_config.tile_h };
+            if (tile.x + tile.w > w)
+                tile.w = w - tile.x;
+            if (tile.y + tile.h > h)
+                tile.h = h - tile.y;
+
+            arrput (dgfx_ctx.tiles, tile);
+        }
+    }
+}
+
+bool
+dgfx_init (uint8_t *init_pixels)
+{
+    dgfx_ctx.pixels = init_pixels;
+    dgfx_ctx.pitch = dgfx_config.w * 4;
+
+    size_t n_workers = (dgfx_config.worker_n ? dgfx_config.worker_n : 1) + arrlenu (dgfx_config.remotes);
+
+    bool loaded = dgfx_plugin_path (dgfx_config.input_path)
+                      ? dgfx_plugin_load (dgfx_config.input_path)
+                      : (dgfx_config.aot && dgfx_aot_load (dgfx_config.input_path)) || dgfx_chunks_compile ();
+    if (loaded && dgfx_config.trace && !dgfx_ctx.plugin)
+        dgfx_trace_load (); // or the script runs on lua
+    if (loaded && !dgfx_plugin_path (dgfx_config.input_path))
+        dgfx_depends_load ();
+    dgfx_tiles_build ();
+    if (!loaded || !dgfx_affinity_init () || !dgfx_shared_init (n_workers, arrlenu (dgfx_ctx.tiles)))
+    {
+        dgfx_deinit ();
+        return false;
+    }
+
+    // worker processes can only write the shared framebuffer, the caller's one becomes a copy target
+    if (dgfx_config.backend == BACKEND_PROCESSES)
+    {
+        dgfx_ctx.target = init_pixels;
+        dgfx_ctx.target_pitch = dgfx_ctx.pitch;
+    }
+
+    // worker processes are forked before the script says whether it needs a setup cache, they inherit this
+    // and map it once it is sized
+    if (dgfx_config.backend == BACKEND_PROCESSES)
+    {
+        dgfx_ctx.setup_fd = memfd_create ("dgfx-setup", MFD_CLOEXEC);
+        if (dgfx_ctx.setup_fd < 0)
+        {
+            perror ("memfd_create");
+            dgfx_deinit ();
+            return false;
+        }
+    }
+
+    // all workers build their lua states at the same time, worker 0's on this thread
+    double start = dgfx_time_now ();
+    bool ok = true;
+
+    for (size_t i = 0; i < n_workers && ok; ++i)
+    {
+        struct dgfx_worker *w = &dgfx_ctx.workers[i];
+        dgfx_ctx.worker_n = i + 1;
+
+        if (!dgfx_worker_init (w, i))
+        {
+            dgfx_worker_fail (w, "could not be started");
+            atomic_store (&w->startup, STARTUP_FAILED);
+            ok = false;
+        }
+    }
+
+    struct dgfx_worker *w0 = &dgfx_ctx.workers[0];
+    if (ok)
+        atomic_store (&w0->startup, dgfx_worker_shader_init (w0) ? STARTUP_READY : STARTUP_FAILED);
+    else if (atomic_load (&w0->startup) == STARTUP_PENDING)
+    {
+        dgfx_worker_fail (w0, "not started");
+        atomic_store (&w0->startup, STARTUP_FAILED);
+    }
+
+    ok = dgfx_workers_wait () && ok;
+    if (ok && dgfx_config.startup_times)
+        dgfx_startup_report (dgfx_time_now () - start);
+
+    if (!ok || (w0->setup_floats && !dgfx_setup_cache_init (w0->setup_floats)))
+    {
+        dgfx_deinit ();
+        return false;
+    }
+
+    dgfx_sched_partition (n_workers);
+
+    return true;
+}
+
+uint8_t *
+dgfx_pixels_set (void *new, size_t pitch)
+{
+    if (!new)
+        UNREACHABLE;
+
+    uint8_t *t;
+    if (dgfx_config.backend == BACKEND_PROCESSES)
+    {
+        t = dgfx_ctx.target;
+        dgfx_ctx.target = new;
+        dgfx_ctx.target_pitch = pitch;
+        return t;
+    }
+
+    t = dgfx_ctx.pixels;
+    dgfx_ctx.pixels = new;
+    dgfx_ctx.pitch = pitch;
+    return t;
+}
+
+// wakes the workers on a new job, returns immediately
+void
+dgfx_job_begin (int job)
+{
+    struct dgfx_frame_sync *sync = dgfx_ctx.sync;
+
+    uint32_t pending = 0;
+    for (size_t i = 1; i < sync->active_n; ++i)
+        pending += !dgfx_ctx.workers[i].dead;
+
+    sync->job = job;
+    dgfx_ctx.worker_lost = false;
+    atomic_store (&sync->failed, false);
+    atomic_store (&sync->pending, pending);
+    atomic_fetch_add (&sync->epoch, 1);
+    dgfx_futex_wake (&sync->epoch, &sync->epoch_sleepers, INT_MAX);
+}
+
+// checks for worker processes that died. a dead worker never counts down `pending`, so the job is
+// finished once every live worker has reported it done on its own.
+bool
+dgfx_job_reap (void)
+{
+    struct dgfx_frame_sync *sync = dgfx_ctx.sync;
+    uint32_t epoch = atomic_load (&sync->epoch);
+    bool lost = false;
+
+    for (size_t i = 1; i < sync->active_n; ++i)
+        if (!dgfx_ctx.workers[i].dead && dgfx_worker_reap (&dgfx_ctx.workers[i]))
+            lost = true;
+
+    if (!lost)
+        return false;
+
+    for (size_t i = 1; i < sync->active_n; ++i)
+    {
+        struct dgfx_worker *w = &dgfx_ctx.workers[i];
+        while (atomic_load (&w->done_epoch) != epoch && !dgfx_worker_reap (w))
+            nanosleep (&(struct timespec){ .tv_nsec = 1000000 }, NULL);
+    }
+
+    dgfx_ctx.worker_lost = true;
+    atomic_store (&sync->failed, true);
+    return true;
+}
+
+bool
+dgfx_jobs_pending (void *arg)
+{
+    (void)arg;
+    return atomic_load_explicit (&dgfx_ctx.sync->pending, memory_order_relaxed) != 0;
+}
+
+// collector time and heap size summed over the local workers, as of their last collection
+void
+dgfx_gc_stats (double *gc_ms, double *heap_mb)
+{
+    uint64_t ns = 0, kb = 0;
+    for (size_t i = 0; i < dgfx_ctx.worker_n; ++i)
+    {
+        ns += atomic_load_explicit (&dgfx_ctx.workers[i].gc_ns, memory_order_relaxed);
+        kb += atomic_load_explicit (&dgfx_ctx.workers[i].gc_heap_kb, memory_order_relaxed);
+    }
+
+    *gc_ms = ns / 1e6;
+    *heap_mb = kb / 1024.0;
+}
+
+// does the main thread's share of the job, then waits for the workers
+bool
+dgfx_job_wait (void)
+{
+    struct dgfx_frame_sync *sync = dgfx_ctx.sync;
+
+    bool ok = dgfx_worker_run_job (&dgfx_ctx.workers[0]);
+    if (!ok)
+        atomic_store (&sync->failed, true);
+
+    // the main thread's idle gap is the wait for the other workers
+    if (sync->job == JOB_TILES)
+        dgfx_worker_gc (&dgfx_ctx.workers[0], dgfx_jobs_pending, NULL);
+
+    int timeout_ms = dgfx_config.backend == BACKEND_PROCESSES ? DGFX_PROCESS_POLL_MS : -1;
+
+    uint32_t pending;
+    while ((pending = atomic_load (&sync->pending)) != 0)
+    {
+        if (dgfx_wait_change (&sync->pending, pending, &sync->pending_sleepers, timeout_ms) == pending
+            && timeout_ms >= 0 && dgfx_job_reap ())
+            break;
+    }
+
+    return !atomic_load (&sync->failed);
+}
+
+// publishes a frame to the worker threads, returns immediately
+bool
+dgfx_frame_begin (double cur_t)
+{
+    struct dgfx_frame_sync *sync = dgfx_ctx.sync;
+
+    if (dgfx_config.balance == BALANCE_ADAPTIVE && dgfx_ctx.tile_cost_valid)
+        dgfx_sched_rebalance ();
+
+    // refill every deque before waking anyone, so early workers can steal from late ones
+    for (size_t i = 0; i < sync->active_n; ++i)
+    {
+        struct dgfx_worker *w = &dgfx_ctx.workers[i];
+        atomic_store_explicit (&w->tile_range, DGFX_RANGE_PACK (w->tile_first, w->tile_first + w->tile_count),
+                               memory_order_relaxed);
+    }
+
+    sync->t_param = cur_t;
+    dgfx_job_begin (JOB_TILES);
+
+    return true;
+}
+
+// renders the main thread's share of the frame, then waits for the worker threads
+bool
+dgfx_frame_wait (void)
+{
+    struct dgfx_frame_sync *sync = dgfx_ctx.sync;
+
+    if (!dgfx_job_wait ())
+    {
+        dgfx_ctx.tile_cost_valid = false;
+        fprintf (stderr, "Worker failed to complete work\n");
+        return false;
+    }
+
+    size_t tiles_done = 0;
+    for (size_t i = 0; i < sync->active_n; ++i)
+        if (!dgfx_ctx.workers[i].dead)
+            tiles_done += dgfx_ctx.workers[i].tiles_done;
+
+    if (tiles_done != arrlenu (dgfx_ctx.tiles))
+    {
+        fprintf (stderr, "Frame incomplete: %zu of %zu tiles shaded\n", tiles_done, arrlenu (dgfx_ctx.tiles));
+        return false;
+    }
+
+    if (sync->job == JOB_TILES)
+    {
+        dgfx_ctx.tile_cost_valid = true;
+        dgfx_broadcast (dgfx_ctx.pixels, dgfx_ctx.pitch, 4);
+        if (dgfx_ctx.hdr_frame)
+            dgfx_broadcast (dgfx_ctx.hdr_frame, dgfx_config.w * 4 * sizeof (float), 4 * sizeof (float));
+    }
+
+    if (dgfx_ctx.target)
+    {
+        for (size_t y = 0; y < dgfx_config.h; ++y)
+            memcpy (dgfx_ctx.target + y * dgfx_ctx.target_pitch, dgfx_ctx.pixels + y * dgfx_ctx.pitch,
+                    dgfx_config.w * 4);
+    }
+
+    return true;
+}
+
+// the frame the caller sees: the copy target of worker processes, or the one the workers shade
+uint8_t *
+dgfx_frame_out (size_t *pitch)
+{
+    *pitch = dgfx_ctx.target ? dgfx_ctx.target_pitch : dgfx_ctx.pitch;
+    return dgfx_ctx.target ? dgfx_ctx.target : dgfx_ctx.pixels;
+}
+
+// a framebuffer about to be freed, or written by something else than dgfx_doframe, no longer holds the still frame
+void
+dgfx_pixels_forget (const void *pixels)
+{
+    for (size_t i = 0; i < arrlenu (dgfx_ctx.still_out); ++i)
+    {
+        if (dgfx_ctx.still_out[i] == pixels)
+        {
+            arrdelswap (dgfx_ctx.still_out, i);
+            return;
+        }
+    }
+}
+
+// scripts that don't depend on t: keeps the first frame shaded, or copies it into the current framebuffer unless
+// an earlier frame already did. bench mode's buffer and render mode's ring slots are reused, so after the first
+// round every frame is free.
+bool
+dgfx_still (bool keep)
+{
+    size_t pitch, row = dgfx_config.w * 4;
+    uint8_t *pixels = dgfx_frame_out (&pitch);
+
+    for (size_t i = 0; i < arrlenu (dgfx_ctx.still_out); ++i)
+        if (dgfx_ctx.still_out[i] == pixels)
+            return true;
+    arrput (dgfx_ctx.still_out, pixels);
+
+    if (keep)
+    {
+        dgfx_ctx.still = malloc (dgfx_config.h * row);
+        if (!dgfx_ctx.still)
+        {
+            perror ("malloc");
             return false;
         }
     }
 
-    return true;
+    for (size_t y = 0; y < dgfx_config.h; ++y)
+    {
+        if (keep)
+            memcpy (dgfx_ctx.still + y * row, pixels + y * pitch, row);
+        else
+            memcpy (pixels + y * pitch, dgfx_ctx.still + y * row, row);
+    }
+    return true;
+}
+
+bool
+dgfx_doframe_shade (double cur_t)
+{
+    if (!dgfx_frame_begin (cur_t))
+        return false;
+    if (dgfx_frame_wait ())
+        return true;
+
+    // a crashed worker process or a disconnected remote worker only takes the tiles it held with it.
+    // its deque is stolen by the others, so the frame is worth one more try.
+    if (!dgfx_ctx.worker_lost)
+        return false;
+
+    fprintf (stderr, "Retrying frame without the lost worker\n");
+    return dgfx_frame_begin (cur_t) && dgfx_frame_wait ();
+}
+
+bool
+dgfx_doframe (double cur_t)
+{
+    if (dgfx_ctx.still)
+        return dgfx_still (false);
+    if (!dgfx_doframe_shade (cur_t))
+        return false;
+    return dgfx_ctx.depends & DEPENDS_T || dgfx_still (true);
+}
+
+// cpus this process may actually use: the affinity mask, further capped by a cgroup cpu quota
+size_t
+dgfx_cpu_budget (void)
+{
+    cpu_set_t allowed;
+    CPU_ZERO (&allowed);
+    size_t budget = sched_getaffinity (0, sizeof (allowed), &allowed) == 0 ? (size_t)CPU_COUNT (&allowed) : 1;
+
+    long quota = -1, period = -1;
+
+    // our own cgroup: "0::<path>" with cgroup v2, "<id>:<controllers>:<path>" with v1, where the controller
+    // list naming "cpu" is the one that holds the quota
+    char cgroup[PATH_MAX] = "", cgroup_v1[PATH_MAX] = "";
+    FILE *f = fopen ("/proc/self/cgroup", "r");
+    if (f)
+    {
+        char line[PATH_MAX];
+        while (fgets (line, sizeof (line), f))
+        {
+            line[strcspn (line, "\n")] = 0;
+            char *controllers = strchr (line, ':');
+            char *path = controllers ? strchr (controllers + 1, ':') : NULL;
+            if (!path)
+                continue;
+            *path++ = 0;
+            controllers++;
+
+            if (strcmp (line, "0") == 0 && !*controllers)
+            {
+                snprintf (cgroup, sizeof (cgroup), "%s", strcmp (path, "/") == 0 ? "" : path);
+                continue;
+            }
+
+            char *save = NULL;
+            for (char *c = strtok_r (controllers, ",", &save); c; c = strtok_r (NULL, ",", &save))
+                if (strcmp (c, "cpu") == 0)
+                    snprintf (cgroup_v1, sizeof (cgroup_v1), "%s", strcmp (path, "/") == 0 ? "" : path);
+        }
+        fclose (f);
+    }
+
+    // cgroup v2: "<quota> <period>" or "max <period>". a container sees its own cgroup as the root of the mount
+    // while /proc still names it by its full path, hence the fallbacks to the root
+    char path[PATH_MAX + 64];
+    snprintf (path, sizeof (path), "/sys/fs/cgroup%s/cpu.max", cgroup);
+    f = fopen (path, "r");
+    if (!f)
+        f = fopen ("/sys/fs/cgroup/cpu.max", "r");
+    if (f)
+    {
+        char quota_str[32];
+        if (fscanf (f, "%31s %ld", quota_str, &period) == 2 && strcmp (quota_str, "max") != 0)
+            quota = strtol (quota_str, NULL, 10);
+        fclose (f);
+    }
+    else // cgroup v1, -1 quota is no limit
+    {
+        snprintf (path, sizeof (path), "/sys/fs/cgroup/cpu%s/cpu.cfs_quota_us", cgroup_v1);
+        if (access (path, R_OK) != 0)
+            cgroup_v1[0] = 0;
+
+        snprintf (path, sizeof (path), "/sys/fs/cgroup/cpu%s/cpu.cfs_quota_us", cgroup_v1);
+        quota = dgfx_sysfs_read_int (path, -1);
+        snprintf (path, sizeof (path), "/sys/fs/cgroup/cpu%s/cpu.cfs_period_us", cgroup_v1);
+        period = dgfx_sysfs_read_int (path, -1);
+    }
+
+    if (quota > 0 && period > 0)
+    {
+        size_t quota_cpus = (quota + period - 1) / period;
+        if (quota_cpus < budget)
+            budget = quota_cpus;
+    }
+
+    return budget ? budget : 1;
+}
+
+// stops the workers past the first `keep`, so they don't wake up, spin and go back to sleep on every frame
+// they take no part in. must be called between frames, after dgfx_sched_partition (keep).
+void
+dgfx_workers_retire (size_t keep)
+{
+    if (keep >= dgfx_ctx.worker_n)
+        return;
+
+    dgfx_job_begin (JOB_RETIRE);
+    dgfx_job_wait ();
+
+    for (size_t i = keep; i < dgfx_ctx.worker_n; ++i)
+        dgfx_worker_stop (&dgfx_ctx.workers[i]);
+    dgfx_ctx.worker_n = keep;
+}
+
+// renders calibration frames with a growing number of active workers and keeps the smallest count after which
+// doubling the workers stops paying off. requires a framebuffer to be set.
+size_t
+dgfx_calibrate_jobs (void)
+{
+    size_t max_n = dgfx_ctx.worker_n;
+    size_t best_n = 1;
+    double base_time = 0, best_time = 0;
+
+    if (!(dgfx_ctx.depends & DEPENDS_T))
+    {
+        printf ("Using %zu jobs, the script doesn't depend on t so its frame is only shaded once\n", max_n);
+        return max_n;
+    }
+
+    printf ("Calibrating job count (up to %zu):\n", max_n);
+
+    // every state traces its hot paths once, so JIT compilation doesn't count against small worker counts
+    dgfx_sched_partition (max_n);
+    dgfx_doframe (0);
+
+    for (size_t n = 1;; n = n * 2 < max_n ? n * 2 : max_n)
+    {
+        dgfx_sched_partition (n);
+
+        double frame_time = 0;
+        for (int i = 0; i < DGFX_CALIBRATION_FRAMES; ++i)
+        {
+            double start = dgfx_time_now ();
+            if (!dgfx_doframe ((double)i / dgfx_config.fps))
+            {
+                dgfx_sched_partition (best_n);
+                dgfx_workers_retire (best_n);
+                return best_n;
+            }
+
+            double elapsed = dgfx_time_now () - start;
+            if (i == 0 || elapsed < frame_time)
+                frame_time = elapsed;
+        }
+
+        if (n == 1)
+            base_time = best_time = frame_time;
+
+        printf ("\t%4zu jobs: %8.3f ms/frame, speedup %.2fx\n", n, frame_time * 1000.0, base_time / frame_time);
+
+        if (n > 1)
+        {
+            if (best_time / frame_time < 1.0 + DGFX_CALIBRATION_MIN_GAIN)
+                break;
+            best_n = n;
+            best_time = frame_time;
+        }
+
+        if (n == max_n)
+            break;
+    }
+
+    printf ("Using %zu jobs\n", best_n);
+
+    dgfx_sched_partition (best_n);
+    dgfx_workers_retire (best_n);
+    return best_n;
+}
+
+// zeroes the current framebuffer, each worker writing the tiles it owns. pages of a fresh buffer are then
+// placed on the NUMA node of the worker that will normally shade them.
+bool
+dgfx_pixels_first_touch (void)
+{
+    size_t pitch;
+    dgfx_pixels_forget (dgfx_frame_out (&pitch));
+
+    dgfx_job_begin (JOB_FIRST_TOUCH);
+    return dgfx_frame_wait ();
+}
+
+// renders frames [0, frame_count) into `ring`, each worker taking whole frames. no per-frame barrier:
+// the only synchronisation is claiming a frame number and waiting for a free slot in the ring.
+bool
+dgfx_render_frames (struct dgfx_frame_ring *ring, size_t frame_count)
+{
+    struct dgfx_frame_sync *sync = dgfx_ctx.sync;
+
+    sync->ring = ring;
+    sync->frame_count = frame_count;
+    atomic_store (&sync->next_frame, 0);
+
+    dgfx_job_begin (JOB_FRAMES);
+    return dgfx_job_wait ();
+}
+
+// --warmup: throwaway frames, so traces are recorded and compiled (and adaptive balancing has tile costs) before
+// anything is timed or shown. leaves the framebuffer pointing at freed memory, every mode sets its own.
+bool
+dgfx_warmup (void)
+{
+    size_t pitch = dgfx_config.w * sizeof (uint32_t);
+    uint8_t *scratch = malloc (dgfx_config.h * pitch);
+    if (!scratch)
+    {
+        perror ("malloc");
+        return false;
+    }
+    dgfx_pixels_set (scratch, pitch);
+
+    bool ok = true;
+    for (size_t frame = 0; ok && frame < dgfx_config.warmup; ++frame)
+        ok = dgfx_doframe ((double)frame / dgfx_config.fps);
+
+    dgfx_pixels_forget (scratch);
+    free (scratch);
+    return ok;
 }
 
-uint8_t *
-dgfx_pixels_set (void *new)
+// renders frame_count frames into a scratch buffer and reports how long they took
+bool
+dgfx_bench (void)
 {
-    if (!new)
-        UNREACHABLE;
+    size_t pitch = dgfx_config.w * sizeof (uint32_t);
+    uint8_t *pixels = malloc (dgfx_config.h * pitch);
+    if (!pixels)
+    {
+        perror ("malloc");
+        return false;
+    }
+    dgfx_pixels_set (pixels, pitch);
 
-    uint8_t *t = dgfx_ctx.pixels;
-    dgfx_ctx.pixels = new;
-    return t;
-}
+    // not timed: the framebuffer gets faulted in (traces were compiled by --warmup)
+    bool ok = dgfx_doframe (0);
 
-void
-dgfx_deinit (void)
-{
-    for (size_t i = 0; i < arrlenu (dgfx_ctx.workers); ++i)
+    double total = 0, best = 0, worst = 0, gc_total = 0, heap_peak = 0;
+    for (size_t frame = 0; ok && frame < dgfx_config.frame_count; ++frame)
+    {
+        double start = dgfx_time_now ();
+        ok = dgfx_doframe ((double)frame / dgfx_config.fps);
+
+        double elapsed = dgfx_time_now () - start;
+        total += elapsed;
+        if (frame == 0 || elapsed < best)
+            best = elapsed;
+        if (elapsed > worst)
+            worst = elapsed;
+
+        // with GC_IDLE a worker may still be collecting after the previous frame, good enough for an average
+        double gc_ms, heap_mb;
+        dgfx_gc_stats (&gc_ms, &heap_mb);
+        gc_total += gc_ms;
+        if (heap_mb > heap_peak)
+            heap_peak = heap_mb;
+    }
+
+    if (ok && dgfx_config.frame_count > 0)
     {
-        dgfx_worker_shutdown (&dgfx_ctx.workers[i]);
+        double avg = total / dgfx_config.frame_count;
+        if (dgfx_ctx.plugin)
+            printf ("%s plugin, ", dgfx_ctx.plugin->name ? dgfx_ctx.plugin->name : dgfx_config.input_path);
+        else if (dgfx_ctx.trace)
+            printf ("traced, %zu nodes, ", arrlenu (dgfx_ctx.trace));
+        else
+            printf ("%s write path, ", _write_path_strings[dgfx_config.write_path]);
+        printf ("%zu jobs, %zux%zu, %zu frames: %.3f ms/frame avg, %.3f ms/frame min, %.1f Mpixel/s\n",
+                dgfx_ctx.sync->active_n, dgfx_config.w, dgfx_config.h, dgfx_config.frame_count, avg * 1000.0,
+                best * 1000.0, dgfx_config.w * dgfx_config.h / avg / 1e6);
+        if (dgfx_ctx.depends != DEPENDS_ALL)
+            printf ("depends on %s%s%s: %s\n", dgfx_ctx.depends & DEPENDS_X ? "x" : "",
+                    dgfx_ctx.depends & DEPENDS_Y ? "y" : "", dgfx_ctx.depends & DEPENDS_T ? "t" : "",
+                    !(dgfx_ctx.depends & DEPENDS_T)   ? "frames after the first are copies of it"
+                    : dgfx_ctx.depends & DEPENDS_X ? "shading a row, copied down the frame"
+                    : dgfx_ctx.depends & DEPENDS_Y ? "shading a column, copied across the frame"
+                                                   : "shading a pixel, copied everywhere");
+        if (!dgfx_ctx.plugin && !dgfx_ctx.trace) // nothing to collect
+            printf ("gc %s: %.3f ms/frame max, %.3f ms/frame in the collector (all jobs), %.1f MB peak heap\n",
+                    _gc_strings[dgfx_config.gc], worst * 1000.0, gc_total / dgfx_config.frame_count, heap_peak);
     }
 
-    arrfree (dgfx_ctx.workers);
+    dgfx_pixels_forget (pixels);
+    free (pixels);
+    return ok;
 }
 
+// serves one coordinator connection: builds a lua state from the script it sends, then shades tiles on request
 bool
-dgfx_frame_begin (double cur_t)
+dgfx_serve_conn (int sock)
 {
-    for (uint8_t i = 0; i < dgfx_config.worker_n; ++i)
+    bool ok = false;
+    struct dgfx_worker *w = NULL;
+    uint8_t *reply = NULL;
+
+    struct dgfx_remote_hello hello;
+    if (!dgfx_recv_all (sock, &hello, sizeof (hello)))
+        return false;
+
+    if (ntohl (hello.magic) != DGFX_REMOTE_MAGIC || ntohl (hello.version) != DGFX_REMOTE_VERSION)
+    {
+        fprintf (stderr, "Rejected connection: not a dgfx coordinator, or a different version\n");
+        return false;
+    }
+
+    dgfx_config.gc = GC_LUA; // requests come without frame boundaries to collect at
+    dgfx_config.w = ntohl (hello.w);
+    dgfx_config.h = ntohl (hello.h);
+    dgfx_config.tile_w = ntohl (hello.tile_w);
+    dgfx_config.tile_h = ntohl (hello.tile_h);
+    dgfx_config.hdr = ntohl (hello.hdr) != 0;
+    dgfx_config.tonemap = ntohl (hello.tonemap);
+    uint32_t exposure_bits = ntohl (hello.exposure);
+    memcpy (&dgfx_config.exposure, &exposure_bits, sizeof (exposure_bits));
+    size_t name_len = ntohl (hello.name_len);
+    size_t script_len = ntohl (hello.script_len);
+
+    if (dgfx_config.w == 0 || dgfx_config.h == 0 || dgfx_config.w > DGFX_REMOTE_MAX_SIDE
+        || dgfx_config.h > DGFX_REMOTE_MAX_SIDE || dgfx_config.tile_w == 0 || dgfx_config.tile_h == 0
+        || dgfx_config.tile_w > DGFX_REMOTE_MAX_TILE || dgfx_config.tile_h > DGFX_REMOTE_MAX_TILE
+        || (size_t)dgfx_config.tonemap >= SARRLEN (_tonemap_strings) || name_len > PATH_MAX)
     {
-        lua_gc (dgfx_ctx.workers[i].L, LUA_GCSTOP, 1);
+        fprintf (stderr, "Rejected connection: invalid parameters\n");
+        return false;
+    }
 
-        if (!dgfx_worker_start_work (&dgfx_ctx.workers[i], cur_t))
+    // "@<path>" makes lua report errors as coming from the coordinator's file
+    dgfx_ctx.script_name = malloc (name_len + 2);
+    char *script = malloc (script_len ? script_len : 1);
+    if (!dgfx_ctx.script_name || !script)
+        goto dgfx_serve_conn_oopsie;
+
+    dgfx_ctx.script_name[0] = '@';
+    dgfx_ctx.script_name[name_len + 1] = 0;
+    if (!dgfx_recv_all (sock, dgfx_ctx.script_name + 1, name_len) || !dgfx_recv_all (sock, script, script_len))
+        goto dgfx_serve_conn_oopsie;
+
+    dgfx_ctx.script = script;
+    dgfx_ctx.script_len = script_len;
+
+    if (posix_memalign ((void **)&w, DGFX_CACHE_LINE, sizeof (struct dgfx_worker)) != 0)
+        goto dgfx_serve_conn_oopsie;
+    memset (w, 0, sizeof (*w));
+    w->id = ntohl (hello.id);
+    w->cpu = -1;
+    w->sock = -1;
+
+    size_t tile_size = (size_t)dgfx_config.tile_w * dgfx_config.tile_h * 4;
+    reply = malloc (sizeof (uint32_t) + tile_size);
+
+    bool ready = reply && dgfx_worker_lua_init (w);
+    if (reply && !ready)
+        fprintf (stderr, "%s\n", w->startup_error);
+    if (ready && w->setup_floats)
+        ready = dgfx_setup_cache_init (w->setup_floats);
+
+    uint32_t status = htonl (ready ? 0 : 1);
+    if (!dgfx_send_all (sock, &status, sizeof (status)) || status != 0)
+        goto dgfx_serve_conn_oopsie;
+
+    printf ("Worker %zu ready: %s, %zux%zu\n", w->id, dgfx_ctx.script_name + 1, dgfx_config.w, dgfx_config.h);
+    fflush (stdout);
+
+    struct dgfx_remote_request req;
+    while (dgfx_recv_all (sock, &req, sizeof (req)))
+    {
+        uint64_t bits = (uint64_t)ntohl (req.t_hi) << 32 | ntohl (req.t_lo);
+        double t;
+        memcpy (&t, &bits, sizeof (t));
+
+        struct dgfx_tile tile = { .x = ntohl (req.x), .y = ntohl (req.y), .w = ntohl (req.w), .h = ntohl (req.h) };
+        // no sums: x + w wraps around for x near UINT32_MAX. a tile off the grid would get another tile's
+        // setup() block, dgfx_tile_index only looks at the origin
+        if (tile.x >= dgfx_config.w || tile.w == 0 || tile.w > dgfx_config.w - tile.x || tile.w > dgfx_config.tile_w
+            || tile.y >= dgfx_config.h || tile.h == 0 || tile.h > dgfx_config.h - tile.y || tile.h > dgfx_config.tile_h
+            || tile.x % dgfx_config.tile_w != 0 || tile.y % dgfx_config.tile_h != 0)
         {
-            fprintf (stderr, "Failed to start work for worker %u\n", i);
-            return false;
+            fprintf (stderr, "Rejected request for tile at %u,%u\n", tile.x, tile.y);
+            goto dgfx_serve_conn_oopsie;
         }
 
-        lua_gc (dgfx_ctx.workers[i].L, LUA_GCRESTART, 1);
+        // status word and pixels go out in one send
+        bool shaded = dgfx_worker_shade_tile (w, &tile, t, reply + sizeof (uint32_t), (size_t)tile.w * 4);
+        status = htonl (shaded ? 0 : 1);
+        memcpy (reply, &status, sizeof (status));
+
+        if (!dgfx_send_all (sock, reply, sizeof (uint32_t) + (shaded ? (size_t)tile.w * tile.h * 4 : 0)))
+            goto dgfx_serve_conn_oopsie;
     }
 
-    return true;
+    ok = true; // coordinator hung up
+
+dgfx_serve_conn_oopsie:
+    if (w && w->L)
+        lua_close (w->L);
+    if (w)
+        free (w->hdr_tile);
+    free (w);
+    free (reply);
+    free (script);
+    free (dgfx_ctx.script_name);
+    dgfx_setup_cache_deinit ();
+    dgfx_ctx.script = NULL;
+    dgfx_ctx.script_name = NULL;
+    return ok;
 }
 
+// --serve: every coordinator connection gets a forked process with its own lua state. runs until killed.
 bool
-dgfx_frame_wait (void)
+dgfx_serve (const char *addr)
 {
-    for (uint8_t i = 0; i < dgfx_config.worker_n; ++i)
+    int fd = dgfx_socket_open (addr, true);
+    if (fd < 0)
+        return false;
+
+    signal (SIGCHLD, SIG_IGN); // connection processes are never waited for
+
+    printf ("Serving on %s\n", addr);
+
+    while (true)
     {
-        if (!dgfx_worker_wait_completion (&dgfx_ctx.workers[i]))
+        int conn = accept4 (fd, NULL, NULL, SOCK_CLOEXEC);
+        if (conn < 0)
         {
-            fprintf (stderr, "Worker %u failed to complete work\n", i);
-            return false;
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            perror ("accept");
+            break;
+        }
+
+        int one = 1;
+        setsockopt (conn, IPPROTO_TCP, TCP_NODELAY, &one, sizeof (one));
+
+        fflush (NULL);
+        pid_t pid = fork ();
+        if (pid == 0) // child
+        {
+            close (fd);
+            signal (SIGCHLD, SIG_DFL);
+            bool ok = dgfx_serve_conn (conn);
+            close (conn);
+            fflush (NULL);
+            _exit (ok ? 0 : 1);
         }
+
+        if (pid < 0)
+            perror ("fork");
+        close (conn);
     }
-    return true;
-}
 
-bool
-dgfx_doframe (double cur_t)
-{
-    if (!dgfx_frame_begin (cur_t))
-        return false;
-    return dgfx_frame_wait ();
+    close (fd);
+    return false;
 }
 
 void
@@ -468,6 +4406,7 @@ dgfx_sdl_loop (void)
     }
 
     bool running = true;
+    bool still_shown = false;
     uint32_t frame_count = 0;
     uint32_t last_fps_time = SDL_GetTicks ();
     float fps = 0.0f;
@@ -505,8 +4444,11 @@ dgfx_sdl_loop (void)
 
             if (font)
             {
-                char fps_text[32];
-                snprintf (fps_text, sizeof (fps_text), "FPS: %.1f", fps);
+                double gc_ms, heap_mb;
+                dgfx_gc_stats (&gc_ms, &heap_mb);
+
+                char fps_text[96];
+                snprintf (fps_text, sizeof (fps_text), "FPS: %.1f  GC: %.2f ms  heap: %.1f MB", fps, gc_ms, heap_mb);
 
                 SDL_Color bright_color = { 255, 255, 0, 255 };
                 SDL_Surface *fps_surface = TTF_RenderText_Solid (font, fps_text, 0, bright_color);
@@ -518,18 +4460,23 @@ dgfx_sdl_loop (void)
             }
         }
 
-        void *locked_ptr = NULL;
-        int row_stride = 0;
-        if (!SDL_LockTexture (texture, NULL, &locked_ptr, &row_stride))
+        // a still picture stays in the texture, it is only shaded and uploaded once
+        if (!still_shown)
         {
-            fprintf (stderr, "SDL_LockTexture failed: %s\n", SDL_GetError ());
-            break;
-        }
+            void *locked_ptr = NULL;
+            int row_stride = 0;
+            if (!SDL_LockTexture (texture, NULL, &locked_ptr, &row_stride))
+            {
+                fprintf (stderr, "SDL_LockTexture failed: %s\n", SDL_GetError ());
+                break;
+            }
 
-        dgfx_pixels_set (locked_ptr);
-        dgfx_doframe (t);
+            dgfx_pixels_set (locked_ptr, row_stride);
+            still_shown = dgfx_doframe (t) && dgfx_ctx.still != NULL;
 
-        SDL_UnlockTexture (texture);
+            SDL_UnlockTexture (texture); // the locked pixels are gone, the next lock may hand out anything
+            dgfx_pixels_forget (locked_ptr);
+        }
 
         SDL_RenderClear (renderer);
         if (!SDL_RenderTexture (renderer, texture, NULL, NULL))
@@ -569,14 +4516,15 @@ dgfx_sdl_loop (void)
     SDL_Quit ();
 }
 
-void
+// false if a frame failed to render, or to reach ffmpeg, or ffmpeg failed to encode it
+bool
 dgfx_ffmpeg_render (void)
 {
     int pipefd[2];
     if (pipe (pipefd) < 0)
     {
         perror ("pipe");
-        return;
+        return false;
     }
 
     pid_t pid = fork ();
@@ -585,7 +4533,7 @@ dgfx_ffmpeg_render (void)
         perror ("fork");
         close (pipefd[0]);
         close (pipefd[1]);
-        return;
+        return false;
     }
 
     if (pid == 0) // child
@@ -611,38 +4559,73 @@ dgfx_ffmpeg_render (void)
     {
         close (pipefd[0]);
 
-        uint32_t *pixels = malloc (dgfx_config.h * dgfx_config.w * sizeof (uint32_t));
-        if (!pixels)
+        // ffmpeg exiting early must fail the writer's write, not kill dgfx
+        signal (SIGPIPE, SIG_IGN);
+
+        // frame parallel mode keeps one frame in flight per worker on top of the queue
+        size_t depth = dgfx_config.queue_depth;
+        if (dgfx_config.parallel == PARALLEL_FRAMES)
+            depth += dgfx_ctx.sync->active_n;
+
+        struct dgfx_frame_ring ring;
+        size_t frame_size = dgfx_config.h * dgfx_config.w * sizeof (uint32_t);
+        if (!dgfx_frame_ring_init (&ring, pipefd[1], depth, frame_size))
         {
-            perror ("malloc");
-            return;
+            close (pipefd[1]);
+            waitpid (pid, NULL, 0);
+            return false;
         }
-        dgfx_pixels_set ((uint8_t *)pixels);
 
-        for (size_t frame = 0; frame < dgfx_config.frame_count; frame++)
+        for (size_t slot = 0; slot < ring.depth; ++slot)
         {
-            double cur_t = ((double)frame / dgfx_config.fps);
+            dgfx_pixels_set (ring.frames + slot * frame_size, dgfx_config.w * sizeof (uint32_t));
+            dgfx_pixels_first_touch ();
+        }
 
-            if (!dgfx_doframe (cur_t))
+        // a still picture is shaded once and copied, no need for workers to take whole frames
+        bool frames = dgfx_config.parallel == PARALLEL_FRAMES && dgfx_ctx.depends & DEPENDS_T;
+        bool ok = true;
+        if (frames)
+        {
+            ok = dgfx_render_frames (&ring, dgfx_config.frame_count); // workers report the frame that failed
+        }
+        else
+        {
+            for (size_t frame = 0; frame < dgfx_config.frame_count; frame++)
             {
-                fprintf (stderr, "Frame %lu generation failed\n", frame);
-                break;
-            }
+                double cur_t = ((double)frame / dgfx_config.fps);
 
-            size_t bytes_to_write = dgfx_config.h * dgfx_config.w * sizeof (uint32_t);
-            if (write (pipefd[1], pixels, bytes_to_write) != (long)bytes_to_write)
-            {
-                perror ("write to pipe");
-                break;
+                uint8_t *pixels = dgfx_frame_ring_acquire (&ring, frame);
+                if (!pixels)
+                    break;
+                dgfx_pixels_set (pixels, dgfx_config.w * sizeof (uint32_t));
+
+                if (!dgfx_doframe (cur_t))
+                {
+                    fprintf (stderr, "Frame %lu generation failed\n", frame);
+                    ok = false;
+                    break;
+                }
+
+                dgfx_frame_ring_submit (&ring, frame);
             }
         }
 
+        for (size_t slot = 0; slot < ring.depth; ++slot)
+            dgfx_pixels_forget (ring.frames + slot * frame_size);
+
+        // the writer reports frames that never made it into the pipe
+        if (!dgfx_frame_ring_deinit (&ring))
+            ok = false;
         close (pipefd[1]);
-        free (pixels);
 
         int status;
-        waitpid (pid, &status, 0);
-        return;
+        if (waitpid (pid, &status, 0) < 0 || !WIFEXITED (status) || WEXITSTATUS (status) != 0)
+        {
+            fprintf (stderr, "ffmpeg failed to encode %s\n", dgfx_config.output_path);
+            ok = false;
+        }
+        return ok;
     }
 
     UNREACHABLE;
@@ -659,6 +4642,26 @@ enum
     ARG_JOBS,
     ARG_FPS,
     ARG_FRAME_COUNT,
+    ARG_TILE,
+    ARG_QUEUE_DEPTH,
+    ARG_AFFINITY,
+    ARG_BALANCE,
+    ARG_PARALLEL,
+    ARG_BACKEND,
+    ARG_REMOTE,
+    ARG_SERVE,
+    ARG_SERVE_PUBLIC,
+    ARG_WRITE_PATH,
+    ARG_HDR,
+    ARG_EXPOSURE,
+    ARG_TONEMAP,
+    ARG_SCRIPT_CACHE,
+    ARG_STARTUP_TIMES,
+    ARG_GC,
+    ARG_JIT_OPT,
+    ARG_WARMUP,
+    ARG_AOT,
+    ARG_TRACE,
 };
 
 const ko_longopt_t longopts[] = { { "help", ko_no_argument, ARG_HELP },
@@ -670,6 +4673,26 @@ const ko_longopt_t longopts[] = { { "help", ko_no_argument, ARG_HELP },
                                   { "heigth", ko_required_argument, ARG_HEIGHT },
                                   { "fps", ko_required_argument, ARG_FPS },
                                   { "frame-count", ko_required_argument, ARG_FRAME_COUNT },
+                                  { "tile", ko_required_argument, ARG_TILE },
+                                  { "queue-depth", ko_required_argument, ARG_QUEUE_DEPTH },
+                                  { "affinity", ko_required_argument, ARG_AFFINITY },
+                                  { "balance", ko_required_argument, ARG_BALANCE },
+                                  { "parallel", ko_required_argument, ARG_PARALLEL },
+                                  { "backend", ko_required_argument, ARG_BACKEND },
+                                  { "remote", ko_required_argument, ARG_REMOTE },
+                                  { "serve", ko_required_argument, ARG_SERVE },
+                                  { "serve-public", ko_no_argument, ARG_SERVE_PUBLIC },
+                                  { "write-path", ko_required_argument, ARG_WRITE_PATH },
+                                  { "hdr", ko_no_argument, ARG_HDR },
+                                  { "exposure", ko_required_argument, ARG_EXPOSURE },
+                                  { "tonemap", ko_required_argument, ARG_TONEMAP },
+                                  { "script-cache", ko_required_argument, ARG_SCRIPT_CACHE },
+                                  { "startup-times", ko_no_argument, ARG_STARTUP_TIMES },
+                                  { "gc", ko_required_argument, ARG_GC },
+                                  { "jit-opt", ko_required_argument, ARG_JIT_OPT },
+                                  { "warmup", ko_required_argument, ARG_WARMUP },
+                                  { "aot", ko_no_argument, ARG_AOT },
+                                  { "trace", ko_no_argument, ARG_TRACE },
                                   { NULL, 0, 0 } };
 
 void
@@ -678,24 +4701,94 @@ usage (const char *progname)
     printf ("Usage: %s [FLAGS] [ARGS]\n", progname);
     printf ("FLAGS:\n");
     printf ("\t-h, --help   - display this message.\n");
+    printf ("\t--hdr        - scripts return unclamped colors, clamped and tone mapped in C. implied by a .hdr\n");
+    printf ("\t               output in single mode, which keeps the float values.\n");
+    printf ("\t--startup-times - print how long every job took to set up its lua state.\n");
+    printf ("\t--aot        - translate the script to C and shade with the compiled code. scripts using more\n");
+    printf ("\t               than numbers, math.* and their own functions keep running on luajit.\n");
+    printf ("\t--trace      - record rgb's arithmetic once and evaluate it in C, a tile row at a time. scripts\n");
+    printf ("\t               whose control flow depends on the pixel keep running on luajit.\n");
+    printf ("\t--serve-public - let --serve listen on addresses other than loopback. there is no authentication:\n");
+    printf ("\t               anyone who can reach the port runs any lua they like on this host.\n");
     printf ("ARGS:\n");
     printf ("\t-W, --width   <integer> - specify output image width.                     DEFAULT: %u\n",
             DGFX_RESOLUTION_W_DEFUALT);
     printf ("\t-H, --height  <integer> - specify output image height.                    DEFAULT: %u\n",
             DGFX_RESOLUTION_H_DEFAULT);
-    printf ("\t-i, --input   <path>    - specify input lua file path.\n");
+    printf ("\t-i, --input   <path>    - specify input lua file path, or a .so plugin (see dgfx_plugin.h).\n");
     printf ("\t-o, --output  <path>    - specify output file path.                       DEFAULT: "
             "\"" DGFX_OUTPUT_PATH_DEFAULT "\"\n");
     printf ("\t-j, --jobs    <integer> - specify number of threads to use for rendering. DEFAULT: 1\n");
+    printf ("\t                          \"auto\" picks it by rendering calibration frames.\n");
     printf ("\t-m, --mode    <MODE>    - specify output mode.                            DEFAULT: %s\n",
             _mode_strings[0]);
     printf ("\t--fps         <integer> - specify fps limit for applicable modes.         DEFAULT: 60\n");
     printf ("\t--frame-count <integer> - specify frame count for render mode.            DEFAULT: 1800\n");
+    printf ("\t--tile        <W>x<H>   - specify size of work unit handed out to threads. DEFAULT: %ux%u\n",
+            DGFX_TILE_W_DEFAULT, DGFX_TILE_H_DEFAULT);
+    printf ("\t--queue-depth <integer> - specify frames buffered ahead of ffmpeg.       DEFAULT: %u\n",
+            DGFX_QUEUE_DEPTH_DEFAULT);
+    printf ("\t--affinity    <POLICY>  - specify how threads are pinned to cpus.           DEFAULT: %s\n",
+            _affinity_strings[0]);
+    printf ("\t--balance     <BALANCE> - specify how tiles are distributed between threads. DEFAULT: %s\n",
+            _balance_strings[BALANCE_ADAPTIVE]);
+    printf ("\t--parallel    <SPLIT>   - specify how render mode splits work.              DEFAULT: %s\n",
+            _parallel_strings[0]);
+    printf ("\t--backend     <BACKEND> - specify what the jobs run in.                    DEFAULT: %s\n",
+            _backend_strings[0]);
+    printf ("\t--write-path  <WRITE>   - specify how lua hands pixels over.               DEFAULT: %s\n",
+            _write_path_strings[0]);
+    printf ("\t--gc          <GC>      - specify when lua collects garbage.                DEFAULT: %s\n",
+            _gc_strings[0]);
+    printf ("\t--jit-opt     <OPTS>    - specify jit.opt.start() arguments, comma separated. DEFAULT: \"%s\"\n",
+            DGFX_JIT_OPT_DEFAULT);
+    printf ("\t                          e.g. hotloop=8,maxmcode=8192,-loop. applied on top of the default.\n");
+    printf ("\t--warmup      <integer> - specify frames rendered before timing or output.   DEFAULT: %u\n",
+            DGFX_WARMUP_DEFAULT);
+    printf ("\t--exposure    <float>   - specify exposure in stops for --hdr.              DEFAULT: 0\n");
+    printf ("\t--tonemap     <TONEMAP> - specify tone mapping curve for --hdr.            DEFAULT: %s\n",
+            _tonemap_strings[0]);
+    printf ("\t--remote      <ADDRESS> - add a remote job served by \"dgfx --serve\". may be repeated.\n");
+    printf ("\t--serve       <ADDRESS> - run as a remote job server instead of rendering.\n");
+    printf ("\t--script-cache <path>  - specify directory to keep compiled scripts in between runs.\n");
+    printf ("ADDRESS:\n");
+    printf ("\t<host>:<port> - TCP, e.g. 10.0.0.2:7070, [::1]:7070 or :7070 (--serve only: 127.0.0.1,\n");
+    printf ("\t                or every interface with --serve-public).\n");
+    printf ("\tunix:<path>   - UNIX socket.\n");
+    printf ("POLICY:\n");
+    printf ("\tnone     - threads are not pinned.\n");
+    printf ("\tcompact  - threads fill one NUMA node and core (SMT siblings included) before the next.\n");
+    printf ("\tscatter  - threads are spread over NUMA nodes first, then physical cores.\n");
+    printf ("\t<list>   - explicit cpu list, e.g. 0-7,64-71. thread N is pinned to N-th cpu (wrapping).\n");
+    printf ("\tthread 0 is the main thread, it's never pinned: everything it starts would share its cpu.\n");
+    printf ("BALANCE:\n");
+    printf ("\tstatic   - every thread starts on an equal, contiguous band of tiles.\n");
+    printf ("\tadaptive - tiles are redistributed by their cost in the previous frame, when that\n");
+    printf ("\t           evens threads out noticeably. tiles stay on their NUMA node.\n");
+    printf ("SPLIT:\n");
+    printf ("\ttiles    - threads share every frame, frames are rendered one after another.\n");
+    printf ("\tframes   - every thread renders whole frames on its own, keeping one frame buffer per thread.\n");
+    printf ("WRITE:\n");
+    printf ("\tffi      - lua stores bytes straight into the framebuffer through an ffi pointer.\n");
+    printf ("\tstring   - lua returns every tile as a string, which is copied into the framebuffer.\n");
+    printf ("TONEMAP:\n");
+    printf ("\tnone     - values are clamped to [0, 1].\n");
+    printf ("\treinhard - x / (1 + x).\n");
+    printf ("\taces     - filmic curve (Narkowicz's ACES fit).\n");
+    printf ("GC:\n");
+    printf ("\tidle     - not while shading. jobs collect after their share of a frame, until the next one.\n");
+    printf ("\tstep     - not while shading. jobs run one bounded collector step after every frame.\n");
+    printf ("\tlua      - whenever lua decides to, which can pause a job in the middle of a tile.\n");
+    printf ("BACKEND:\n");
+    printf ("\tthreads   - jobs are threads of one process.\n");
+    printf ("\tprocesses - jobs are forked processes rendering to shared memory. a crashing job only fails\n");
+    printf ("\t            the frame it was working on.\n");
     printf ("MODE:\n");
     printf ("\tsingle   - program outputs single frame, with t=0.0, to bitmap.\n");
     printf ("\trender   - program calls on ffmpeg to render frames as video.\n");
     printf (
         "\trealtime - program displays pixels in SDL3 window, passing time from window creation in seconds to t.\n");
+    printf ("\tbench    - program renders frame-count frames without output and prints frame times.\n");
 }
 
 int
@@ -706,6 +4799,7 @@ main (int argc, char *argv[])
     const char *optstr = "hi:o:W:H:j:m:";
 
     char *endptr = NULL;
+    bool jobs_auto = false;
 
     while ((c = ketopt (&s, argc, argv, 1, optstr, longopts)) != -1)
     {
@@ -762,6 +4856,12 @@ main (int argc, char *argv[])
             break;
         case 'j':
         case ARG_JOBS:
+            if (strcasecmp (s.arg, "auto") == 0)
+            {
+                jobs_auto = true;
+                break;
+            }
+
             endptr = NULL;
             dgfx_config.worker_n = strtoul (s.arg, &endptr, 10);
             if (endptr != s.arg + strlen (s.arg) || *endptr != 0 || dgfx_config.worker_n == 0)
@@ -769,6 +4869,7 @@ main (int argc, char *argv[])
                 fprintf (stderr, "Invalid job count\n");
                 return 1;
             }
+            jobs_auto = false;
             break;
         case 'o':
         case ARG_OUTPUT:
@@ -792,6 +4893,218 @@ main (int argc, char *argv[])
                 return 1;
             }
             break;
+        case ARG_TILE:
+            endptr = NULL;
+            dgfx_config.tile_w = strtoul (s.arg, &endptr, 10);
+            if (*endptr != 'x' || dgfx_config.tile_w == 0)
+            {
+                fprintf (stderr, "Invalid tile size\n");
+                return 1;
+            }
+            dgfx_config.tile_h = strtoul (endptr + 1, &endptr, 10);
+            if (*endptr != 0 || dgfx_config.tile_h == 0)
+            {
+                fprintf (stderr, "Invalid tile size\n");
+                return 1;
+            }
+            break;
+        case ARG_QUEUE_DEPTH:
+            endptr = NULL;
+            dgfx_config.queue_depth = strtoul (s.arg, &endptr, 10);
+            if (endptr != s.arg + strlen (s.arg) || *endptr != 0 || dgfx_config.queue_depth == 0)
+            {
+                fprintf (stderr, "Invalid queue depth\n");
+                return 1;
+            }
+            break;
+        case ARG_AFFINITY:
+            bool affinity_found = false;
+
+            for (int i = 0; i < (int)SARRLEN (_affinity_strings); ++i)
+            {
+                if (strcasecmp (s.arg, _affinity_strings[i]) == 0)
+                {
+                    dgfx_config.affinity = i;
+                    affinity_found = true;
+                    break;
+                }
+            }
+
+            if (!affinity_found)
+            {
+                int *cpus = NULL;
+                bool valid = dgfx_cpulist_parse (s.arg, &cpus) && arrlenu (cpus) > 0;
+                arrfree (cpus);
+
+                if (!valid)
+                {
+                    fprintf (stderr, "Invalid affinity: %s\n", s.arg);
+                    return 1;
+                }
+
+                dgfx_config.affinity = AFFINITY_LIST;
+                dgfx_config.affinity_list = s.arg;
+            }
+            break;
+        case ARG_BALANCE:
+            bool balance_found = false;
+
+            for (int i = 0; i < (int)SARRLEN (_balance_strings); ++i)
+            {
+                if (strcasecmp (s.arg, _balance_strings[i]) == 0)
+                {
+                    dgfx_config.balance = i;
+                    balance_found = true;
+                    break;
+                }
+            }
+
+            if (!balance_found)
+            {
+                fprintf (stderr, "Invalid balance: %s\n", s.arg);
+                return 1;
+            }
+            break;
+        case ARG_PARALLEL:
+            bool parallel_found = false;
+
+            for (int i = 0; i < (int)SARRLEN (_parallel_strings); ++i)
+            {
+                if (strcasecmp (s.arg, _parallel_strings[i]) == 0)
+                {
+                    dgfx_config.parallel = i;
+                    parallel_found = true;
+                    break;
+                }
+            }
+
+            if (!parallel_found)
+            {
+                fprintf (stderr, "Invalid parallel split: %s\n", s.arg);
+                return 1;
+            }
+            break;
+        case ARG_BACKEND:
+            bool backend_found = false;
+
+            for (int i = 0; i < (int)SARRLEN (_backend_strings); ++i)
+            {
+                if (strcasecmp (s.arg, _backend_strings[i]) == 0)
+                {
+                    dgfx_config.backend = i;
+                    backend_found = true;
+                    break;
+                }
+            }
+
+            if (!backend_found)
+            {
+                fprintf (stderr, "Invalid backend: %s\n", s.arg);
+                return 1;
+            }
+            break;
+        case ARG_REMOTE:
+            arrput (dgfx_config.remotes, s.arg);
+            break;
+        case ARG_HDR:
+            dgfx_config.hdr = true;
+            break;
+        case ARG_EXPOSURE:
+            endptr = NULL;
+            dgfx_config.exposure = strtof (s.arg, &endptr);
+            if (endptr == s.arg || *endptr != 0 || !isfinite (dgfx_config.exposure))
+            {
+                fprintf (stderr, "Invalid exposure\n");
+                return 1;
+            }
+            break;
+        case ARG_TONEMAP:
+            bool tonemap_found = false;
+
+            for (int i = 0; i < (int)SARRLEN (_tonemap_strings); ++i)
+            {
+                if (strcasecmp (s.arg, _tonemap_strings[i]) == 0)
+                {
+                    dgfx_config.tonemap = i;
+                    tonemap_found = true;
+                    break;
+                }
+            }
+
+            if (!tonemap_found)
+            {
+                fprintf (stderr, "Invalid tonemap: %s\n", s.arg);
+                return 1;
+            }
+            break;
+        case ARG_WRITE_PATH:
+            bool write_path_found = false;
+
+            for (int i = 0; i < (int)SARRLEN (_write_path_strings); ++i)
+            {
+                if (strcasecmp (s.arg, _write_path_strings[i]) == 0)
+                {
+                    dgfx_config.write_path = i;
+                    write_path_found = true;
+                    break;
+                }
+            }
+
+            if (!write_path_found)
+            {
+                fprintf (stderr, "Invalid write path: %s\n", s.arg);
+                return 1;
+            }
+            break;
+        case ARG_SERVE:
+            dgfx_config.serve_addr = s.arg;
+            break;
+        case ARG_SERVE_PUBLIC:
+            dgfx_config.serve_public = true;
+            break;
+        case ARG_SCRIPT_CACHE:
+            dgfx_config.script_cache = s.arg;
+            break;
+        case ARG_STARTUP_TIMES:
+            dgfx_config.startup_times = true;
+            break;
+        case ARG_AOT:
+            dgfx_config.aot = true;
+            break;
+        case ARG_TRACE:
+            dgfx_config.trace = true;
+            break;
+        case ARG_JIT_OPT:
+            dgfx_config.jit_opt = s.arg;
+            break;
+        case ARG_WARMUP:
+            endptr = NULL;
+            dgfx_config.warmup = strtoul (s.arg, &endptr, 10);
+            if (endptr == s.arg || *endptr != 0)
+            {
+                fprintf (stderr, "Invalid warmup frame count\n");
+                return 1;
+            }
+            break;
+        case ARG_GC:
+            bool gc_found = false;
+
+            for (int i = 0; i < (int)SARRLEN (_gc_strings); ++i)
+            {
+                if (strcasecmp (s.arg, _gc_strings[i]) == 0)
+                {
+                    dgfx_config.gc = i;
+                    gc_found = true;
+                    break;
+                }
+            }
+
+            if (!gc_found)
+            {
+                fprintf (stderr, "Invalid gc mode: %s\n", s.arg);
+                return 1;
+            }
+            break;
         case '?':
             fprintf (stderr, "Unknown option: %s\n", argv[s.ind]);
             return 1;
@@ -801,15 +5114,89 @@ main (int argc, char *argv[])
         }
     }
 
+    if (dgfx_config.serve_addr)
+        return dgfx_serve (dgfx_config.serve_addr) ? 0 : 1;
+
     if (!dgfx_config.input_path)
     {
         fprintf (stderr, "No input file provided. Exiting\n");
         return 0;
     }
 
+    // servers only run lua, there is no way to hand them a shared object
+    if (dgfx_plugin_path (dgfx_config.input_path) && arrlenu (dgfx_config.remotes))
+    {
+        fprintf (stderr, "\"remote\" jobs can't run plugins. Exiting\n");
+        return 1;
+    }
+
+    if (dgfx_config.aot && arrlenu (dgfx_config.remotes))
+    {
+        fprintf (stderr, "Warning: \"aot\" argument does not apply to \"remote\" jobs. It's ignored.\n");
+        dgfx_config.aot = false;
+    }
+
+    if (dgfx_config.parallel == PARALLEL_FRAMES && dgfx_config.mode != MODE_RENDER)
+    {
+        fprintf (stderr, "Warning: \"parallel\" argument only applies to render mode. It's ignored.\n");
+        dgfx_config.parallel = PARALLEL_TILES;
+    }
+
+    // frame ring slots are plain memory of the main process
+    if (dgfx_config.parallel == PARALLEL_FRAMES && dgfx_config.backend == BACKEND_PROCESSES)
+    {
+        fprintf (stderr, "Warning: \"parallel frames\" is not supported by the processes backend. Using tiles.\n");
+        dgfx_config.parallel = PARALLEL_TILES;
+    }
+
+    const char *ext = strrchr (dgfx_config.output_path, '.');
+    if (dgfx_config.mode == MODE_SINGLE && ext && strcasecmp (ext, ".hdr") == 0)
+        dgfx_config.hdr = dgfx_config.hdr_output = true;
+
+    // servers send tiles back as 8 bit pixels, theirs would be black in the float frame
+    if (dgfx_config.hdr_output && arrlenu (dgfx_config.remotes))
+    {
+        fprintf (stderr, "\"remote\" jobs can't render .hdr output. Exiting\n");
+        return 1;
+    }
+
+    if (!dgfx_config.hdr && (dgfx_config.exposure != 0.0f || dgfx_config.tonemap != TONEMAP_NONE))
+    {
+        fprintf (stderr, "Warning: \"exposure\" and \"tonemap\" arguments only apply with --hdr. They're ignored.\n");
+        dgfx_config.exposure = 0.0f; // plugin tiles are quantized either way
+        dgfx_config.tonemap = TONEMAP_NONE;
+    }
+
+    if (jobs_auto)
+        dgfx_config.worker_n = dgfx_cpu_budget ();
+
     if (!dgfx_init (NULL))
         return 1;
 
+    if (jobs_auto)
+    {
+        uint32_t *scratch = malloc (dgfx_config.h * dgfx_config.w * sizeof (uint32_t));
+        if (!scratch)
+        {
+            perror ("malloc");
+            return 1;
+        }
+        dgfx_pixels_set ((uint8_t *)scratch, dgfx_config.w * sizeof (uint32_t));
+
+        dgfx_config.worker_n = dgfx_calibrate_jobs ();
+
+        dgfx_pixels_forget (scratch);
+        free (scratch);
+    }
+
+    // single mode renders one frame either way, warming up would only delay it
+    if (dgfx_config.mode != MODE_SINGLE && dgfx_config.warmup > 0 && !dgfx_warmup ())
+    {
+        fprintf (stderr, "frame generation failed\n");
+        dgfx_deinit ();
+        return 1;
+    }
+
     switch (dgfx_config.mode)
     {
     case MODE_SINGLE: {
@@ -819,7 +5206,7 @@ main (int argc, char *argv[])
             perror ("malloc");
             return 1;
         }
-        dgfx_pixels_set ((uint8_t *)pixels);
+        dgfx_pixels_set ((uint8_t *)pixels, dgfx_config.w * sizeof (uint32_t));
 
         if (!dgfx_doframe (0))
         {
@@ -829,7 +5216,10 @@ main (int argc, char *argv[])
             return 1;
         }
 
-        if (!stbi_write_bmp (dgfx_config.output_path, dgfx_config.w, dgfx_config.h, 4, pixels))
+        bool written = dgfx_ctx.hdr_frame
+                           ? stbi_write_hdr (dgfx_config.output_path, dgfx_config.w, dgfx_config.h, 4, dgfx_ctx.hdr_frame)
+                           : stbi_write_bmp (dgfx_config.output_path, dgfx_config.w, dgfx_config.h, 4, pixels);
+        if (!written)
         {
             fprintf (stderr, "Failed to write image to %s\n", dgfx_config.output_path);
         }
@@ -848,7 +5238,20 @@ main (int argc, char *argv[])
     }
     break;
     case MODE_RENDER: {
-        dgfx_ffmpeg_render ();
+        if (!dgfx_ffmpeg_render ())
+        {
+            dgfx_deinit ();
+            return 1;
+        }
+    }
+    break;
+    case MODE_BENCH: {
+        if (!dgfx_bench ())
+        {
+            fprintf (stderr, "frame generation failed\n");
+            dgfx_deinit ();
+            return 1;
+        }
     }
     break;
     default:
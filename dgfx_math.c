@@ -0,0 +1,871 @@
+// dgfx.math, see dgfx_math.h. the kernels are always inlined and their small loops fully unrolled, so each batch
+// function's avx2 and avx-512 builds get straight-line copies of them to vectorize rather than calls into the
+// baseline ones. the makefile builds this file with -fno-math-errno -fno-trapping-math, which floor and sqrt need
+// to vectorize; nothing here reads errno or the fp exception flags. conversions through pow, cbrt and cos stay
+// scalar calls into libm.
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "dgfx_math.h"
+
+#define DGFX_MATH_KERNEL static inline __attribute__ ((always_inline))
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define DGFX_MATH_BATCH __attribute__ ((target_clones ("default", "arch=x86-64-v3", "arch=x86-64-v4")))
+#else
+#define DGFX_MATH_BATCH
+#endif
+
+// lowbias32 by Chris Wellons, with the lattice point's coordinates folded in by odd multipliers
+DGFX_MATH_KERNEL uint32_t
+dgfx_math_hash (uint32_t x, uint32_t y, uint32_t z, uint32_t w)
+{
+    uint32_t h = x * 0x8da6b343u + y * 0xd8163841u + z * 0xcb1ab31fu + w * 0x165667b1u;
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    h *= 0x846ca68bu;
+    h ^= h >> 16;
+    return h;
+}
+
+// the lattice cell of a whole `v`, modulo 2^32 so far out coordinates wrap instead of overflowing. goes through
+// int32_t, avx2 has no wider conversion.
+DGFX_MATH_KERNEL uint32_t
+dgfx_math_cell (double v)
+{
+    v -= 4294967296.0 * floor (v * (1.0 / 4294967296.0));
+    return (uint32_t)(int32_t)(v - 2147483648.0) ^ 0x80000000u;
+}
+
+// 24 bits of a hash as a double in [0, 1)
+DGFX_MATH_KERNEL double
+dgfx_math_unit (uint32_t h)
+{
+    return (h >> 8) * (1.0 / 16777216.0);
+}
+
+DGFX_MATH_KERNEL double
+dgfx_math_fade (double t)
+{
+    return t * t * t * (t * (t * 6.0 - 15.0) + 10.0);
+}
+
+DGFX_MATH_KERNEL double
+dgfx_math_lerp (double a, double b, double t)
+{
+    return a + t * (b - a);
+}
+
+// gradients: the 8 neighbours of a square, the 12 edge midpoints of a cube and the 32 of a tesseract, dotted with
+// the offset from their corner
+DGFX_MATH_KERNEL double
+dgfx_math_grad2 (uint32_t h, double x, double y)
+{
+    double u = h & 4 ? y : x, v = h & 4 ? x : y;
+    return (h & 1 ? -u : u) + (h & 2 ? -v : v) * (h & 8 ? 1.0 : 0.0);
+}
+
+DGFX_MATH_KERNEL double
+dgfx_math_grad3 (uint32_t h, double x, double y, double z)
+{
+    h &= 15;
+    double u = h < 8 ? x : y;
+    double v = h < 4 ? y : h == 12 || h == 14 ? x : z;
+    return (h & 1 ? -u : u) + (h & 2 ? -v : v);
+}
+
+DGFX_MATH_KERNEL double
+dgfx_math_grad4 (uint32_t h, double x, double y, double z, double w)
+{
+    h &= 31;
+    double u = h < 24 ? x : y, v = h < 16 ? y : z, s = h < 8 ? z : w;
+    return (h & 1 ? -u : u) + (h & 2 ? -v : v) + (h & 4 ? -s : s);
+}
+
+DGFX_MATH_KERNEL double
+dgfx_math_perlin2_k (double x, double y)
+{
+    double fx = floor (x), fy = floor (y);
+    uint32_t i = dgfx_math_cell (fx), j = dgfx_math_cell (fy);
+    x -= fx;
+    y -= fy;
+
+    double u = dgfx_math_fade (x), v = dgfx_math_fade (y);
+    double n00 = dgfx_math_grad2 (dgfx_math_hash (i, j, 0, 0), x, y);
+    double n10 = dgfx_math_grad2 (dgfx_math_hash (i + 1, j, 0, 0), x - 1.0, y);
+    double n01 = dgfx_math_grad2 (dgfx_math_hash (i, j + 1, 0, 0), x, y - 1.0);
+    double n11 = dgfx_math_grad2 (dgfx_math_hash (i + 1, j + 1, 0, 0), x - 1.0, y - 1.0);
+    return dgfx_math_lerp (dgfx_math_lerp (n00, n10, u), dgfx_math_lerp (n01, n11, u), v);
+}
+
+DGFX_MATH_KERNEL double
+dgfx_math_perlin3_k (double x, double y, double z)
+{
+    double fx = floor (x), fy = floor (y), fz = floor (z);
+    uint32_t i = dgfx_math_cell (fx), j = dgfx_math_cell (fy), k = dgfx_math_cell (fz);
+    x -= fx;
+    y -= fy;
+    z -= fz;
+
+    double u = dgfx_math_fade (x), v = dgfx_math_fade (y), s = dgfx_math_fade (z);
+    double n[2][2];
+    #pragma GCC unroll 32
+    for (int b = 0; b < 2; ++b)
+        #pragma GCC unroll 32
+        for (int a = 0; a < 2; ++a)
+        {
+            double n0 = dgfx_math_grad3 (dgfx_math_hash (i, j + a, k + b, 0), x, y - a, z - b);
+            double n1 = dgfx_math_grad3 (dgfx_math_hash (i + 1, j + a, k + b, 0), x - 1.0, y - a, z - b);
+            n[b][a] = dgfx_math_lerp (n0, n1, u);
+        }
+    return dgfx_math_lerp (dgfx_math_lerp (n[0][0], n[0][1], v), dgfx_math_lerp (n[1][0], n[1][1], v), s);
+}
+
+DGFX_MATH_KERNEL double
+dgfx_math_perlin4_k (double x, double y, double z, double w)
+{
+    double fx = floor (x), fy = floor (y), fz = floor (z), fw = floor (w);
+    uint32_t i = dgfx_math_cell (fx), j = dgfx_math_cell (fy), k = dgfx_math_cell (fz), l = dgfx_math_cell (fw);
+    x -= fx;
+    y -= fy;
+    z -= fz;
+    w -= fw;
+
+    double u = dgfx_math_fade (x), v = dgfx_math_fade (y), s = dgfx_math_fade (z), r = dgfx_math_fade (w);
+    double n[2][2][2];
+    #pragma GCC unroll 32
+    for (int c = 0; c < 2; ++c)
+        #pragma GCC unroll 32
+        for (int b = 0; b < 2; ++b)
+            #pragma GCC unroll 32
+            for (int a = 0; a < 2; ++a)
+            {
+                double n0 = dgfx_math_grad4 (dgfx_math_hash (i, j + a, k + b, l + c), x, y - a, z - b, w - c);
+                double n1
+                    = dgfx_math_grad4 (dgfx_math_hash (i + 1, j + a, k + b, l + c), x - 1.0, y - a, z - b, w - c);
+                n[c][b][a] = dgfx_math_lerp (n0, n1, u);
+            }
+
+    double m[2];
+    #pragma GCC unroll 32
+    for (int c = 0; c < 2; ++c)
+        m[c] = dgfx_math_lerp (dgfx_math_lerp (n[c][0][0], n[c][0][1], v), dgfx_math_lerp (n[c][1][0], n[c][1][1], v),
+                               s);
+    // four dimensions reach a little past 1
+    return 0.87 * dgfx_math_lerp (m[0], m[1], r);
+}
+
+// simplex noise after Stefan Gustavson's "Simplex noise demystified", hashing the corners instead of looking
+// them up in a permutation table. the final factors scale it to about [-1, 1].
+DGFX_MATH_KERNEL double
+dgfx_math_simplex_corner (double r2, double t)
+{
+    t = r2 - t;
+    return t < 0.0 ? 0.0 : t * t * t * t;
+}
+
+DGFX_MATH_KERNEL double
+dgfx_math_simplex2_k (double x, double y)
+{
+    const double F2 = 0.36602540378443864676, G2 = 0.21132486540518711775;
+
+    double s = (x + y) * F2;
+    double fi = floor (x + s), fj = floor (y + s);
+    uint32_t i = dgfx_math_cell (fi), j = dgfx_math_cell (fj);
+    double t = (fi + fj) * G2;
+    double x0 = x - (fi - t), y0 = y - (fj - t);
+
+    int32_t i1 = x0 > y0, j1 = !i1;
+    double x1 = x0 - i1 + G2, y1 = y0 - j1 + G2;
+    double x2 = x0 - 1.0 + 2.0 * G2, y2 = y0 - 1.0 + 2.0 * G2;
+
+    double n = dgfx_math_simplex_corner (0.5, x0 * x0 + y0 * y0) * dgfx_math_grad2 (dgfx_math_hash (i, j, 0, 0), x0, y0)
+               + dgfx_math_simplex_corner (0.5, x1 * x1 + y1 * y1)
+                     * dgfx_math_grad2 (dgfx_math_hash (i + i1, j + j1, 0, 0), x1, y1)
+               + dgfx_math_simplex_corner (0.5, x2 * x2 + y2 * y2)
+                     * dgfx_math_grad2 (dgfx_math_hash (i + 1, j + 1, 0, 0), x2, y2);
+    return 70.0 * n;
+}
+
+DGFX_MATH_KERNEL double
+dgfx_math_simplex3_k (double x, double y, double z)
+{
+    const double F3 = 1.0 / 3.0, G3 = 1.0 / 6.0;
+
+    double s = (x + y + z) * F3;
+    double fi = floor (x + s), fj = floor (y + s), fk = floor (z + s);
+    uint32_t i = dgfx_math_cell (fi), j = dgfx_math_cell (fj), k = dgfx_math_cell (fk);
+    double t = (fi + fj + fk) * G3;
+    double x0 = x - (fi - t), y0 = y - (fj - t), z0 = z - (fk - t);
+
+    // the simplex the point is in, by the order of its offsets
+    int32_t xy = x0 >= y0, yz = y0 >= z0, xz = x0 >= z0;
+    int32_t i1 = xy && xz, j1 = !xy && yz, k1 = !xz && !yz;
+    int32_t i2 = xy || xz, j2 = !xy || yz, k2 = !(xz && yz);
+
+    double x1 = x0 - i1 + G3, y1 = y0 - j1 + G3, z1 = z0 - k1 + G3;
+    double x2 = x0 - i2 + 2.0 * G3, y2 = y0 - j2 + 2.0 * G3, z2 = z0 - k2 + 2.0 * G3;
+    double x3 = x0 - 1.0 + 3.0 * G3, y3 = y0 - 1.0 + 3.0 * G3, z3 = z0 - 1.0 + 3.0 * G3;
+
+    double n = dgfx_math_simplex_corner (0.6, x0 * x0 + y0 * y0 + z0 * z0)
+                   * dgfx_math_grad3 (dgfx_math_hash (i, j, k, 0), x0, y0, z0)
+               + dgfx_math_simplex_corner (0.6, x1 * x1 + y1 * y1 + z1 * z1)
+                     * dgfx_math_grad3 (dgfx_math_hash (i + i1, j + j1, k + k1, 0), x1, y1, z1)
+               + dgfx_math_simplex_corner (0.6, x2 * x2 + y2 * y2 + z2 * z2)
+                     * dgfx_math_grad3 (dgfx_math_hash (i + i2, j + j2, k + k2, 0), x2, y2, z2)
+               + dgfx_math_simplex_corner (0.6, x3 * x3 + y3 * y3 + z3 * z3)
+                     * dgfx_math_grad3 (dgfx_math_hash (i + 1, j + 1, k + 1, 0), x3, y3, z3);
+    return 32.0 * n;
+}
+
+DGFX_MATH_KERNEL double
+dgfx_math_simplex4_k (double x, double y, double z, double w)
+{
+    const double F4 = 0.30901699437494742410, G4 = 0.13819660112501051518;
+
+    double s = (x + y + z + w) * F4;
+    double fi = floor (x + s), fj = floor (y + s), fk = floor (z + s), fl = floor (w + s);
+    uint32_t i = dgfx_math_cell (fi), j = dgfx_math_cell (fj), k = dgfx_math_cell (fk), l = dgfx_math_cell (fl);
+    double t = (fi + fj + fk + fl) * G4;
+    double x0 = x - (fi - t), y0 = y - (fj - t), z0 = z - (fk - t), w0 = w - (fl - t);
+
+    // each offset's rank among the four picks the simplex: corner c steps along the axes ranked above 3 - c
+    int32_t rx = 0, ry = 0, rz = 0, rw = 0;
+    rx += x0 > y0, ry += x0 <= y0;
+    rx += x0 > z0, rz += x0 <= z0;
+    rx += x0 > w0, rw += x0 <= w0;
+    ry += y0 > z0, rz += y0 <= z0;
+    ry += y0 > w0, rw += y0 <= w0;
+    rz += z0 > w0, rw += z0 <= w0;
+
+    double n = dgfx_math_simplex_corner (0.6, x0 * x0 + y0 * y0 + z0 * z0 + w0 * w0)
+               * dgfx_math_grad4 (dgfx_math_hash (i, j, k, l), x0, y0, z0, w0);
+    #pragma GCC unroll 32
+    for (int32_t c = 1; c < 4; ++c)
+    {
+        int32_t ic = rx >= 4 - c, jc = ry >= 4 - c, kc = rz >= 4 - c, lc = rw >= 4 - c;
+        double xc = x0 - ic + c * G4, yc = y0 - jc + c * G4, zc = z0 - kc + c * G4, wc = w0 - lc + c * G4;
+        n += dgfx_math_simplex_corner (0.6, xc * xc + yc * yc + zc * zc + wc * wc)
+             * dgfx_math_grad4 (dgfx_math_hash (i + ic, j + jc, k + kc, l + lc), xc, yc, zc, wc);
+    }
+
+    double x4 = x0 - 1.0 + 4.0 * G4, y4 = y0 - 1.0 + 4.0 * G4, z4 = z0 - 1.0 + 4.0 * G4, w4 = w0 - 1.0 + 4.0 * G4;
+    n += dgfx_math_simplex_corner (0.6, x4 * x4 + y4 * y4 + z4 * z4 + w4 * w4)
+         * dgfx_math_grad4 (dgfx_math_hash (i + 1, j + 1, k + 1, l + 1), x4, y4, z4, w4);
+    return 27.0 * n;
+}
+
+// a random value in [-1, 1] at every lattice point, blended with the same fade as perlin noise
+DGFX_MATH_KERNEL double
+dgfx_math_value_k (uint32_t h)
+{
+    return dgfx_math_unit (h) * 2.0 - 1.0;
+}
+
+DGFX_MATH_KERNEL double
+dgfx_math_value2_k (double x, double y)
+{
+    double fx = floor (x), fy = floor (y);
+    uint32_t i = dgfx_math_cell (fx), j = dgfx_math_cell (fy);
+    double u = dgfx_math_fade (x - fx), v = dgfx_math_fade (y - fy);
+
+    double a = dgfx_math_lerp (dgfx_math_value_k (dgfx_math_hash (i, j, 0, 0)),
+                               dgfx_math_value_k (dgfx_math_hash (i + 1, j, 0, 0)), u);
+    double b = dgfx_math_lerp (dgfx_math_value_k (dgfx_math_hash (i, j + 1, 0, 0)),
+                               dgfx_math_value_k (dgfx_math_hash (i + 1, j + 1, 0, 0)), u);
+    return dgfx_math_lerp (a, b, v);
+}
+
+DGFX_MATH_KERNEL double
+dgfx_math_value3_k (double x, double y, double z)
+{
+    double fx = floor (x), fy = floor (y), fz = floor (z);
+    uint32_t i = dgfx_math_cell (fx), j = dgfx_math_cell (fy), k = dgfx_math_cell (fz);
+    double u = dgfx_math_fade (x - fx), v = dgfx_math_fade (y - fy), s = dgfx_math_fade (z - fz);
+
+    double n[2][2];
+    #pragma GCC unroll 32
+    for (int b = 0; b < 2; ++b)
+        #pragma GCC unroll 32
+        for (int a = 0; a < 2; ++a)
+            n[b][a] = dgfx_math_lerp (dgfx_math_value_k (dgfx_math_hash (i, j + a, k + b, 0)),
+                                      dgfx_math_value_k (dgfx_math_hash (i + 1, j + a, k + b, 0)), u);
+    return dgfx_math_lerp (dgfx_math_lerp (n[0][0], n[0][1], v), dgfx_math_lerp (n[1][0], n[1][1], v), s);
+}
+
+DGFX_MATH_KERNEL double
+dgfx_math_value4_k (double x, double y, double z, double w)
+{
+    double fx = floor (x), fy = floor (y), fz = floor (z), fw = floor (w);
+    uint32_t i = dgfx_math_cell (fx), j = dgfx_math_cell (fy), k = dgfx_math_cell (fz), l = dgfx_math_cell (fw);
+    double u = dgfx_math_fade (x - fx), v = dgfx_math_fade (y - fy), s = dgfx_math_fade (z - fz),
+           r = dgfx_math_fade (w - fw);
+
+    double m[2];
+    #pragma GCC unroll 32
+    for (int c = 0; c < 2; ++c)
+    {
+        double n[2][2];
+        #pragma GCC unroll 32
+        for (int b = 0; b < 2; ++b)
+            #pragma GCC unroll 32
+            for (int a = 0; a < 2; ++a)
+                n[b][a] = dgfx_math_lerp (dgfx_math_value_k (dgfx_math_hash (i, j + a, k + b, l + c)),
+                                          dgfx_math_value_k (dgfx_math_hash (i + 1, j + a, k + b, l + c)), u);
+        m[c] = dgfx_math_lerp (dgfx_math_lerp (n[0][0], n[0][1], v), dgfx_math_lerp (n[1][0], n[1][1], v), s);
+    }
+    return dgfx_math_lerp (m[0], m[1], r);
+}
+
+// cellular noise: the distance to the nearest of one random point per cell, in cells. 0 at the points, up to
+// about 1.2 between them.
+DGFX_MATH_KERNEL double
+dgfx_math_worley2_k (double x, double y)
+{
+    double fx = floor (x), fy = floor (y);
+    uint32_t i = dgfx_math_cell (fx), j = dgfx_math_cell (fy);
+    x -= fx;
+    y -= fy;
+
+    double best = 8.0;
+    #pragma GCC unroll 32
+    for (int b = -1; b <= 1; ++b)
+        #pragma GCC unroll 32
+        for (int a = -1; a <= 1; ++a)
+        {
+            uint32_t h = dgfx_math_hash (i + a, j + b, 0, 0);
+            double dx = a + dgfx_math_unit (h) - x;
+            double dy = b + dgfx_math_unit (h * 0x9e3779b9u) - y;
+            double d = dx * dx + dy * dy;
+            best = d < best ? d : best;
+        }
+    return sqrt (best);
+}
+
+DGFX_MATH_KERNEL double
+dgfx_math_worley3_k (double x, double y, double z)
+{
+    double fx = floor (x), fy = floor (y), fz = floor (z);
+    uint32_t i = dgfx_math_cell (fx), j = dgfx_math_cell (fy), k = dgfx_math_cell (fz);
+    x -= fx;
+    y -= fy;
+    z -= fz;
+
+    double best = 8.0;
+    #pragma GCC unroll 32
+    for (int c = -1; c <= 1; ++c)
+        #pragma GCC unroll 32
+        for (int b = -1; b <= 1; ++b)
+            #pragma GCC unroll 32
+            for (int a = -1; a <= 1; ++a)
+            {
+                uint32_t h = dgfx_math_hash (i + a, j + b, k + c, 0);
+                double dx = a + dgfx_math_unit (h) - x;
+                double dy = b + dgfx_math_unit (h * 0x9e3779b9u) - y;
+                double dz = c + dgfx_math_unit (h * 0x85ebca6bu) - z;
+                double d = dx * dx + dy * dy + dz * dz;
+                best = d < best ? d : best;
+            }
+    return sqrt (best);
+}
+
+// fractal brownian motion: `octaves` layers of perlin noise, each `lacunarity` times the frequency and `gain`
+// times the amplitude of the one before, divided by the summed amplitudes to stay in [-1, 1]
+DGFX_MATH_KERNEL double
+dgfx_math_fbm2_k (double x, double y, int octaves, double lacunarity, double gain)
+{
+    double sum = 0.0, amp = 1.0, f = 1.0, norm = 0.0;
+    for (int o = 0; o < octaves; ++o)
+    {
+        sum += amp * dgfx_math_perlin2_k (x * f, y * f);
+        norm += amp;
+        amp *= gain;
+        f *= lacunarity;
+    }
+    return norm > 0.0 ? sum / norm : 0.0;
+}
+
+DGFX_MATH_KERNEL double
+dgfx_math_fbm3_k (double x, double y, double z, int octaves, double lacunarity, double gain)
+{
+    double sum = 0.0, amp = 1.0, f = 1.0, norm = 0.0;
+    for (int o = 0; o < octaves; ++o)
+    {
+        sum += amp * dgfx_math_perlin3_k (x * f, y * f, z * f);
+        norm += amp;
+        amp *= gain;
+        f *= lacunarity;
+    }
+    return norm > 0.0 ? sum / norm : 0.0;
+}
+
+DGFX_MATH_KERNEL double
+dgfx_math_fbm4_k (double x, double y, double z, double w, int octaves, double lacunarity, double gain)
+{
+    double sum = 0.0, amp = 1.0, f = 1.0, norm = 0.0;
+    for (int o = 0; o < octaves; ++o)
+    {
+        sum += amp * dgfx_math_perlin4_k (x * f, y * f, z * f, w * f);
+        norm += amp;
+        amp *= gain;
+        f *= lacunarity;
+    }
+    return norm > 0.0 ? sum / norm : 0.0;
+}
+
+DGFX_MATH_KERNEL double
+dgfx_math_clamp01 (double v)
+{
+    v = v > 0.0 ? v : 0.0;
+    return v < 1.0 ? v : 1.0;
+}
+
+// the branchless forms from https://en.wikipedia.org/wiki/HSL_and_HSV#Color_conversion_formulae
+DGFX_MATH_KERNEL void
+dgfx_math_hsv2rgb_k (double h, double s, double v, double *out)
+{
+    h = (h - floor (h)) * 6.0;
+    double k[3] = { 5.0, 3.0, 1.0 };
+    #pragma GCC unroll 32
+    for (int c = 0; c < 3; ++c)
+    {
+        double kc = k[c] + h;
+        kc = kc >= 6.0 ? kc - 6.0 : kc;
+        double m = 4.0 - kc < kc ? 4.0 - kc : kc;
+        out[c] = v - v * s * dgfx_math_clamp01 (m);
+    }
+}
+
+DGFX_MATH_KERNEL void
+dgfx_math_hsl2rgb_k (double h, double s, double l, double *out)
+{
+    h = (h - floor (h)) * 12.0;
+    double a = s * (l < 1.0 - l ? l : 1.0 - l);
+    double k[3] = { 0.0, 8.0, 4.0 };
+    #pragma GCC unroll 32
+    for (int c = 0; c < 3; ++c)
+    {
+        double kc = k[c] + h;
+        kc = kc >= 12.0 ? kc - 12.0 : kc;
+        double m = kc - 3.0 < 9.0 - kc ? kc - 3.0 : 9.0 - kc;
+        out[c] = l - a * (dgfx_math_clamp01 ((m + 1.0) * 0.5) * 2.0 - 1.0);
+    }
+}
+
+// hue in [0, 1) and the largest and smallest channel, shared by both inverse conversions
+DGFX_MATH_KERNEL double
+dgfx_math_hue (double r, double g, double b, double *max, double *min)
+{
+    *max = r > g ? (r > b ? r : b) : (g > b ? g : b);
+    *min = r < g ? (r < b ? r : b) : (g < b ? g : b);
+    double d = *max - *min;
+    if (d <= 0.0)
+        return 0.0;
+
+    double h = *max == r ? (g - b) / d : *max == g ? (b - r) / d + 2.0 : (r - g) / d + 4.0;
+    h /= 6.0;
+    return h < 0.0 ? h + 1.0 : h;
+}
+
+DGFX_MATH_KERNEL void
+dgfx_math_rgb2hsv_k (double r, double g, double b, double *out)
+{
+    double max, min;
+    out[0] = dgfx_math_hue (r, g, b, &max, &min);
+    out[1] = max > 0.0 ? (max - min) / max : 0.0;
+    out[2] = max;
+}
+
+DGFX_MATH_KERNEL void
+dgfx_math_rgb2hsl_k (double r, double g, double b, double *out)
+{
+    double max, min;
+    out[0] = dgfx_math_hue (r, g, b, &max, &min);
+    double l = (max + min) * 0.5;
+    double d = 1.0 - fabs (2.0 * l - 1.0);
+    out[1] = d > 0.0 ? (max - min) / d : 0.0;
+    out[2] = l;
+}
+
+// sRGB's transfer function, odd so colors out of gamut survive the round trip
+DGFX_MATH_KERNEL double
+dgfx_math_srgb_to_linear (double c)
+{
+    double a = fabs (c);
+    return copysign (a <= 0.04045 ? a / 12.92 : pow ((a + 0.055) / 1.055, 2.4), c);
+}
+
+DGFX_MATH_KERNEL double
+dgfx_math_linear_to_srgb (double c)
+{
+    double a = fabs (c);
+    return copysign (a <= 0.0031308 ? a * 12.92 : 1.055 * pow (a, 1.0 / 2.4) - 0.055, c);
+}
+
+// Björn Ottosson's matrices, https://bottosson.github.io/posts/oklab/
+DGFX_MATH_KERNEL void
+dgfx_math_rgb2oklab_k (double r, double g, double b, double *out)
+{
+    r = dgfx_math_srgb_to_linear (r);
+    g = dgfx_math_srgb_to_linear (g);
+    b = dgfx_math_srgb_to_linear (b);
+
+    double l = cbrt (0.4122214708 * r + 0.5363325363 * g + 0.0514459929 * b);
+    double m = cbrt (0.2119034982 * r + 0.6806995451 * g + 0.1073969566 * b);
+    double s = cbrt (0.0883024619 * r + 0.2817188376 * g + 0.6299787005 * b);
+
+    out[0] = 0.2104542553 * l + 0.7936177850 * m - 0.0040720468 * s;
+    out[1] = 1.9779984951 * l - 2.4285922050 * m + 0.4505937099 * s;
+    out[2] = 0.0259040371 * l + 0.7827717662 * m - 0.8086757660 * s;
+}
+
+DGFX_MATH_KERNEL void
+dgfx_math_oklab2rgb_k (double L, double a, double b, double *out)
+{
+    double l = L + 0.3963377774 * a + 0.2158037573 * b;
+    double m = L - 0.1055613458 * a - 0.0638541728 * b;
+    double s = L - 0.0894841775 * a - 1.2914855480 * b;
+    l = l * l * l;
+    m = m * m * m;
+    s = s * s * s;
+
+    out[0] = dgfx_math_linear_to_srgb (4.0767416621 * l - 3.3077115913 * m + 0.2309699292 * s);
+    out[1] = dgfx_math_linear_to_srgb (-1.2684380046 * l + 2.6097574011 * m - 0.3413193965 * s);
+    out[2] = dgfx_math_linear_to_srgb (-0.0041960863 * l - 0.7034186147 * m + 1.7076147010 * s);
+}
+
+// Inigo Quilez's cosine palettes
+DGFX_MATH_KERNEL void
+dgfx_math_palette_k (double t, const double *abcd, double *out)
+{
+    #pragma GCC unroll 32
+    for (int c = 0; c < 3; ++c)
+        out[c] = abcd[c] + abcd[3 + c] * cos (6.28318530717958647692 * (abcd[6 + c] * t + abcd[9 + c]));
+}
+
+// the entry points: scalar ones for single values and, built per instruction set, loops over arrays
+
+#define DGFX_MATH_NOISE2(name)                                                                                         \
+    double dgfx_math_##name (double x, double y)                                                                       \
+    {                                                                                                                  \
+        return dgfx_math_##name##_k (x, y);                                                                            \
+    }                                                                                                                  \
+    DGFX_MATH_BATCH void dgfx_math_##name##_n (size_t n, const double *x, const double *y, double *out)                \
+    {                                                                                                                  \
+        for (size_t i = 0; i < n; ++i)                                                                                 \
+            out[i] = dgfx_math_##name##_k (x[i], y[i]);                                                                \
+    }
+
+#define DGFX_MATH_NOISE3(name)                                                                                         \
+    double dgfx_math_##name (double x, double y, double z)                                                             \
+    {                                                                                                                  \
+        return dgfx_math_##name##_k (x, y, z);                                                                         \
+    }                                                                                                                  \
+    DGFX_MATH_BATCH void dgfx_math_##name##_n (size_t n, const double *x, const double *y, const double *z,            \
+                                                double *out)                                                           \
+    {                                                                                                                  \
+        for (size_t i = 0; i < n; ++i)                                                                                 \
+            out[i] = dgfx_math_##name##_k (x[i], y[i], z[i]);                                                          \
+    }
+
+#define DGFX_MATH_NOISE4(name)                                                                                         \
+    double dgfx_math_##name (double x, double y, double z, double w)                                                   \
+    {                                                                                                                  \
+        return dgfx_math_##name##_k (x, y, z, w);                                                                      \
+    }                                                                                                                  \
+    DGFX_MATH_BATCH void dgfx_math_##name##_n (size_t n, const double *x, const double *y, const double *z,            \
+                                                const double *w, double *out)                                          \
+    {                                                                                                                  \
+        for (size_t i = 0; i < n; ++i)                                                                                 \
+            out[i] = dgfx_math_##name##_k (x[i], y[i], z[i], w[i]);                                                    \
+    }
+
+// `in` may be `out`, every triple is read before it is written
+#define DGFX_MATH_COLOR(name)                                                                                          \
+    void dgfx_math_##name (double a, double b, double c, double *out)                                                  \
+    {                                                                                                                  \
+        dgfx_math_##name##_k (a, b, c, out);                                                                           \
+    }                                                                                                                  \
+    DGFX_MATH_BATCH void dgfx_math_##name##_n (size_t n, const double *in, double *out)                                \
+    {                                                                                                                  \
+        for (size_t i = 0; i < n; ++i)                                                                                 \
+        {                                                                                                              \
+            double c[3];                                                                                               \
+            dgfx_math_##name##_k (in[i * 3], in[i * 3 + 1], in[i * 3 + 2], c);                                        \
+            out[i * 3] = c[0];                                                                                         \
+            out[i * 3 + 1] = c[1];                                                                                     \
+            out[i * 3 + 2] = c[2];                                                                                     \
+        }                                                                                                              \
+    }
+
+DGFX_MATH_NOISE2 (perlin2)
+DGFX_MATH_NOISE3 (perlin3)
+DGFX_MATH_NOISE4 (perlin4)
+DGFX_MATH_NOISE2 (simplex2)
+DGFX_MATH_NOISE3 (simplex3)
+DGFX_MATH_NOISE4 (simplex4)
+DGFX_MATH_NOISE2 (value2)
+DGFX_MATH_NOISE3 (value3)
+DGFX_MATH_NOISE4 (value4)
+DGFX_MATH_NOISE2 (worley2)
+DGFX_MATH_NOISE3 (worley3)
+
+DGFX_MATH_COLOR (hsv2rgb)
+DGFX_MATH_COLOR (rgb2hsv)
+DGFX_MATH_COLOR (hsl2rgb)
+DGFX_MATH_COLOR (rgb2hsl)
+DGFX_MATH_COLOR (oklab2rgb)
+DGFX_MATH_COLOR (rgb2oklab)
+
+double
+dgfx_math_fbm2 (double x, double y, int octaves, double lacunarity, double gain)
+{
+    return dgfx_math_fbm2_k (x, y, octaves, lacunarity, gain);
+}
+
+double
+dgfx_math_fbm3 (double x, double y, double z, int octaves, double lacunarity, double gain)
+{
+    return dgfx_math_fbm3_k (x, y, z, octaves, lacunarity, gain);
+}
+
+double
+dgfx_math_fbm4 (double x, double y, double z, double w, int octaves, double lacunarity, double gain)
+{
+    return dgfx_math_fbm4_k (x, y, z, w, octaves, lacunarity, gain);
+}
+
+void
+dgfx_math_palette (double t, const double *abcd, double *out)
+{
+    dgfx_math_palette_k (t, abcd, out);
+}
+
+// fbm a block at a time, octave by octave, so the loop over pixels is the inner one and vectorizes. sums in the
+// same order as the scalar version.
+#define DGFX_MATH_FBM_BLOCK 64
+
+DGFX_MATH_BATCH void
+dgfx_math_fbm2_n (size_t n, const double *x, const double *y, int octaves, double lacunarity, double gain,
+                  double *out)
+{
+    for (size_t i = 0; i < n; i += DGFX_MATH_FBM_BLOCK)
+    {
+        size_t m = n - i < DGFX_MATH_FBM_BLOCK ? n - i : DGFX_MATH_FBM_BLOCK;
+        double sum[DGFX_MATH_FBM_BLOCK] = { 0 }, amp = 1.0, f = 1.0, norm = 0.0;
+        for (int o = 0; o < octaves; ++o)
+        {
+            for (size_t j = 0; j < m; ++j)
+                sum[j] += amp * dgfx_math_perlin2_k (x[i + j] * f, y[i + j] * f);
+            norm += amp;
+            amp *= gain;
+            f *= lacunarity;
+        }
+
+        for (size_t j = 0; j < m; ++j)
+            out[i + j] = norm > 0.0 ? sum[j] / norm : 0.0;
+    }
+}
+
+DGFX_MATH_BATCH void
+dgfx_math_fbm3_n (size_t n, const double *x, const double *y, const double *z, int octaves, double lacunarity,
+                  double gain, double *out)
+{
+    for (size_t i = 0; i < n; i += DGFX_MATH_FBM_BLOCK)
+    {
+        size_t m = n - i < DGFX_MATH_FBM_BLOCK ? n - i : DGFX_MATH_FBM_BLOCK;
+        double sum[DGFX_MATH_FBM_BLOCK] = { 0 }, amp = 1.0, f = 1.0, norm = 0.0;
+        for (int o = 0; o < octaves; ++o)
+        {
+            for (size_t j = 0; j < m; ++j)
+                sum[j] += amp * dgfx_math_perlin3_k (x[i + j] * f, y[i + j] * f, z[i + j] * f);
+            norm += amp;
+            amp *= gain;
+            f *= lacunarity;
+        }
+
+        for (size_t j = 0; j < m; ++j)
+            out[i + j] = norm > 0.0 ? sum[j] / norm : 0.0;
+    }
+}
+
+DGFX_MATH_BATCH void
+dgfx_math_fbm4_n (size_t n, const double *x, const double *y, const double *z, const double *w, int octaves,
+                  double lacunarity, double gain, double *out)
+{
+    for (size_t i = 0; i < n; i += DGFX_MATH_FBM_BLOCK)
+    {
+        size_t m = n - i < DGFX_MATH_FBM_BLOCK ? n - i : DGFX_MATH_FBM_BLOCK;
+        double sum[DGFX_MATH_FBM_BLOCK] = { 0 }, amp = 1.0, f = 1.0, norm = 0.0;
+        for (int o = 0; o < octaves; ++o)
+        {
+            for (size_t j = 0; j < m; ++j)
+                sum[j] += amp * dgfx_math_perlin4_k (x[i + j] * f, y[i + j] * f, z[i + j] * f, w[i + j] * f);
+            norm += amp;
+            amp *= gain;
+            f *= lacunarity;
+        }
+
+        for (size_t j = 0; j < m; ++j)
+            out[i + j] = norm > 0.0 ? sum[j] / norm : 0.0;
+    }
+}
+
+DGFX_MATH_BATCH void
+dgfx_math_palette_n (size_t n, const double *t, const double *abcd, double *out)
+{
+    for (size_t i = 0; i < n; ++i)
+        dgfx_math_palette_k (t[i], abcd, out + i * 3);
+}
+
+// dgfx.shared and dgfx.lut: blocks built by whichever lua state asks for one first, all later ones get it
+// read-only. in most runs that is the main thread's scratch state, before workers are started, so worker
+// processes inherit the blocks across fork() and the pages stay shared.
+struct dgfx_math_block
+{
+    size_t size;
+    void *data; // NULL: not built yet
+};
+
+struct
+{
+    pthread_mutex_t mutex; // held from block_acquire to block_release while a block is built
+    struct dgfx_math_block *blocks;
+    size_t block_n;
+} dgfx_math_ctx = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .blocks = NULL,
+    .block_n = 0,
+};
+
+// whole pages, so the finished block can be made read-only without touching anything else
+size_t
+dgfx_math_block_pages (size_t size)
+{
+    size_t page = (size_t)sysconf (_SC_PAGESIZE);
+    return (size + page - 1) / page * page;
+}
+
+void *
+dgfx_math_block_acquire (uint32_t index, size_t size, int *fill)
+{
+    pthread_mutex_lock (&dgfx_math_ctx.mutex);
+    *fill = 0;
+
+    if (index < dgfx_math_ctx.block_n && dgfx_math_ctx.blocks[index].data)
+    {
+        struct dgfx_math_block *block = &dgfx_math_ctx.blocks[index];
+        bool same = block->size == size;
+        *fill = same ? 0 : -1;
+        pthread_mutex_unlock (&dgfx_math_ctx.mutex);
+        return same ? block->data : NULL;
+    }
+
+    if (size == 0)
+        goto dgfx_math_block_acquire_oopsie;
+
+    if (index >= dgfx_math_ctx.block_n)
+    {
+        struct dgfx_math_block *blocks = realloc (dgfx_math_ctx.blocks, (index + 1) * sizeof (*blocks));
+        if (!blocks)
+            goto dgfx_math_block_acquire_oopsie;
+        memset (blocks + dgfx_math_ctx.block_n, 0, (index + 1 - dgfx_math_ctx.block_n) * sizeof (*blocks));
+        dgfx_math_ctx.blocks = blocks;
+        dgfx_math_ctx.block_n = index + 1;
+    }
+
+    void *data = mmap (NULL, dgfx_math_block_pages (size), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data == MAP_FAILED)
+        goto dgfx_math_block_acquire_oopsie;
+
+    dgfx_math_ctx.blocks[index] = (struct dgfx_math_block){ .size = size, .data = data };
+    *fill = 1;
+    return data; // still locked, see dgfx_math_block_release
+
+dgfx_math_block_acquire_oopsie:
+    pthread_mutex_unlock (&dgfx_math_ctx.mutex);
+    return NULL;
+}
+
+void
+dgfx_math_block_release (uint32_t index, int filled)
+{
+    struct dgfx_math_block *block = &dgfx_math_ctx.blocks[index];
+    if (filled)
+        mprotect (block->data, dgfx_math_block_pages (block->size), PROT_READ);
+    else // building failed, the next state to ask tries again
+    {
+        munmap (block->data, dgfx_math_block_pages (block->size));
+        block->data = NULL;
+    }
+    pthread_mutex_unlock (&dgfx_math_ctx.mutex);
+}
+
+void
+dgfx_math_blocks_free (void)
+{
+    for (size_t i = 0; i < dgfx_math_ctx.block_n; ++i)
+        if (dgfx_math_ctx.blocks[i].data)
+            munmap (dgfx_math_ctx.blocks[i].data, dgfx_math_block_pages (dgfx_math_ctx.blocks[i].size));
+    free (dgfx_math_ctx.blocks);
+    dgfx_math_ctx.blocks = NULL;
+    dgfx_math_ctx.block_n = 0;
+}
+
+const struct dgfx_math dgfx_math = {
+    .perlin2 = dgfx_math_perlin2,
+    .perlin3 = dgfx_math_perlin3,
+    .perlin4 = dgfx_math_perlin4,
+    .simplex2 = dgfx_math_simplex2,
+    .simplex3 = dgfx_math_simplex3,
+    .simplex4 = dgfx_math_simplex4,
+    .value2 = dgfx_math_value2,
+    .value3 = dgfx_math_value3,
+    .value4 = dgfx_math_value4,
+    .worley2 = dgfx_math_worley2,
+    .worley3 = dgfx_math_worley3,
+    .fbm2 = dgfx_math_fbm2,
+    .fbm3 = dgfx_math_fbm3,
+    .fbm4 = dgfx_math_fbm4,
+
+    .hsv2rgb = dgfx_math_hsv2rgb,
+    .rgb2hsv = dgfx_math_rgb2hsv,
+    .hsl2rgb = dgfx_math_hsl2rgb,
+    .rgb2hsl = dgfx_math_rgb2hsl,
+    .oklab2rgb = dgfx_math_oklab2rgb,
+    .rgb2oklab = dgfx_math_rgb2oklab,
+    .palette = dgfx_math_palette,
+
+    .perlin2_n = dgfx_math_perlin2_n,
+    .perlin3_n = dgfx_math_perlin3_n,
+    .perlin4_n = dgfx_math_perlin4_n,
+    .simplex2_n = dgfx_math_simplex2_n,
+    .simplex3_n = dgfx_math_simplex3_n,
+    .simplex4_n = dgfx_math_simplex4_n,
+    .value2_n = dgfx_math_value2_n,
+    .value3_n = dgfx_math_value3_n,
+    .value4_n = dgfx_math_value4_n,
+    .worley2_n = dgfx_math_worley2_n,
+    .worley3_n = dgfx_math_worley3_n,
+    .fbm2_n = dgfx_math_fbm2_n,
+    .fbm3_n = dgfx_math_fbm3_n,
+    .fbm4_n = dgfx_math_fbm4_n,
+
+    .hsv2rgb_n = dgfx_math_hsv2rgb_n,
+    .rgb2hsv_n = dgfx_math_rgb2hsv_n,
+    .hsl2rgb_n = dgfx_math_hsl2rgb_n,
+    .rgb2hsl_n = dgfx_math_rgb2hsl_n,
+    .oklab2rgb_n = dgfx_math_oklab2rgb_n,
+    .rgb2oklab_n = dgfx_math_rgb2oklab_n,
+    .palette_n = dgfx_math_palette_n,
+
+    .block_acquire = dgfx_math_block_acquire,
+    .block_release = dgfx_math_block_release,
+};
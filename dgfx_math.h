@@ -0,0 +1,85 @@
+#ifndef _DGFX_MATH_H
+#define _DGFX_MATH_H
+
+// dgfx.math: noise and color helpers in C, for scripts through the ffi (see resources/lua/math.lua). everything
+// is in doubles, like lua numbers. noise is roughly in [-1, 1] and the same on every run and machine, colors are
+// 0..1 per channel with hues in [0, 1).
+//
+// every function has a batch variant, suffixed _n, over `n` elements of arrays: one array per coordinate for
+// noise, r, g, b triples for colors (`in` may be `out`). those are built for avx2 and avx-512 as well and pick
+// the best one the cpu has.
+
+#include <stddef.h>
+#include <stdint.h>
+
+// declares the table for C and keeps the same text for ffi.cdef, so the two can't drift apart
+#define DGFX_MATH_DECLARE(...)                                                                                         \
+    __VA_ARGS__;                                                                                                       \
+    static const char dgfx_math_cdef[] = #__VA_ARGS__ ";"
+
+DGFX_MATH_DECLARE (struct dgfx_math {
+    double (*perlin2) (double x, double y);
+    double (*perlin3) (double x, double y, double z);
+    double (*perlin4) (double x, double y, double z, double w);
+    double (*simplex2) (double x, double y);
+    double (*simplex3) (double x, double y, double z);
+    double (*simplex4) (double x, double y, double z, double w);
+    double (*value2) (double x, double y);
+    double (*value3) (double x, double y, double z);
+    double (*value4) (double x, double y, double z, double w);
+    double (*worley2) (double x, double y);
+    double (*worley3) (double x, double y, double z);
+    double (*fbm2) (double x, double y, int octaves, double lacunarity, double gain);
+    double (*fbm3) (double x, double y, double z, int octaves, double lacunarity, double gain);
+    double (*fbm4) (double x, double y, double z, double w, int octaves, double lacunarity, double gain);
+
+    void (*hsv2rgb) (double h, double s, double v, double *out);
+    void (*rgb2hsv) (double r, double g, double b, double *out);
+    void (*hsl2rgb) (double h, double s, double l, double *out);
+    void (*rgb2hsl) (double r, double g, double b, double *out);
+    // oklab from and to rgb as scripts return it, sRGB encoded
+    void (*oklab2rgb) (double l, double a, double b, double *out);
+    void (*rgb2oklab) (double r, double g, double b, double *out);
+    // a + b * cos (2 pi (c * t + d)) per channel, `abcd` holds a, b, c and d as r, g, b triples
+    void (*palette) (double t, const double *abcd, double *out);
+
+    void (*perlin2_n) (size_t n, const double *x, const double *y, double *out);
+    void (*perlin3_n) (size_t n, const double *x, const double *y, const double *z, double *out);
+    void (*perlin4_n) (size_t n, const double *x, const double *y, const double *z, const double *w, double *out);
+    void (*simplex2_n) (size_t n, const double *x, const double *y, double *out);
+    void (*simplex3_n) (size_t n, const double *x, const double *y, const double *z, double *out);
+    void (*simplex4_n) (size_t n, const double *x, const double *y, const double *z, const double *w, double *out);
+    void (*value2_n) (size_t n, const double *x, const double *y, double *out);
+    void (*value3_n) (size_t n, const double *x, const double *y, const double *z, double *out);
+    void (*value4_n) (size_t n, const double *x, const double *y, const double *z, const double *w, double *out);
+    void (*worley2_n) (size_t n, const double *x, const double *y, double *out);
+    void (*worley3_n) (size_t n, const double *x, const double *y, const double *z, double *out);
+    void (*fbm2_n) (size_t n, const double *x, const double *y, int octaves, double lacunarity, double gain,
+                    double *out);
+    void (*fbm3_n) (size_t n, const double *x, const double *y, const double *z, int octaves, double lacunarity,
+                    double gain, double *out);
+    void (*fbm4_n) (size_t n, const double *x, const double *y, const double *z, const double *w, int octaves,
+                    double lacunarity, double gain, double *out);
+
+    void (*hsv2rgb_n) (size_t n, const double *in, double *out);
+    void (*rgb2hsv_n) (size_t n, const double *in, double *out);
+    void (*hsl2rgb_n) (size_t n, const double *in, double *out);
+    void (*rgb2hsl_n) (size_t n, const double *in, double *out);
+    void (*oklab2rgb_n) (size_t n, const double *in, double *out);
+    void (*rgb2oklab_n) (size_t n, const double *in, double *out);
+    void (*palette_n) (size_t n, const double *t, const double *abcd, double *out);
+
+    // dgfx.shared's blocks and dgfx.lut's tables, found by the order a script creates them in. the block for
+    // `index` when it was built already. otherwise `size` fresh page-aligned bytes with *fill set, and every
+    // other caller kept waiting until block_release says whether they were filled. filled blocks turn
+    // read-only. NULL with *fill 0 when out of memory, -1 when block `index` has another size.
+    void *(*block_acquire) (uint32_t index, size_t size, int *fill);
+    void (*block_release) (uint32_t index, int filled);
+});
+
+extern const struct dgfx_math dgfx_math;
+
+// frees the blocks of dgfx.shared and dgfx.lut, once no lua state uses them anymore
+void dgfx_math_blocks_free (void);
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef _DGFX_PLUGIN_H
+#define _DGFX_PLUGIN_H
+
+// native shaders: `dgfx -i shader.so` loads a shared object in place of a lua script. it is shaded by the same
+// workers, scheduler and output modes, only with C instead of lua. build one with
+//
+//     cc -std=c99 -O3 -shared -fPIC -I<dgfx> shader.c -o shader.so
+//
+// see examples/plugin_simple.c. a plugin exports one symbol, `const struct dgfx_plugin dgfx_plugin`.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define DGFX_PLUGIN_ABI 1
+#define DGFX_PLUGIN_SYMBOL "dgfx_plugin"
+
+struct dgfx_plugin_info
+{
+    uint32_t width, height;  // frame size
+    uint32_t tile_w, tile_h; // largest tile shade_tile is called with, edge tiles are smaller
+    uint32_t worker_id;
+    int hdr; // values above 1 are tone mapped (--hdr) rather than clamped
+};
+
+struct dgfx_plugin
+{
+    uint32_t abi; // DGFX_PLUGIN_ABI
+    const char *name;
+
+    // called once per worker, on the thread or in the process that will call shade_tile with `*state`.
+    // returns 0 on success. may be NULL, `state` is NULL then.
+    int (*init) (const struct dgfx_plugin_info *info, void **state);
+
+    // called when the worker shuts down, may be NULL
+    void (*fini) (void *state);
+
+    // shades the `w` x `h` pixels at `x0`, `y0` for time `t`: r, g, b of pixel (x0 + x, y0 + y) go to
+    // dst[y * pitch + x * 4 + 0..2], `pitch` counts floats and dst[.. + 3] is not read. dgfx clamps (or tone maps)
+    // and quantizes them. a row shader is a tile shader that loops over one row. returns 0 on success.
+    int (*shade_tile) (void *state, double t, uint32_t x0, uint32_t y0, uint32_t w, uint32_t h, float *dst,
+                       size_t pitch);
+};
+
+#endif
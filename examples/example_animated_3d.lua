@@ -1,11 +1,49 @@
-function rgb(n, m, t)
+-- everything that only depends on t (camera, object positions and colors, light) is computed once per frame
+-- in frame(t), rgb gets the result as its 4th argument.
+function frame(t)
+    local f = {
+        cam_x = 3 * math.sin(t * 0.3),
+        cam_y = 2 + math.sin(t * 0.4) * 0.5,
+        cam_z = 5 + math.cos(t * 0.2) * 2,
+        light_x = 5 * math.sin(t * 0.6),
+        light_y = 3,
+        light_z = 5 * math.cos(t * 0.6) - 3,
+        spheres = {},
+        cubes = {},
+    }
+
+    for i = 1, 6 do
+        local sphere_angle = t * 0.5 + i * math.pi / 3
+        local r, g, b = hsvToRgb((i / 6.0 + t * 0.1) % 1.0, 0.8, 0.9)
+        f.spheres[i] = {
+            x = 3 * math.cos(sphere_angle),
+            y = math.sin(t * 2 + i) * 1.5,
+            z = 3 * math.sin(sphere_angle) - 8,
+            radius = 0.8 + 0.3 * math.sin(t * 3 + i),
+            r = r, g = g, b = b,
+        }
+    end
+
+    for i = 1, 4 do
+        local cube_angle = t * 0.7 + i * math.pi / 2
+        local r, g, b = hsvToRgb((i / 4.0 + t * 0.2 + 0.5) % 1.0, 1.0, 1.0)
+        f.cubes[i] = {
+            x = 2 * math.cos(cube_angle),
+            y = math.cos(t * 1.5 + i * 2) * 2,
+            z = 2 * math.sin(cube_angle) - 5,
+            r = r, g = g, b = b,
+        }
+    end
+
+    return f
+end
+
+function rgb(n, m, t, f)
     local aspect = dgfx.width / dgfx.height
     local screen_x = (2.0 * n / dgfx.width - 1.0) * aspect
     local screen_y = 1.0 - 2.0 * m / dgfx.height
     
-    local cam_x = 3 * math.sin(t * 0.3)
-    local cam_y = 2 + math.sin(t * 0.4) * 0.5
-    local cam_z = 5 + math.cos(t * 0.2) * 2
+    local cam_x, cam_y, cam_z = f.cam_x, f.cam_y, f.cam_z
     
     local focal_length = 2.0
     local ray_dx = screen_x
@@ -20,12 +58,11 @@ function rgb(n, m, t)
     local hit_normal_x, hit_normal_y, hit_normal_z = 0, 0, 0
     local hit_pos_x, hit_pos_y, hit_pos_z = 0, 0, 0
     
+    local spheres = f.spheres
     for i = 1, 6 do
-        local sphere_angle = t * 0.5 + i * math.pi / 3
-        local sphere_x = 3 * math.cos(sphere_angle)
-        local sphere_y = math.sin(t * 2 + i) * 1.5
-        local sphere_z = 3 * math.sin(sphere_angle) - 8
-        local sphere_radius = 0.8 + 0.3 * math.sin(t * 3 + i)
+        local sphere = spheres[i]
+        local sphere_x, sphere_y, sphere_z = sphere.x, sphere.y, sphere.z
+        local sphere_radius = sphere.radius
         
         local hit_dist, hit_x, hit_y, hit_z = raySphereIntersect(
             cam_x, cam_y, cam_z, ray_dx, ray_dy, ray_dz,
@@ -40,21 +77,18 @@ function rgb(n, m, t)
             hit_normal_y = (hit_y - sphere_y) / sphere_radius
             hit_normal_z = (hit_z - sphere_z) / sphere_radius
             
-            local hue = (i / 6.0 + t * 0.1) % 1.0
-            hit_color_r, hit_color_g, hit_color_b = hsvToRgb(hue, 0.8, 0.9)
+            hit_color_r, hit_color_g, hit_color_b = sphere.r, sphere.g, sphere.b
         end
     end
     
+    local cubes = f.cubes
     for i = 1, 4 do
-        local cube_angle = t * 0.7 + i * math.pi / 2
-        local cube_x = 2 * math.cos(cube_angle)
-        local cube_y = math.cos(t * 1.5 + i * 2) * 2
-        local cube_z = 2 * math.sin(cube_angle) - 5
+        local cube = cubes[i]
         local cube_size = 0.6
         
         local hit_dist, hit_x, hit_y, hit_z, normal_x, normal_y, normal_z = rayBoxIntersect(
             cam_x, cam_y, cam_z, ray_dx, ray_dy, ray_dz,
-            cube_x, cube_y, cube_z, cube_size, cube_size, cube_size
+            cube.x, cube.y, cube.z, cube_size, cube_size, cube_size
         )
         
         if hit_dist > 0 and hit_dist < closest_dist then
@@ -62,8 +96,7 @@ function rgb(n, m, t)
             hit_pos_x, hit_pos_y, hit_pos_z = hit_x, hit_y, hit_z
             hit_normal_x, hit_normal_y, hit_normal_z = normal_x, normal_y, normal_z
             
-            local hue = (i / 4.0 + t * 0.2 + 0.5) % 1.0
-            hit_color_r, hit_color_g, hit_color_b = hsvToRgb(hue, 1.0, 1.0)
+            hit_color_r, hit_color_g, hit_color_b = cube.r, cube.g, cube.b
         end
     end
     
@@ -92,7 +125,7 @@ function rgb(n, m, t)
             hit_pos_x, hit_pos_y, hit_pos_z,
             hit_normal_x, hit_normal_y, hit_normal_z,
             hit_color_r, hit_color_g, hit_color_b,
-            cam_x, cam_y, cam_z, t
+            f.light_x, f.light_y, f.light_z
         )
     end
     
@@ -179,11 +212,7 @@ function rayBoxIntersect(ray_x, ray_y, ray_z, dir_x, dir_y, dir_z, box_x, box_y,
     return t, hit_x, hit_y, hit_z, normal_x, normal_y, normal_z
 end
 
-function calculateSimpleLighting(hit_x, hit_y, hit_z, normal_x, normal_y, normal_z, base_r, base_g, base_b, cam_x, cam_y, cam_z, t)
-    local light_x = 5 * math.sin(t * 0.6)
-    local light_y = 3
-    local light_z = 5 * math.cos(t * 0.6) - 3
-    
+function calculateSimpleLighting(hit_x, hit_y, hit_z, normal_x, normal_y, normal_z, base_r, base_g, base_b, light_x, light_y, light_z)
     local to_light_x = light_x - hit_x
     local to_light_y = light_y - hit_y
     local to_light_z = light_z - hit_z
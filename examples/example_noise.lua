@@ -0,0 +1,39 @@
+-- domain-warped fbm under a cosine palette, with the noise and colors from dgfx.math (C, see dgfx_math.h).
+-- shaded a row at a time through the batch functions; an rgb(n, m, t) calling dgfx.math.fbm3 and the palette
+-- for every pixel gives the same picture.
+local dm = dgfx.math
+
+local w = dgfx.worker.tile_w
+local xs, ys, zs = dm.array(w), dm.array(w), dm.array(w)
+local warp, v = dm.array(w), dm.array(w)
+local color = dm.array(w * 3)
+
+local _, abcd = dm.palette({ 0.5, 0.5, 0.5 }, { 0.5, 0.5, 0.5 }, { 1.0, 1.0, 1.0 }, { 0.0, 0.1, 0.2 })
+local scale = 3.0 / dgfx.height
+
+function rgb_row(y, x0, x1, t, row)
+    local n = x1 - x0 + 1
+    local z = t * 0.1
+
+    for i = 0, n - 1 do
+        xs[i] = (x0 + i) * scale
+        ys[i] = y * scale
+        zs[i] = z
+    end
+    dm.fbm3_n(n, xs, ys, zs, 4, 2.0, 0.5, warp)
+
+    for i = 0, n - 1 do
+        xs[i] = xs[i] + warp[i] * 2.0
+        ys[i] = ys[i] - warp[i] * 2.0
+    end
+    dm.fbm3_n(n, xs, ys, zs, 5, 2.0, 0.5, v)
+
+    for i = 0, n - 1 do
+        v[i] = v[i] * 1.5 + 0.5 + t * 0.05
+    end
+    dm.palette_n(n, v, abcd, color)
+
+    for i = 0, n * 3 - 1 do
+        row[i] = color[i]
+    end
+end
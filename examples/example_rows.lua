@@ -0,0 +1,22 @@
+-- same kind of picture as example_animated_simple.lua, shaded a row at a time with rgb_row.
+-- everything that only depends on the line is computed once per call instead of once per pixel.
+local sin, cos, sqrt = math.sin, math.cos, math.sqrt
+
+function rgb_row(y, x0, x1, t, row)
+    local inv_h = 1.0 / dgfx.height
+    local uv_y = (y * 2.0 - dgfx.height) * inv_h
+    local wave_y = sin(uv_y * 6.0 + t)
+    local uv_y2 = uv_y * uv_y
+
+    local i = 0
+    for x = x0, x1 do
+        local uv_x = (x * 2.0 - dgfx.width) * inv_h
+        local d = sqrt(uv_x * uv_x + uv_y2)
+        local v = 0.5 + 0.5 * sin(d * 10.0 - t * 2.0 + wave_y)
+
+        row[i] = v
+        row[i + 1] = 0.5 + 0.5 * cos(uv_x * 3.0 + t) * v
+        row[i + 2] = 1.0 - v * 0.75
+        i = i + 3
+    end
+end
@@ -0,0 +1,44 @@
+-- example_animated_simple.lua split in two: everything that does not depend on time (the uv folding and the
+-- distance terms of all 4 iterations) is computed once per pixel in setup, shade only animates them.
+local sin, cos, abs, pow, sqrt, exp, floor = math.sin, math.cos, math.abs, math.pow, math.sqrt, math.exp, math.floor
+
+local function palette(t)
+    return 0.5 + 0.5 * cos(6.28318 * (t + 0.263)),
+           0.5 + 0.5 * cos(6.28318 * (t + 0.416)),
+           0.5 + 0.5 * cos(6.28318 * (t + 0.557))
+end
+
+local function fract(x)
+    return x - floor(x)
+end
+
+function setup(n, m)
+    local uv_x = (n * 2.0 - dgfx.width) / dgfx.height
+    local uv_y = (m * 2.0 - dgfx.height) / dgfx.height
+    local len0 = sqrt(uv_x * uv_x + uv_y * uv_y)
+    local fade = exp(-len0)
+
+    local d = {}
+    for i = 0, 3 do
+        uv_x = fract(uv_x * 1.5) - 0.5
+        uv_y = fract(uv_y * 1.5) - 0.5
+        d[i] = sqrt(uv_x * uv_x + uv_y * uv_y) * fade
+    end
+
+    return len0, d[0], d[1], d[2], d[3]
+end
+
+local function layer(len0, i, d, time)
+    local col_r, col_g, col_b = palette(len0 + i * 0.4 + time * 0.4)
+    d = pow(0.01 / abs(sin(d * 8.0 + time) / 8.0), 1.2)
+    return col_r * d, col_g * d, col_b * d
+end
+
+function shade(n, m, time, f, len0, d0, d1, d2, d3)
+    local r0, g0, b0 = layer(len0, 0, d0, time)
+    local r1, g1, b1 = layer(len0, 1, d1, time)
+    local r2, g2, b2 = layer(len0, 2, d2, time)
+    local r3, g3, b3 = layer(len0, 3, d3, time)
+
+    return math.min(1, r0 + r1 + r2 + r3), math.min(1, g0 + g1 + g2 + g3), math.min(1, b0 + b1 + b2 + b3)
+end
@@ -41,6 +41,9 @@ local function hsv2rgb(h, s, v)
     return v, p, q
 end
 
+-- rgb ignores t: the picture is shaded once and every later frame is a copy. dgfx checks the claim on a few pixels.
+depends = "xy"
+
 function rgb(n, m)
     local cx = map(n, 0, dgfx.width, -2.5, 1)
     local cy = map(m, 0, dgfx.height, -1.2, 1.2)
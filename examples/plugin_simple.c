@@ -0,0 +1,79 @@
+// example_animated_simple.lua as a native plugin, a baseline for how fast the lua version could get.
+// build with `make plugins`, run with `dgfx -i examples/plugin_simple.so`.
+#include <math.h>
+#include <stdlib.h>
+
+#include "dgfx_plugin.h"
+
+static float
+fractf (float x)
+{
+    return x - floorf (x);
+}
+
+// the state is just a copy of `info`, for the frame size. workers start at the same time, so each gets its own.
+static int
+plugin_init (const struct dgfx_plugin_info *info, void **state)
+{
+    struct dgfx_plugin_info *frame = malloc (sizeof (*frame));
+    if (!frame)
+        return 1;
+
+    *frame = *info;
+    *state = frame;
+    return 0;
+}
+
+static void
+plugin_fini (void *state)
+{
+    free (state);
+}
+
+static int
+plugin_shade_tile (void *state, double t, uint32_t x0, uint32_t y0, uint32_t w, uint32_t h, float *dst, size_t pitch)
+{
+    const struct dgfx_plugin_info *frame = state;
+    float time = (float)t;
+
+    for (uint32_t y = 0; y < h; ++y, dst += pitch)
+    {
+        for (uint32_t x = 0; x < w; ++x)
+        {
+            float uv_x = ((x0 + x) * 2.0f - frame->width) / frame->height;
+            float uv_y = ((y0 + y) * 2.0f - frame->height) / frame->height;
+            float len0 = sqrtf (uv_x * uv_x + uv_y * uv_y);
+            float r = 0, g = 0, b = 0;
+
+            for (int i = 0; i < 4; ++i)
+            {
+                uv_x = fractf (uv_x * 1.5f) - 0.5f;
+                uv_y = fractf (uv_y * 1.5f) - 0.5f;
+
+                float d = sqrtf (uv_x * uv_x + uv_y * uv_y) * expf (-len0);
+                float p = len0 + i * 0.4f + time * 0.4f;
+
+                d = fabsf (sinf (d * 8.0f + time) / 8.0f);
+                d = powf (0.01f / d, 1.2f);
+
+                r += (0.5f + 0.5f * cosf (6.28318f * (p + 0.263f))) * d;
+                g += (0.5f + 0.5f * cosf (6.28318f * (p + 0.416f))) * d;
+                b += (0.5f + 0.5f * cosf (6.28318f * (p + 0.557f))) * d;
+            }
+
+            dst[x * 4 + 0] = r;
+            dst[x * 4 + 1] = g;
+            dst[x * 4 + 2] = b;
+        }
+    }
+
+    return 0;
+}
+
+const struct dgfx_plugin dgfx_plugin = {
+    .abi = DGFX_PLUGIN_ABI,
+    .name = "simple",
+    .init = plugin_init,
+    .fini = plugin_fini,
+    .shade_tile = plugin_shade_tile,
+};
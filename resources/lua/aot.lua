@@ -0,0 +1,1398 @@
+-- --aot: translates a script to C, which dgfx_aot_load builds into a plugin (see dgfx_plugin.h) that shades
+-- instead of luajit. called with the script's source and chunk name, returns the C source, or raises an error
+-- saying where the script leaves the subset this understands:
+--
+--   top level  function definitions, and locals or globals holding numbers, booleans, arrays of numbers
+--              ({ 0.5, 0.25 }) or math and script functions (local sin = math.sin). plain statements run
+--              once per worker, before the first tile.
+--   functions  number and boolean locals, arithmetic, comparisons, and/or/not, math.*, dgfx.width, height and
+--              hdr, if/while/repeat/numeric for/break, calls to other script functions, any number of return
+--              values. arrays only take constant indices.
+--   entry      rgb(n, m, t) returning r, g, b. frame(t), rgb_row and setup/shade are not supported.
+--
+-- functions can't assign globals or top level locals, so everything they compute only depends on their
+-- arguments and the generated code needs neither a lua state nor locks.
+local source, chunkname = ...
+local script = chunkname:gsub("^[@=]", "")
+
+local function fail(line, fmt, ...)
+    error(string.format("%s:%d: %s", script, line, string.format(fmt, ...)), 0)
+end
+
+-- lexer ------------------------------------------------------------------------------------------------------
+
+local keywords = {}
+for word in ([[and break do else elseif end false for function goto if in local nil not or repeat return then
+               true until while]]):gmatch("%a+") do
+    keywords[word] = true
+end
+
+local function lex(src)
+    local tokens, i, line = {}, 1, 1
+
+    local function push(type, value)
+        tokens[#tokens + 1] = { type = type, value = value, line = line }
+    end
+
+    -- [[ ... ]], [==[ ... ]==]: returns the position after it, nil when there is none at `at`
+    local function long_bracket(at)
+        local eq = src:match("^%[(=*)%[", at)
+        if not eq then
+            return nil
+        end
+
+        local close = "]" .. eq .. "]"
+        local e = src:find(close, at, true)
+        if not e then
+            fail(line, "unfinished long string or comment")
+        end
+
+        local _, newlines = src:sub(at, e):gsub("\n", "")
+        line = line + newlines
+        return e + #close
+    end
+
+    if src:find("^#") then -- shebang
+        i = (src:find("\n", 1, true) or #src + 1)
+    end
+
+    while i <= #src do
+        local c = src:sub(i, i)
+        if c == "\n" then
+            line = line + 1
+            i = i + 1
+        elseif c:find("^%s") then
+            i = i + 1
+        elseif src:find("^%-%-", i) then
+            i = long_bracket(i + 2) or src:find("\n", i, true) or #src + 1
+        elseif c:find("^[%a_]") then
+            local word = src:match("^[%w_]+", i)
+            push(keywords[word] and word or "<name>", word)
+            i = i + #word
+        elseif c:find("^%d") or src:find("^%.%d", i) then
+            local num = src:match("^0[xX]%x+", i) or src:match("^%d*%.?%d*[eE][%+%-]?%d+", i)
+                        or src:match("^%d*%.?%d*", i)
+            if not tonumber(num) or src:find("^[%w_]", i + #num) then
+                fail(line, "malformed number, or an ffi one (LL, ULL, i), near '%s'", src:match("^[%w_.]+", i))
+            end
+            push("<number>", tonumber(num))
+            i = i + #num
+        elseif c == '"' or c == "'" then
+            local j = i + 1
+            while src:sub(j, j) ~= c do
+                if src:sub(j, j) == "" or src:sub(j, j) == "\n" then
+                    fail(line, "unfinished string")
+                end
+                j = j + (src:sub(j, j) == "\\" and 2 or 1)
+            end
+            push("<string>", src:sub(i + 1, j - 1))
+            i = j + 1
+        elseif src:find("^%[=*%[", i) then
+            push("<string>", "")
+            i = long_bracket(i)
+        else
+            local op = src:match("^%.%.%.", i) or src:match("^[=~<>]=", i) or src:match("^%.%.", i)
+                       or src:match("^::", i) or src:match("^[%+%-%*/%%%^#<>=%(%){}%[%];:,%.]", i)
+            if not op then
+                fail(line, "unexpected symbol near '%s'", c)
+            end
+            push(op, op)
+            i = i + #op
+        end
+    end
+
+    push("<eof>", "<eof>")
+    return tokens
+end
+
+-- parser: lua 5.1 syntax, into a tree of { k = kind, line = ..., ... } nodes --------------------------------------
+
+local tokens, pos = lex(source), 1
+
+local function check(type)
+    return tokens[pos].type == type
+end
+
+local function next_token()
+    pos = pos + 1
+    return tokens[pos - 1]
+end
+
+local function accept(type)
+    if check(type) then
+        return next_token()
+    end
+end
+
+local function expect(type)
+    if not check(type) then
+        fail(tokens[pos].line, "'%s' expected near '%s'", type, tokens[pos].value)
+    end
+    return next_token()
+end
+
+local binary_priority = {
+    ["or"] = { 1, 1 }, ["and"] = { 2, 2 },
+    ["<"] = { 3, 3 }, [">"] = { 3, 3 }, ["<="] = { 3, 3 }, [">="] = { 3, 3 }, ["~="] = { 3, 3 }, ["=="] = { 3, 3 },
+    [".."] = { 5, 4 }, ["+"] = { 6, 6 }, ["-"] = { 6, 6 }, ["*"] = { 7, 7 }, ["/"] = { 7, 7 }, ["%"] = { 7, 7 },
+    ["^"] = { 10, 9 },
+}
+local unary_priority = 8
+
+local parse_expr, parse_explist, parse_block
+
+local function parse_function(line)
+    expect("(")
+    local params, vararg = {}, false
+    if not check(")") then
+        repeat
+            if accept("...") then
+                vararg = true
+                break
+            end
+            params[#params + 1] = expect("<name>").value
+        until not accept(",")
+    end
+    expect(")")
+
+    local body = parse_block()
+    expect("end")
+    return { params = params, vararg = vararg, body = body, line = line }
+end
+
+local function parse_table()
+    local line = expect("{").line
+    local items = {}
+    while not check("}") do
+        if accept("[") then
+            local key = parse_expr()
+            expect("]")
+            expect("=")
+            items[#items + 1] = { key = key, val = parse_expr() }
+        elseif check("<name>") and tokens[pos + 1].type == "=" then
+            local key = { k = "Str", v = next_token().value, line = line }
+            next_token()
+            items[#items + 1] = { key = key, val = parse_expr() }
+        else
+            items[#items + 1] = { val = parse_expr() }
+        end
+
+        if not accept(",") and not accept(";") then
+            break
+        end
+    end
+    expect("}")
+    return { k = "Table", items = items, line = line }
+end
+
+local function parse_args()
+    local t = tokens[pos]
+    if accept("(") then
+        local args = check(")") and {} or parse_explist()
+        expect(")")
+        return args
+    elseif accept("<string>") then
+        return { { k = "Str", v = t.value, line = t.line } }
+    elseif check("{") then
+        return { parse_table() }
+    end
+    fail(t.line, "function arguments expected near '%s'", t.value)
+end
+
+local function parse_primary()
+    local t = next_token()
+    if t.type == "<name>" then
+        return { k = "Name", name = t.value, line = t.line }
+    elseif t.type == "(" then
+        local e = parse_expr()
+        expect(")")
+        return { k = "Paren", e = e, line = t.line }
+    end
+    fail(t.line, "unexpected symbol near '%s'", t.value)
+end
+
+local function parse_suffixed()
+    local e = parse_primary()
+    while true do
+        local line = tokens[pos].line
+        if accept(".") then
+            e = { k = "Index", obj = e, key = { k = "Str", v = expect("<name>").value, line = line }, line = line }
+        elseif accept("[") then
+            e = { k = "Index", obj = e, key = parse_expr(), line = line }
+            expect("]")
+        elseif accept(":") then
+            e = { k = "Method", obj = e, name = expect("<name>").value, line = line }
+            e.args = parse_args()
+        elseif check("(") or check("<string>") or check("{") then
+            e = { k = "Call", fn = e, args = parse_args(), line = line }
+        else
+            return e
+        end
+    end
+end
+
+local function parse_simple()
+    local t = tokens[pos]
+    if accept("<number>") then
+        return { k = "Num", v = t.value, line = t.line }
+    elseif accept("<string>") then
+        return { k = "Str", v = t.value, line = t.line }
+    elseif accept("nil") or accept("true") or accept("false") or accept("...") then
+        return { k = t.type, line = t.line }
+    elseif check("{") then
+        return parse_table()
+    elseif accept("function") then
+        local f = parse_function(t.line)
+        f.k = "Func"
+        return f
+    end
+    return parse_suffixed()
+end
+
+function parse_expr(limit)
+    local t = tokens[pos]
+    local e
+    if accept("not") or accept("-") or accept("#") then
+        e = { k = "Un", op = t.type, e = parse_expr(unary_priority), line = t.line }
+    else
+        e = parse_simple()
+    end
+
+    while true do
+        local priority = binary_priority[tokens[pos].type]
+        if not priority or priority[1] <= (limit or 0) then
+            return e
+        end
+
+        local op = next_token()
+        e = { k = "Bin", op = op.type, a = e, b = parse_expr(priority[2]), line = op.line }
+    end
+end
+
+function parse_explist()
+    local list = { parse_expr() }
+    while accept(",") do
+        list[#list + 1] = parse_expr()
+    end
+    return list
+end
+
+local function block_follows()
+    local type = tokens[pos].type
+    return type == "end" or type == "else" or type == "elseif" or type == "until" or type == "<eof>"
+end
+
+local function parse_statement()
+    local line = tokens[pos].line
+
+    if accept("if") then
+        local s = { k = "If", conds = {}, blocks = {}, line = line }
+        repeat
+            s.conds[#s.conds + 1] = parse_expr()
+            expect("then")
+            s.blocks[#s.blocks + 1] = parse_block()
+        until not accept("elseif")
+        if accept("else") then
+            s.orelse = parse_block()
+        end
+        expect("end")
+        return s
+    elseif accept("while") then
+        local s = { k = "While", cond = parse_expr(), line = line }
+        expect("do")
+        s.body = parse_block()
+        expect("end")
+        return s
+    elseif accept("do") then
+        local s = { k = "Do", body = parse_block(), line = line }
+        expect("end")
+        return s
+    elseif accept("for") then
+        local var = expect("<name>").value
+        if accept("=") then
+            local s = { k = "Fornum", var = var, start = parse_expr(), line = line }
+            expect(",")
+            s.limit = parse_expr()
+            s.step = accept(",") and parse_expr() or nil
+            expect("do")
+            s.body = parse_block()
+            expect("end")
+            return s
+        end
+
+        while accept(",") do
+            expect("<name>")
+        end
+        expect("in")
+        parse_explist()
+        expect("do")
+        parse_block()
+        expect("end")
+        return { k = "Forin", line = line }
+    elseif accept("repeat") then
+        local s = { k = "Repeat", body = parse_block(), line = line }
+        expect("until")
+        s.cond = parse_expr()
+        return s
+    elseif accept("function") then
+        local path = { expect("<name>").value }
+        while accept(".") do
+            path[#path + 1] = expect("<name>").value
+        end
+        local method = accept(":") and expect("<name>").value
+
+        local s = parse_function(line)
+        s.k, s.path, s.method = "Function", path, method
+        return s
+    elseif accept("local") then
+        if accept("function") then
+            local name = expect("<name>").value
+            local s = parse_function(line)
+            s.k, s.name = "LocalFunction", name
+            return s
+        end
+
+        local s = { k = "Local", names = {}, exprs = {}, line = line }
+        repeat
+            s.names[#s.names + 1] = expect("<name>").value
+        until not accept(",")
+        if accept("=") then
+            s.exprs = parse_explist()
+        end
+        return s
+    elseif accept("return") then
+        local s = { k = "Return", exprs = (block_follows() or check(";")) and {} or parse_explist(), line = line }
+        accept(";")
+        return s
+    elseif accept("break") then
+        return { k = "Break", line = line }
+    elseif check("goto") or check("::") then
+        fail(line, "goto is not supported")
+    end
+
+    local e = parse_suffixed()
+    if check("=") or check(",") then
+        local s = { k = "Assign", targets = { e }, line = line }
+        while accept(",") do
+            s.targets[#s.targets + 1] = parse_suffixed()
+        end
+        expect("=")
+        s.exprs = parse_explist()
+        return s
+    end
+
+    if e.k ~= "Call" and e.k ~= "Method" then
+        fail(line, "syntax error near '%s'", tokens[pos].value)
+    end
+    return { k = "CallStat", call = e, line = line }
+end
+
+function parse_block()
+    local list = {}
+    while not block_follows() do
+        if not accept(";") then
+            list[#list + 1] = parse_statement()
+            if list[#list].k == "Return" then
+                break
+            end
+        end
+    end
+    return list
+end
+
+local chunk = parse_block()
+expect("<eof>")
+
+-- code generation ---------------------------------------------------------------------------------------------
+--
+-- every value is a C double, or an int for booleans. names are resolved to symbols:
+--   var    local of the function (or of a block of the top level) being generated, `c` is its C name
+--   value  top level local or global, a member of struct aot_state
+--   array  { ... } of numbers, local or top level, `n` elements
+--   fn     script function, `fn` describes it
+--   math   math.<name>, or a local alias of it
+--   lib    the math and dgfx tables themselves
+-- expressions compile to { c = C expression, t = "num" | "bool" }, and "numfalse" for `cond and num`, which is
+-- only usable as the left side of `or`.
+
+local globals = {}
+local fields = {}    -- struct aot_state members
+local functions = {} -- generated C functions, in the order they were needed
+local queue = {}     -- script functions still to generate
+local uid = 0
+
+local function unique(prefix, name)
+    uid = uid + 1
+    return prefix .. uid .. "_" .. name
+end
+
+local function emit(ctx, line)
+    ctx.lines[#ctx.lines + 1] = string.rep("    ", ctx.depth) .. line
+end
+
+-- adds lines captured at `ctx.depth - extra`
+local function append(ctx, lines, extra)
+    for _, line in ipairs(lines) do
+        ctx.lines[#ctx.lines + 1] = string.rep("    ", extra) .. line
+    end
+end
+
+local function open(ctx, line)
+    if line then
+        emit(ctx, line)
+    end
+    emit(ctx, "{")
+    ctx.depth = ctx.depth + 1
+end
+
+local function close(ctx)
+    ctx.depth = ctx.depth - 1
+    emit(ctx, "}")
+end
+
+-- runs f(ctx, ...) with its lines going to a list of their own, returns that list and what f returned
+local function capture(ctx, f, ...)
+    local saved = ctx.lines
+    ctx.lines = {}
+    local result = f(ctx, ...)
+    local lines = ctx.lines
+    ctx.lines = saved
+    return lines, result
+end
+
+local function number(v)
+    if v ~= v then
+        return "NAN"
+    elseif v == math.huge then
+        return "HUGE_VAL"
+    end
+
+    -- shortest form that reads back as the same double
+    local s
+    for digits = 15, 17 do
+        s = string.format("%." .. digits .. "g", v)
+        if tonumber(s) == v then
+            break
+        end
+    end
+    return s:find("[%.e]") and s or s .. ".0"
+end
+
+local function describe(e)
+    if e.k == "Name" then
+        return e.name
+    elseif e.k == "Index" and e.key.k == "Str" then
+        return describe(e.obj) .. "." .. e.key.v
+    elseif e.k == "Index" then
+        return describe(e.obj) .. "[]"
+    end
+    return "expression"
+end
+
+local function new_function(name, node, chain)
+    if node.vararg then
+        fail(node.line, "%s: varargs are not supported", name)
+    end
+    return { name = name, params = node.params, body = node.body, line = node.line, chain = chain,
+             cname = unique("f", name) }
+end
+
+local function need(fn)
+    if not fn.needed then
+        fn.needed = true
+        queue[#queue + 1] = fn
+    end
+end
+
+-- lexical lookup: the blocks being generated, then the top level locals in scope where the function was defined
+-- (chained newest first), then globals, which functions see as they are after the top level ran
+local function resolve(ctx, name)
+    for i = #ctx.scopes, 1, -1 do
+        if ctx.scopes[i][name] then
+            return ctx.scopes[i][name]
+        end
+    end
+
+    local node = ctx.chain
+    while node do
+        if node.name == name then
+            return node.sym
+        end
+        node = node.parent
+    end
+
+    if globals[name] then
+        return globals[name]
+    elseif name == "math" or name == "dgfx" then
+        return { kind = "lib", lib = name }
+    end
+end
+
+-- how many values a function returns: all its return statements have to agree. nil while that depends on a call
+-- back into a function whose count is being worked out, those returns are left to the others.
+local arity
+
+local function returns_of(block, list)
+    for _, s in ipairs(block) do
+        if s.k == "Return" then
+            list[#list + 1] = s
+        elseif s.k == "If" then
+            for _, b in ipairs(s.blocks) do
+                returns_of(b, list)
+            end
+            returns_of(s.orelse or {}, list)
+        elseif s.k == "Do" or s.k == "While" or s.k == "Repeat" or s.k == "Fornum" then
+            returns_of(s.body, list)
+        end
+    end
+    return list
+end
+
+local function values_of(fn, e)
+    if e.k ~= "Call" or e.fn.k ~= "Name" then
+        return 1
+    end
+
+    local sym = resolve({ scopes = {}, chain = fn.chain }, e.fn.name)
+    if sym and sym.kind == "fn" then
+        return arity(sym.fn)
+    end
+    return 1
+end
+
+function arity(fn)
+    if fn.arity or fn.visiting then
+        return fn.arity
+    end
+
+    fn.visiting = true
+    local n, n_line
+    for _, r in ipairs(returns_of(fn.body, {})) do
+        local k = #r.exprs
+        if k > 0 then
+            local last = values_of(fn, r.exprs[k])
+            k = last and k - 1 + last
+        end
+
+        if k and n and k ~= n then
+            fail(r.line, "%s returns %d values here, but %d on line %d", fn.name, k, n, n_line)
+        end
+        n, n_line = n or k, n_line or (k and r.line)
+    end
+    fn.visiting = false
+
+    fn.arity = n or 0
+    return fn.arity
+end
+
+local math_functions = {
+    abs = "fabs", ceil = "ceil", floor = "floor", sqrt = "sqrt", exp = "exp", log10 = "log10",
+    sin = "sin", cos = "cos", tan = "tan", asin = "asin", acos = "acos", sinh = "sinh", cosh = "cosh", tanh = "tanh",
+    fmod = "fmod", pow = "pow", atan2 = "atan2", ldexp = "aot_ldexp", deg = "aot_deg", rad = "aot_rad",
+    atan = true, log = true, min = true, max = true,
+}
+local math_arity = { fmod = 2, pow = 2, atan2 = 2, ldexp = 2 }
+
+local expr, explist, stmt, block
+
+local function numeric(ctx, e)
+    local v = expr(ctx, e)
+    if v.t == "bool" then
+        fail(e.line, "arithmetic on a boolean")
+    elseif v.t ~= "num" then
+        fail(e.line, "'a and b' is only supported as part of 'a and b or c'")
+    end
+    return v.c
+end
+
+-- `e` as a C condition, without the parentheses around it
+local function cond(ctx, e)
+    local v = expr(ctx, e)
+    local c = v.t == "bool" and v.c or v.t == "numfalse" and v.cond or "1" -- numbers are always true in lua, even 0
+    if c:find("^%b()$") then
+        c = c:sub(2, -2)
+    end
+    return c
+end
+
+-- names and table accesses: the symbol they refer to, or a value for dgfx.*, math constants and array elements
+local function lookup(ctx, e)
+    if e.k == "Name" then
+        local sym = resolve(ctx, e.name)
+        if not sym then
+            fail(e.line, "unknown variable '%s'", e.name)
+        end
+        return sym
+    end
+
+    local obj = (e.obj.k == "Name" or e.obj.k == "Index") and lookup(ctx, e.obj)
+    local key = e.key
+
+    if obj and obj.kind == "lib" and key.k == "Str" then
+        if obj.lib == "math" and key.v == "pi" then
+            return { kind = "const", c = number(math.pi), t = "num" }
+        elseif obj.lib == "math" and key.v == "huge" then
+            return { kind = "const", c = "HUGE_VAL", t = "num" }
+        elseif obj.lib == "math" and math_functions[key.v] then
+            return { kind = "math", name = key.v }
+        elseif obj.lib == "dgfx" and (key.v == "width" or key.v == "height" or key.v == "hdr") then
+            return { kind = "const", c = "S->" .. key.v, t = key.v == "hdr" and "bool" or "num" }
+        end
+    elseif obj and obj.kind == "array" then
+        local i = key.k == "Num" and key.v
+        if not i then
+            fail(e.line, "%s: arrays can only be indexed with constant numbers", describe(e))
+        elseif i ~= math.floor(i) or i < 1 or i > obj.n then
+            fail(e.line, "%s: index %s is outside the array's %d elements", describe(e), number(i), obj.n)
+        end
+        return { kind = "element", c = obj.c .. "[" .. (i - 1) .. "]", t = "num", top = obj.top }
+    end
+
+    fail(e.line, "%s is not supported, only math.*, dgfx.width, height and hdr, and arrays", describe(e))
+end
+
+local function math_call(ctx, name, args, line)
+    local c = {}
+    for i, v in ipairs(args) do
+        if v.t ~= "num" then
+            fail(line, "math.%s: argument %d is not a number", name, i)
+        end
+        c[i] = v.c
+    end
+
+    local n = #c
+    local function check(lo, hi)
+        if n < lo or n > hi then
+            fail(line, "math.%s: wrong number of arguments", name)
+        end
+    end
+
+    if name == "min" or name == "max" then
+        check(1, math.huge)
+        local v = c[1]
+        for i = 2, n do
+            v = "aot_" .. name .. " (" .. v .. ", " .. c[i] .. ")"
+        end
+        return v
+    elseif name == "atan" then
+        -- luajit's math.atan ignores a second argument, it is not lua 5.3's atan2
+        check(1, 2)
+        return "atan (" .. c[1] .. ")"
+    elseif name == "log" then
+        check(1, 2)
+        return (n == 1 and "log (" or "aot_log (") .. table.concat(c, ", ") .. ")"
+    end
+
+    check(math_arity[name] or 1, math_arity[name] or 1)
+    return math_functions[name] .. " (" .. table.concat(c, ", ") .. ")"
+end
+
+-- a call producing `want` values (all of them when nil): a list of values. calls of functions returning more
+-- than one value store them in temporaries first.
+local function call(ctx, e, want)
+    if e.k == "Method" then
+        fail(e.line, "method calls (%s:%s) are not supported", describe(e.obj), e.name)
+    end
+
+    local sym = (e.fn.k == "Name" or e.fn.k == "Index") and lookup(ctx, e.fn)
+    if sym and sym.kind == "math" then
+        return { { c = math_call(ctx, sym.name, explist(ctx, e.args), e.line), t = "num" } }
+    elseif not sym or sym.kind ~= "fn" then
+        fail(e.line, "%s can't be called, only math.* and functions of the script can", describe(e.fn))
+    end
+
+    local fn = sym.fn
+    need(fn)
+
+    local args = { "S" }
+    for i, v in ipairs(explist(ctx, e.args, #fn.params)) do
+        if v.t == "nil" then
+            fail(e.line, "%s takes %d arguments, it is called with fewer", fn.name, #fn.params)
+        elseif v.t ~= "num" then
+            fail(e.line, "%s: argument %d is not a number", fn.name, i)
+        end
+        args[#args + 1] = v.c
+    end
+
+    local n = arity(fn)
+    local results = math.min(want or n, n)
+    if want ~= 0 and n == 0 then
+        fail(e.line, "%s returns no value", fn.name)
+    end
+
+    local temps = {}
+    for i = 1, results do
+        temps[i] = unique("t", fn.name)
+    end
+    for i = 2, n do
+        if i > results then
+            ctx.discard = true
+        end
+        args[#args + 1] = i <= results and "&" .. temps[i] or "&aot_discard"
+    end
+
+    local c = fn.cname .. " (" .. table.concat(args, ", ") .. ")"
+    if results <= 1 then
+        return { { c = c, t = "num" } }
+    end
+
+    emit(ctx, "double " .. table.concat(temps, ", ", 2) .. ";")
+    emit(ctx, "double " .. temps[1] .. " = " .. c .. ";")
+
+    local values = {}
+    for i = 1, results do
+        values[i] = { c = temps[i], t = "num" }
+    end
+    return values
+end
+
+local function script_call(ctx, e)
+    if e.k ~= "Call" or e.fn.k ~= "Name" then
+        return false
+    end
+    local sym = resolve(ctx, e.fn.name)
+    return sym and sym.kind == "fn"
+end
+
+-- `want` values (all of them when nil) from a list of expressions, the last one expanded when it is a call.
+-- missing values are nil.
+function explist(ctx, exprs, want)
+    local values = {}
+    for i, e in ipairs(exprs) do
+        if i == #exprs and script_call(ctx, e) and (not want or want > i) then
+            for _, v in ipairs(call(ctx, e, want and want - i + 1)) do
+                values[#values + 1] = v
+            end
+        else
+            values[#values + 1] = expr(ctx, e)
+        end
+    end
+
+    for i = #values + 1, want or 0 do
+        values[i] = { c = "0.0", t = "nil" }
+    end
+    for i = (want or #values) + 1, #values do
+        values[i] = nil
+    end
+    return values
+end
+
+local comparisons = { ["<"] = "<", [">"] = ">", ["<="] = "<=", [">="] = ">=", ["=="] = "==", ["~="] = "!=" }
+
+function expr(ctx, e)
+    local k = e.k
+
+    if k == "Num" then
+        return { c = number(e.v), t = "num" }
+    elseif k == "true" or k == "false" then
+        return { c = k == "true" and "1" or "0", t = "bool" }
+    elseif k == "Paren" then
+        return expr(ctx, e.e)
+    elseif k == "Name" or k == "Index" then
+        local sym = lookup(ctx, e)
+        if sym.kind == "var" or sym.kind == "value" or sym.kind == "const" or sym.kind == "element" then
+            return { c = sym.c, t = sym.t }
+        end
+        fail(e.line, "%s can only be called or indexed, not used as a value", describe(e))
+    elseif k == "Call" or k == "Method" then
+        return call(ctx, e, 1)[1]
+    elseif k == "Un" and e.op == "-" then
+        return { c = "(-" .. numeric(ctx, e.e) .. ")", t = "num" }
+    elseif k == "Un" and e.op == "not" then
+        local v = expr(ctx, e.e)
+        if v.t == "num" then
+            return { c = "0", t = "bool" }
+        end
+        return { c = "(!" .. (v.t == "bool" and v.c or v.cond) .. ")", t = "bool" }
+    elseif k == "Un" then -- #
+        local sym = (e.e.k == "Name" or e.e.k == "Index") and lookup(ctx, e.e)
+        if not sym or sym.kind ~= "array" then
+            fail(e.line, "# is only supported on arrays")
+        end
+        return { c = number(sym.n), t = "num" }
+    elseif k == "Bin" and comparisons[e.op] then
+        local a, b = expr(ctx, e.a), expr(ctx, e.b)
+        if a.t ~= b.t or (a.t ~= "num" and (a.t ~= "bool" or (e.op ~= "==" and e.op ~= "~="))) then
+            fail(e.line, "'%s' is only supported between two numbers (or two booleans, for == and ~=)", e.op)
+        end
+        return { c = "(" .. a.c .. " " .. comparisons[e.op] .. " " .. b.c .. ")", t = "bool" }
+    elseif k == "Bin" and e.op == "and" then
+        local a, b = expr(ctx, e.a), expr(ctx, e.b)
+        if a.t == "num" then -- always true
+            return b
+        elseif a.t == "bool" and b.t == "bool" then
+            return { c = "(" .. a.c .. " && " .. b.c .. ")", t = "bool" }
+        elseif a.t == "bool" and b.t == "num" then
+            return { t = "numfalse", cond = a.c, val = b.c }
+        end
+    elseif k == "Bin" and e.op == "or" then
+        local a, b = expr(ctx, e.a), expr(ctx, e.b)
+        if a.t == "num" then
+            return a
+        elseif a.t == "bool" and b.t == "bool" then
+            return { c = "(" .. a.c .. " || " .. b.c .. ")", t = "bool" }
+        elseif a.t == "numfalse" and b.t == "num" then
+            return { c = "(" .. a.cond .. " ? " .. a.val .. " : " .. b.c .. ")", t = "num" }
+        end
+    elseif k == "Bin" and e.op == ".." then
+        fail(e.line, "strings are not supported")
+    elseif k == "Bin" then
+        local a, b = numeric(ctx, e.a), numeric(ctx, e.b)
+        if e.op == "%" then
+            return { c = "aot_mod (" .. a .. ", " .. b .. ")", t = "num" }
+        elseif e.op == "^" then
+            return { c = "pow (" .. a .. ", " .. b .. ")", t = "num" }
+        end
+        return { c = "(" .. a .. " " .. e.op .. " " .. b .. ")", t = "num" }
+    elseif k == "nil" then
+        fail(e.line, "nil is not supported")
+    elseif k == "Str" then
+        fail(e.line, "strings are not supported")
+    elseif k == "..." then
+        fail(e.line, "varargs are not supported")
+    elseif k == "Func" then
+        fail(e.line, "anonymous functions are not supported")
+    elseif k == "Table" then
+        fail(e.line, "tables are only supported as arrays of numbers assigned to a local")
+    end
+
+    fail(e.line, "'%s' mixing numbers and booleans is not supported", e.op)
+end
+
+-- the top level's own locals become members of struct aot_state, anything declared in a block is a C local
+local function at_top(ctx)
+    return ctx.top and #ctx.scopes == 0
+end
+
+local function declare(ctx, name, sym)
+    if at_top(ctx) then
+        ctx.chain = { name = name, sym = sym, parent = ctx.chain }
+    else
+        ctx.scopes[#ctx.scopes][name] = sym
+    end
+end
+
+local function type_of(value, line)
+    if value.t == "numfalse" then
+        fail(line, "'a and b' is only supported as part of 'a and b or c'")
+    end
+    return value.t == "nil" and "num" or value.t -- a local declared without a value becomes a number
+end
+
+-- storage for a new number or boolean holding `value`, or an array of `values`: a symbol for it
+local function variable(ctx, name, value, values, line)
+    local t = values and "num" or type_of(value, line)
+    local ctype = t == "bool" and "int " or "double "
+    local dims = values and "[" .. #values .. "]" or ""
+
+    local sym
+    if at_top(ctx) then
+        local c = unique("g", name)
+        fields[#fields + 1] = ctype .. c .. dims .. ";"
+        sym = { kind = values and "array" or "value", c = "S->" .. c, t = t, n = values and #values, top = true }
+    else
+        sym = { kind = values and "array" or "var", c = unique("l", name), t = t, n = values and #values }
+    end
+
+    if values then
+        local c = {}
+        for i, v in ipairs(values) do
+            if v.t ~= "num" then
+                fail(line, "arrays can only hold numbers")
+            end
+            c[i] = v.c
+        end
+
+        if sym.top then
+            for i = 1, #c do
+                emit(ctx, sym.c .. "[" .. (i - 1) .. "] = " .. c[i] .. ";")
+            end
+        else
+            emit(ctx, ctype .. sym.c .. dims .. " = { " .. table.concat(c, ", ") .. " };")
+        end
+    else
+        emit(ctx, (sym.top and "" or ctype) .. sym.c .. " = " .. value.c .. ";")
+    end
+
+    return sym
+end
+
+local function assign(ctx, sym, value, line)
+    local t = type_of(value, line)
+    if t ~= sym.t then
+        fail(line, "a %s variable can't be assigned a %s", sym.t == "bool" and "boolean" or "number",
+             t == "bool" and "boolean" or "number")
+    end
+    emit(ctx, sym.c .. " = " .. value.c .. ";")
+end
+
+-- `local f = math.sin`, `local f = helper`: an alias, nothing to store
+local function alias(ctx, e)
+    if e.k ~= "Name" and e.k ~= "Index" then
+        return nil
+    end
+
+    local ok, sym = pcall(lookup, ctx, e)
+    return ok and (sym.kind == "fn" or sym.kind == "math") and sym or nil
+end
+
+local function stmt_local(ctx, s)
+    if #s.names == 1 and #s.exprs == 1 and s.exprs[1].k == "Table" then
+        local exprs = {}
+        for i, item in ipairs(s.exprs[1].items) do
+            if item.key then
+                fail(s.line, "tables with keys are not supported, only arrays of numbers")
+            end
+            exprs[i] = item.val
+        end
+
+        local values = explist(ctx, exprs)
+        if #values == 0 then
+            fail(s.line, "empty tables are not supported")
+        end
+
+        declare(ctx, s.names[1], variable(ctx, s.names[1], nil, values, s.line))
+        return
+    end
+
+    local aliases = {}
+    for i, e in ipairs(s.exprs) do
+        aliases[i] = alias(ctx, e)
+    end
+    if #aliases == #s.names and #aliases == #s.exprs then
+        for i, name in ipairs(s.names) do
+            declare(ctx, name, aliases[i])
+        end
+        return
+    end
+
+    -- values first: they see the names being declared as they were before
+    local values = explist(ctx, s.exprs, #s.names)
+    local syms = {}
+    for i, name in ipairs(s.names) do
+        syms[i] = variable(ctx, name, values[i], nil, s.line)
+    end
+    for i, name in ipairs(s.names) do
+        declare(ctx, name, syms[i])
+    end
+end
+
+local function stmt_assign(ctx, s)
+    local targets = {}
+    for i, e in ipairs(s.targets) do
+        local sym
+        if e.k == "Name" and not resolve(ctx, e.name) then
+            sym = {} -- global that does not exist yet
+        elseif e.k == "Name" or e.k == "Index" then
+            sym = lookup(ctx, e)
+        else
+            fail(s.line, "only variables and array elements can be assigned")
+        end
+
+        if sym.kind == nil and ctx.top then
+            targets[i] = { name = e.name }
+        elseif sym.kind == nil then
+            fail(s.line, "%s: functions can't create globals", e.name)
+        elseif sym.kind == "var" or (sym.kind == "element" and not sym.top) then
+            targets[i] = sym
+        elseif (sym.kind == "value" or sym.kind == "element") and ctx.top then
+            targets[i] = sym
+        elseif sym.kind == "value" or sym.kind == "element" then
+            fail(s.line, "%s: functions can only assign their own locals, not globals or top level locals",
+                 describe(e))
+        else
+            fail(s.line, "%s can't be assigned", describe(e))
+        end
+    end
+
+    local values = explist(ctx, s.exprs, #targets)
+
+    -- lua evaluates all values before assigning any
+    if #targets > 1 then
+        for i, v in ipairs(values) do
+            if v.t == "num" or v.t == "bool" then
+                local temp = unique("t", "assign")
+                emit(ctx, (v.t == "bool" and "int " or "double ") .. temp .. " = " .. v.c .. ";")
+                values[i] = { c = temp, t = v.t }
+            end
+        end
+    end
+
+    for i, target in ipairs(targets) do
+        if target.name then
+            local sym = globals[target.name]
+            if sym and sym.kind == "value" then
+                assign(ctx, sym, values[i], s.line)
+            else
+                local saved = ctx.scopes
+                ctx.scopes = {} -- at_top: globals are members of struct aot_state too
+                globals[target.name] = variable(ctx, target.name, values[i], nil, s.line)
+                ctx.scopes = saved
+            end
+        else
+            assign(ctx, target, values[i], s.line)
+        end
+    end
+end
+
+-- runs `before` once the block's scope exists and `after` before it goes away
+function block(ctx, stmts, before, after)
+    ctx.scopes[#ctx.scopes + 1] = {}
+    if before then
+        before()
+    end
+    for _, s in ipairs(stmts) do
+        stmt(ctx, s)
+    end
+    if after then
+        after()
+    end
+    ctx.scopes[#ctx.scopes] = nil
+end
+
+local function stmt_fornum(ctx, s)
+    local loop = unique("i", s.var)
+    local limit = unique("limit", s.var)
+
+    open(ctx)
+    emit(ctx, "double " .. loop .. " = " .. numeric(ctx, s.start) .. ";")
+    emit(ctx, "double " .. limit .. " = " .. numeric(ctx, s.limit) .. ";")
+
+    local step = s.step and s.step.k == "Un" and s.step.op == "-" and s.step.e.k == "Num" and -s.step.e.v
+                 or s.step and s.step.k == "Num" and s.step.v or not s.step and 1
+    local test
+    if step then
+        test = loop .. (step >= 0 and " <= " or " >= ") .. limit
+        step = number(step)
+    else
+        local c = numeric(ctx, s.step)
+        step = unique("step", s.var)
+        emit(ctx, "double " .. step .. " = " .. c .. ";")
+        test = "(" .. step .. " > 0 ? " .. loop .. " <= " .. limit .. " : " .. loop .. " >= " .. limit .. ")"
+    end
+
+    open(ctx, "for (; " .. test .. "; " .. loop .. " += " .. step .. ")")
+    block(ctx, s.body, function()
+        declare(ctx, s.var, variable(ctx, s.var, { c = loop, t = "num" }))
+    end)
+    close(ctx)
+    close(ctx)
+end
+
+local function stmt_if(ctx, s)
+    local nested = 0
+    for i, e in ipairs(s.conds) do
+        local lines, c = capture(ctx, cond, e)
+        local keyword = i > 1 and "else " or ""
+        if #lines > 0 and i > 1 then -- the condition needs statements of its own first
+            open(ctx, "else")
+            nested = nested + 1
+            append(ctx, lines, 1)
+            keyword = ""
+        else
+            append(ctx, lines, 0)
+        end
+
+        open(ctx, keyword .. "if (" .. c .. ")")
+        block(ctx, s.blocks[i])
+        close(ctx)
+    end
+
+    if s.orelse then
+        open(ctx, "else")
+        block(ctx, s.orelse)
+        close(ctx)
+    end
+
+    for _ = 1, nested do
+        close(ctx)
+    end
+end
+
+local function stmt_while(ctx, s)
+    ctx.depth = ctx.depth + 1
+    local lines, c = capture(ctx, cond, s.cond)
+    ctx.depth = ctx.depth - 1
+
+    if #lines == 0 then
+        open(ctx, "while (" .. c .. ")")
+    else
+        open(ctx, "for (;;)")
+        append(ctx, lines, 0)
+        emit(ctx, "if (!(" .. c .. "))")
+        emit(ctx, "    break;")
+    end
+    block(ctx, s.body)
+    close(ctx)
+end
+
+local function stmt_repeat(ctx, s)
+    open(ctx, "for (;;)")
+    block(ctx, s.body, nil, function() -- the condition sees the body's locals
+        emit(ctx, "if (" .. cond(ctx, s.cond) .. ")")
+        emit(ctx, "    break;")
+    end)
+    close(ctx)
+end
+
+local function stmt_return(ctx, s)
+    if not ctx.fn then
+        fail(s.line, "return at the top level is not supported")
+    end
+
+    local n = arity(ctx.fn)
+    local values = explist(ctx, s.exprs, n)
+    for i, v in ipairs(values) do
+        if v.t ~= "num" then
+            fail(s.line, "%s: return value %d is not a number", ctx.fn.name, i)
+        end
+        if i > 1 then
+            emit(ctx, "*r" .. (i - 1) .. " = " .. v.c .. ";")
+        end
+    end
+    emit(ctx, "return " .. (values[1] and values[1].c or "0.0") .. ";")
+end
+
+function stmt(ctx, s)
+    local k = s.k
+    if k == "Local" then
+        stmt_local(ctx, s)
+    elseif k == "Assign" then
+        stmt_assign(ctx, s)
+    elseif k == "CallStat" then
+        local results = call(ctx, s.call, 0)
+        if script_call(ctx, s.call) then
+            emit(ctx, results[1].c .. ";")
+        end
+    elseif k == "Do" then
+        open(ctx)
+        block(ctx, s.body)
+        close(ctx)
+    elseif k == "If" then
+        stmt_if(ctx, s)
+    elseif k == "While" then
+        stmt_while(ctx, s)
+    elseif k == "Repeat" then
+        stmt_repeat(ctx, s)
+    elseif k == "Fornum" then
+        stmt_fornum(ctx, s)
+    elseif k == "Forin" then
+        fail(s.line, "generic for loops (pairs, ipairs) are not supported")
+    elseif k == "Break" then
+        emit(ctx, "break;")
+    elseif k == "Return" then
+        stmt_return(ctx, s)
+    elseif not at_top(ctx) then
+        fail(s.line, "functions can only be defined at the top level")
+    elseif k == "LocalFunction" then
+        local fn = new_function(s.name, s)
+        declare(ctx, s.name, { kind = "fn", fn = fn })
+        fn.chain = ctx.chain -- sees itself
+    elseif #s.path > 1 or s.method then
+        fail(s.line, "functions can only be stored in plain variables, not tables")
+    else
+        globals[s.path[1]] = { kind = "fn", fn = new_function(s.path[1], s, ctx.chain) }
+    end
+end
+
+local function generate(fn)
+    local ctx = { lines = {}, depth = 1, scopes = { {} }, chain = fn.chain, fn = fn }
+
+    local params = { "const struct aot_state *restrict S" }
+    for _, name in ipairs(fn.params) do
+        local c = unique("l", name)
+        params[#params + 1] = "double " .. c
+        ctx.scopes[1][name] = { kind = "var", c = c, t = "num" }
+    end
+    for i = 1, arity(fn) - 1 do
+        params[#params + 1] = "double *r" .. i
+    end
+
+    block(ctx, fn.body)
+
+    -- falling off the end returns nothing, callers can't have used that
+    local last = fn.body[#fn.body]
+    if not last or last.k ~= "Return" then
+        emit(ctx, "return 0.0;")
+    end
+    if ctx.discard then
+        table.insert(ctx.lines, 1, "    double aot_discard;")
+    end
+
+    local head = "static double\n" .. fn.cname .. " (" .. table.concat(params, ", ") .. ")"
+    functions[#functions + 1] = { proto = head:gsub("\n", " ") .. ";",
+                                  def = head .. "\n{\n" .. table.concat(ctx.lines, "\n") .. "\n}\n" }
+end
+
+-- the top level becomes the plugin's init(), run by every worker
+local top = { lines = {}, depth = 1, scopes = {}, top = true }
+for _, s in ipairs(chunk) do
+    stmt(top, s)
+end
+
+for _, hook in ipairs({ "frame", "rgb_row", "setup", "shade" }) do
+    if globals[hook] and globals[hook].kind == "fn" then
+        fail(globals[hook].fn.line, "%s() is not supported, only rgb(n, m, t)", hook)
+    end
+end
+
+local rgb = globals.rgb and globals.rgb.fn
+if not rgb then
+    fail(1, "no rgb(n, m, t) function")
+elseif #rgb.params > 3 then
+    fail(rgb.line, "rgb takes %d arguments, only n, m and t are supported", #rgb.params)
+elseif arity(rgb) ~= 3 then
+    fail(rgb.line, "rgb returns %d values instead of r, g and b", arity(rgb))
+end
+need(rgb)
+
+local i = 1
+while queue[i] do
+    generate(queue[i])
+    i = i + 1
+end
+
+local rgb_args = { "S", "x0 + x", "y0 + y", "t" }
+for j = #rgb.params + 2, #rgb_args do
+    rgb_args[j] = nil
+end
+
+local c = {}
+local function add(text)
+    c[#c + 1] = text
+end
+
+add("// generated by dgfx --aot from " .. script .. ", see resources/lua/aot.lua\n")
+add("#include <math.h>\n#include <stdint.h>\n#include <stdlib.h>\n\n#include \"dgfx_plugin.h\"\n\n")
+add("struct aot_state\n{\n    double width, height;\n    int hdr;\n")
+for _, field in ipairs(fields) do
+    add("    " .. field .. "\n")
+end
+add("};\n\n")
+add([[
+// lua's modulo takes the sign of the divisor, fmod() the dividend's
+static inline double
+aot_mod (double a, double b)
+{
+    return a - floor (a / b) * b;
+}
+
+// the operand order of luajit's minsd/maxsd: the second value wins ties, signed zeros and NaNs
+static inline double
+aot_min (double a, double b)
+{
+    return a < b ? a : b;
+}
+
+static inline double
+aot_max (double a, double b)
+{
+    return a > b ? a : b;
+}
+
+static inline double
+aot_log (double x, double base)
+{
+    /* same as luajit's lib_math.c, so math.log (x, 2) and math.log (x, 10) stay exact */
+    return log2 (x) * (1.0 / log2 (base));
+}
+
+static inline double
+aot_ldexp (double x, double e)
+{
+    return ldexp (x, (int)e);
+}
+
+static inline double
+aot_deg (double x)
+{
+    return x * (180.0 / 3.141592653589793);
+}
+
+static inline double
+aot_rad (double x)
+{
+    return x * (3.141592653589793 / 180.0);
+}
+
+// the ffi write path clamps r * 255 to [0, 255] (NaN gives 0) and stores it through a uint8_t pointer, truncated.
+// dgfx_quantize_tile clamps and rounds, so it gets that byte over 255, which it rounds back to the same byte.
+// with --hdr the values are passed on as they are.
+static inline float
+aot_out (const struct aot_state *S, double v)
+{
+    if (S->hdr)
+        return (float)v;
+
+    double x = v * 255.0;
+    x = x > 0.0 ? x : 0.0;
+    x = x < 255.0 ? x : 255.0;
+    return (uint8_t)x / 255.0f;
+}
+
+]])
+for _, f in ipairs(functions) do
+    add(f.proto .. "\n")
+end
+add("\n")
+for _, f in ipairs(functions) do
+    add(f.def .. "\n")
+end
+
+if top.discard then
+    table.insert(top.lines, 1, "    double aot_discard;")
+end
+add([[
+static int
+aot_init (const struct dgfx_plugin_info *info, void **state)
+{
+    struct aot_state *S = calloc (1, sizeof (*S));
+    if (!S)
+        return 1;
+
+    S->width = info->width;
+    S->height = info->height;
+    S->hdr = info->hdr;
+
+]] .. table.concat(top.lines, "\n") .. (#top.lines > 0 and "\n\n" or "") .. [[
+    *state = S;
+    return 0;
+}
+
+static void
+aot_fini (void *state)
+{
+    free (state);
+}
+
+static int
+aot_shade_tile (void *state, double t, uint32_t x0, uint32_t y0, uint32_t w, uint32_t h, float *dst, size_t pitch)
+{
+    const struct aot_state *S = state;
+    (void)t;
+
+    for (uint32_t y = 0; y < h; ++y, dst += pitch)
+    {
+        for (uint32_t x = 0; x < w; ++x)
+        {
+            double g, b;
+            double r = ]] .. rgb.cname .. " (" .. table.concat(rgb_args, ", ") .. (", &g, &b);\n") .. [[
+            dst[x * 4 + 0] = aot_out (S, r);
+            dst[x * 4 + 1] = aot_out (S, g);
+            dst[x * 4 + 2] = aot_out (S, b);
+        }
+    }
+
+    return 0;
+}
+
+const struct dgfx_plugin dgfx_plugin = {
+    .abi = DGFX_PLUGIN_ABI,
+    .name = "]] .. script:gsub("[\\\"]", "\\%0") .. [[",
+    .init = aot_init,
+    .fini = aot_fini,
+    .shade_tile = aot_shade_tile,
+};
+]])
+
+return table.concat(c)
@@ -0,0 +1,326 @@
+-- dgfx.math: noise and color functions implemented in C (dgfx_math.c), called through the ffi, plus dgfx.shared
+-- and dgfx.lut, data built once and kept in C for every worker. called with a pointer to the C functions and the
+-- cdef declaring them, returns the three as scripts see them.
+--
+-- noise functions are the C functions themselves: math.perlin3(x, y, z) compiles to a direct call. colors come
+-- back as three values, palettes are built once and called per pixel. every function also has a batch variant,
+-- suffixed _n, taking ffi arrays (see array) and a count, for rgb_row and other loops over many pixels.
+local ffi = require("ffi")
+local api, cdef = ...
+
+ffi.cdef(cdef)
+local C = ffi.cast("const struct dgfx_math *", api)
+
+local M = {}
+
+for _, name in ipairs({ "perlin2", "perlin3", "perlin4", "simplex2", "simplex3", "simplex4", "value2", "value3",
+                        "value4", "worley2", "worley3" }) do
+    M[name] = C[name]
+    M[name .. "_n"] = C[name .. "_n"]
+end
+
+-- fbm2(x, y[, octaves[, lacunarity[, gain]]]), the usual 5 octaves doubling in frequency and halving in
+-- amplitude by default
+local fbm2, fbm3, fbm4 = C.fbm2, C.fbm3, C.fbm4
+
+function M.fbm2(x, y, octaves, lacunarity, gain)
+    return fbm2(x, y, octaves or 5, lacunarity or 2, gain or 0.5)
+end
+
+function M.fbm3(x, y, z, octaves, lacunarity, gain)
+    return fbm3(x, y, z, octaves or 5, lacunarity or 2, gain or 0.5)
+end
+
+function M.fbm4(x, y, z, w, octaves, lacunarity, gain)
+    return fbm4(x, y, z, w, octaves or 5, lacunarity or 2, gain or 0.5)
+end
+
+M.fbm2_n, M.fbm3_n, M.fbm4_n = C.fbm2_n, C.fbm3_n, C.fbm4_n
+
+-- h, s, v -> r, g, b and so on. the result goes through one buffer per state, which the jit keeps in registers
+local out = ffi.new("double[3]")
+
+for _, name in ipairs({ "hsv2rgb", "rgb2hsv", "hsl2rgb", "rgb2hsl", "oklab2rgb", "rgb2oklab" }) do
+    local f = C[name]
+    M[name] = function(a, b, c)
+        f(a, b, c, out)
+        return out[0], out[1], out[2]
+    end
+    M[name .. "_n"] = C[name .. "_n"]
+end
+
+-- palette(a, b, c, d) with {r, g, b} tables returns a function of t giving a + b * cos(2 pi (c * t + d)), see
+-- https://iquilezles.org/articles/palettes/. the function's second return value holds the 12 coefficients for
+-- palette_n(n, t, abcd, out).
+local palette = C.palette
+
+function M.palette(a, b, c, d)
+    local abcd = ffi.new("double[12]", a[1], a[2], a[3], b[1], b[2], b[3], c[1], c[2], c[3], d[1], d[2], d[3])
+    return function(t)
+        palette(t, abcd, out)
+        return out[0], out[1], out[2]
+    end, abcd
+end
+
+M.palette_n = C.palette_n
+
+-- n doubles for the batch variants, zeroed. colors take 3 per pixel.
+local double_array = ffi.typeof("double[?]")
+
+function M.array(n)
+    return double_array(n)
+end
+
+-- small helpers stay in lua, where the jit inlines them. a call into C would cost more than they do.
+function M.fract(x)
+    return x - math.floor(x)
+end
+
+function M.clamp(x, lo, hi)
+    return math.min(math.max(x, lo), hi)
+end
+
+function M.mix(a, b, t)
+    return a + (b - a) * t
+end
+
+-- value from [a, b] to [c, d]
+function M.map(v, a, b, c, d)
+    return c + (v - a) * (d - c) / (b - a)
+end
+
+function M.smoothstep(e0, e1, x)
+    local t = M.clamp((x - e0) / (e1 - e0), 0, 1)
+    return t * t * (3 - 2 * t)
+end
+
+-- dgfx.shared(ctype, n, build) returns a const pointer to n elements of ctype ("float", "uint8_t", a struct
+-- declared with ffi.cdef ...) in a page-aligned block kept in C. build(p, n) fills it through p, a writable
+-- pointer, in the first state to get to a script's nth dgfx.shared or dgfx.lut call. every other state is
+-- handed the same block without running build: a big precomputed field is built and stored once however many
+-- workers there are, so build must not depend on dgfx.worker. the block is read-only once built.
+local block_index = 0
+local block_building = false
+local fill_out = ffi.new("int[1]")
+
+-- the script's next block, `size` bytes built by build(p) with p cast to `ptr`. errors are raised for the
+-- caller's caller, the script.
+local function block(what, size, ptr, build)
+    if block_building then
+        error(what .. ": can't make a block while building another one", 3)
+    end
+
+    local index = block_index
+    block_index = block_index + 1
+    local data = C.block_acquire(index, size, fill_out)
+    if data == nil then
+        error(fill_out[0] < 0 and what .. ": the block has another size in another worker, it must not depend on it"
+              or what .. ": out of memory", 3)
+    end
+
+    if fill_out[0] == 1 then
+        block_building = true
+        local ok, err = pcall(build, ffi.cast(ptr, data))
+        block_building = false
+        C.block_release(index, ok and 1 or 0)
+        if not ok then
+            error(what .. ": " .. tostring(err), 3)
+        end
+    end
+
+    return data
+end
+
+local function shared(ctype, n, build)
+    local ok, ct = pcall(ffi.typeof, ctype)
+    if not ok then
+        error("dgfx.shared: " .. tostring(ct), 2)
+    end
+    if type(n) ~= "number" or n < 1 or n ~= math.floor(n) then
+        error("dgfx.shared: n must be a whole number above 0", 2)
+    end
+    if type(build) ~= "function" then
+        error("dgfx.shared: build must be a function", 2)
+    end
+
+    local size = ffi.sizeof(ct)
+    if not size or size == 0 then
+        error("dgfx.shared: " .. tostring(ct) .. " has no fixed size", 2)
+    end
+
+    local data = block("dgfx.shared", size * n, ffi.typeof("$ *", ct), function(p)
+        build(p, n)
+    end)
+    return ffi.cast(ffi.typeof("const $ *", ct), data)
+end
+
+-- dgfx.lut(f[, opts]) samples f once into a table of floats kept in C, and returns a function looking values up
+-- in it, interpolated: cheaper than calling f when f does a few sin/cos/pow. opts, all optional:
+--   size    samples, 256 by default. {w, h} makes a 2D table of f(x, y), looked up with two arguments
+--   from    start of the domain sampled, 0 (or {x, y})
+--   to      end of it, 1 (or {x, y})
+--   filter  "linear" or "cubic" (catmull-rom, through the samples)
+--   wrap    "clamp": outside the domain is the edge value, or "repeat": f is periodic, from and to meet
+-- f returns 1 to 4 numbers, the lookup returns as many. the table comes back as a second value, a const float *
+-- of w * h samples of that many channels each.
+--
+-- the table is a dgfx.shared block: sampled by one state, read by all, so f must not depend on dgfx.worker.
+
+local function lut_axis(opts, key, i, default)
+    local v = opts[key]
+    if type(v) == "table" then
+        v = v[i]
+    end
+    return v == nil and default or v
+end
+
+-- the body of a lookup, in 1 or 2 dimensions. $-names are filled in per table. taps are the samples weighed
+-- together on each axis: 2 for linear, 4 for cubic.
+local lut_head = [[
+    local data, nx, ny, x0, y0, sx, sy = ...
+    local floor, min, max = math.floor, math.min, math.max
+    return function($ARGS)
+        $AXES
+        return $SUMS
+    end
+]]
+
+local lut_axis_src = {
+    clamp = [[
+        local u$A = min(max(($A - $A0) * s$A, 0), n$A - 1)
+        local i$A = floor(u$A)
+        local f$A = u$A - i$A
+        $TAPS
+    ]],
+    ["repeat"] = [[
+        local u$A = ($A - $A0) * s$A
+        local i$A = floor(u$A)
+        local f$A = u$A - i$A
+        i$A = i$A % n$A
+        $TAPS
+    ]],
+}
+
+-- tap k's index on axis a, k from `first`
+local function lut_tap(a, wrap, k)
+    if k == 0 then
+        return "i" .. a
+    end
+    if wrap == "repeat" then
+        return string.format("(i%s + %d) %% n%s", a, k, a)
+    end
+    return k < 0 and string.format("max(i%s %d, 0)", a, k) or string.format("min(i%s + %d, n%s - 1)", a, k, a)
+end
+
+local lut_weights = {
+    linear = { "1 - f$A", "f$A" },
+    cubic = { "f$A * (-0.5 + f$A * (1 - 0.5 * f$A))", "1 + f$A * f$A * (-2.5 + 1.5 * f$A)",
+              "f$A * (0.5 + f$A * (2 - 1.5 * f$A))", "f$A * f$A * (-0.5 + 0.5 * f$A)" },
+}
+
+local function lut_lookup(data, n, lo, hi, channels, filter, wrap)
+    local weights = lut_weights[filter]
+    local first = filter == "cubic" and -1 or 0
+    local axes, names = {}, { "x", "y" }
+    local taps = {} -- per axis: { index expression, weight } ...
+
+    for d = 1, #n do
+        local a = names[d]
+        local lines = {}
+        taps[d] = {}
+        for k = 1, #weights do
+            local idx, w = "i" .. a .. k, "w" .. a .. k
+            lines[#lines + 1] = string.format("local %s, %s = %s, %s", idx, w, lut_tap(a, wrap, first + k - 1),
+                                              weights[k]:gsub("%$A", a))
+            taps[d][k] = { idx, w }
+        end
+        local src = lut_axis_src[wrap]:gsub("%$A", a)
+        axes[d] = src:gsub("%$(TAPS)", { TAPS = table.concat(lines, "\n        ") })
+    end
+
+    local sums = {}
+    for c = 0, channels - 1 do
+        local terms = {}
+        for _, tx in ipairs(taps[1]) do
+            for _, ty in ipairs(taps[2] or { { "0", "1" } }) do
+                terms[#terms + 1] = string.format("%s * %s * data[(%s * nx + %s) * %d + %d]", tx[2], ty[2], ty[1], tx[1],
+                                                  channels, c)
+            end
+        end
+        sums[c + 1] = table.concat(terms, " + ")
+    end
+
+    local src = lut_head:gsub("%$(%u+)", { ARGS = table.concat(names, ", ", 1, #n), AXES = table.concat(axes, "\n"),
+                                          SUMS = table.concat(sums, ",\n            ") })
+    local gen = assert(loadstring(src, "=dgfx.lut"))
+
+    -- samples per unit of the domain: clamped tables have samples on both ends, repeating ones leave out `to`,
+    -- which is `from` again
+    local s = {}
+    for d = 1, 2 do
+        local steps = (n[d] or 1) - (wrap == "clamp" and 1 or 0)
+        s[d] = hi[d] and hi[d] ~= lo[d] and steps / (hi[d] - lo[d]) or 0
+    end
+    return gen(data, n[1], n[2] or 1, lo[1], lo[2] or 0, s[1], s[2])
+end
+
+local function lut(f, opts)
+    opts = opts or {}
+    if type(f) ~= "function" then
+        error("dgfx.lut: f must be a function", 2)
+    end
+    local dims = type(opts.size) == "table" and 2 or 1
+    local n, lo, hi = {}, {}, {}
+    for d = 1, dims do
+        n[d] = lut_axis(opts, "size", d, 256)
+        lo[d] = lut_axis(opts, "from", d, 0)
+        hi[d] = lut_axis(opts, "to", d, 1)
+        if type(n[d]) ~= "number" or n[d] ~= math.floor(n[d]) or n[d] < 2 or n[d] > 2 ^ 24 then
+            error("dgfx.lut: size must be whole numbers from 2 to 2^24", 2)
+        end
+        if type(lo[d]) ~= "number" or type(hi[d]) ~= "number" or lo[d] == hi[d] then
+            error("dgfx.lut: from and to must be different numbers", 2)
+        end
+    end
+
+    local filter, wrap = opts.filter or "linear", opts.wrap or "clamp"
+    if not lut_weights[filter] then
+        error("dgfx.lut: filter must be \"linear\" or \"cubic\"", 2)
+    end
+    if not lut_axis_src[wrap] then
+        error("dgfx.lut: wrap must be \"clamp\" or \"repeat\"", 2)
+    end
+
+    -- the sample positions, the same in every state
+    local step = {}
+    for d = 1, dims do
+        step[d] = (hi[d] - lo[d]) / (n[d] - (wrap == "clamp" and 1 or 0))
+    end
+
+    local channels = select("#", f(lo[1], lo[2]))
+    if channels < 1 or channels > 4 then
+        error(string.format("dgfx.lut: f returns %d values, it may return 1 to 4", channels), 2)
+    end
+
+    local data = block("dgfx.lut", n[1] * (n[2] or 1) * channels * ffi.sizeof("float"), "float *", function(p)
+        local o = 0
+        for j = 0, (n[2] or 1) - 1 do
+            local y = dims == 2 and lo[2] + j * step[2] or nil
+            for i = 0, n[1] - 1 do
+                local v = { f(lo[1] + i * step[1], y) }
+                for c = 1, channels do
+                    if type(v[c]) ~= "number" then
+                        error(string.format("f returned a %s as value %d", type(v[c]), c), 0)
+                    end
+                    p[o] = v[c]
+                    o = o + 1
+                end
+            end
+        end
+    end)
+
+    data = ffi.cast("const float *", data)
+    return lut_lookup(data, n, lo, hi, channels, filter, wrap), data
+end
+
+return M, lut, shared
@@ -0,0 +1,174 @@
+-- --trace: runs the script with recording versions of math.*, then calls rgb(x, y, t) once with stand-ins for its
+-- arguments. every arithmetic operation and math call that gets a stand-in adds a node to a program, which
+-- dgfx_trace_load evaluates in C for whole packets of pixels. anything else done with one (comparing it, using it
+-- as an index or a loop bound, handing it to a function that isn't math.*) raises an error saying where, and the
+-- script keeps running on luajit.
+--
+-- called with the loaded script and the most nodes a program may have. returns the program: parallel arrays op,
+-- a, b (0 based operand nodes) and k (constants), plus out, the nodes rgb returned. also returns rgb itself, the
+-- program is checked against it on a few pixels.
+local chunk, max_nodes = ...
+
+local op, a, b, k = {}, {}, {}, {}
+local node_of = {} -- stand-in -> its node
+local known = {}   -- same operation on the same operands -> its stand-in, values are computed once
+local value_mt = {}
+
+local function node(name, x, y, value)
+    local key = string.format("%s %d %d %.17g", name, x or 0, y or 0, value or 0)
+    local v = known[key]
+    if v then
+        return v
+    end
+
+    if #op >= max_nodes then
+        error(string.format("rgb takes more than %d operations", max_nodes), 0)
+    end
+
+    local i = #op + 1
+    op[i], a[i], b[i], k[i] = name, x or 0, y or 0, value or 0
+    v = setmetatable({}, value_mt)
+    node_of[v] = i - 1
+    known[key] = v
+    return v
+end
+
+local function operand(v)
+    if node_of[v] then
+        return node_of[v]
+    end
+
+    local n = tonumber(v) -- "2" * x works in lua too
+    if n == nil then
+        error("attempt to perform arithmetic on a " .. type(v) .. " value", 3)
+    end
+    return node_of[node("const", nil, nil, n)]
+end
+
+local function traced(v)
+    return node_of[v] ~= nil
+end
+
+local function binary(name)
+    return function(x, y)
+        return node(name, operand(x), operand(y))
+    end
+end
+
+value_mt.__add = binary("add")
+value_mt.__sub = binary("sub")
+value_mt.__mul = binary("mul")
+value_mt.__div = binary("div")
+value_mt.__mod = binary("mod")
+value_mt.__pow = binary("pow")
+value_mt.__unm = function(x)
+    return node("unm", operand(x))
+end
+
+-- lua only asks the metatable when both sides of a comparison are tables, comparing with a number already fails
+local function untraceable(what)
+    return function()
+        error(what .. " a value that depends on x, y or t", 2)
+    end
+end
+
+value_mt.__lt = untraceable("compares")
+value_mt.__le = untraceable("compares")
+value_mt.__eq = untraceable("compares")
+value_mt.__index = untraceable("indexes")
+value_mt.__newindex = untraceable("indexes")
+value_mt.__call = untraceable("calls")
+value_mt.__concat = untraceable("concatenates")
+value_mt.__len = untraceable("takes the length of")
+
+-- math functions record a node when an argument is a stand-in and compute the value as usual otherwise
+local math_real = math
+local math_traced = {}
+for name, f in pairs(math_real) do
+    math_traced[name] = f
+end
+
+for _, name in ipairs({ "abs", "floor", "ceil", "sqrt", "exp", "log10", "sin", "cos", "tan", "asin", "acos", "atan",
+                        "sinh", "cosh", "tanh" }) do
+    local f = math_real[name]
+    math_traced[name] = function(x, ...) -- luajit's atan ignores a second argument too
+        if traced(x) then
+            return node(name, operand(x))
+        end
+        return f(x, ...)
+    end
+end
+
+for _, name in ipairs({ "fmod", "pow", "atan2", "ldexp" }) do
+    local f = math_real[name]
+    math_traced[name] = function(x, y)
+        if traced(x) or traced(y) then
+            return node(name, operand(x), operand(y))
+        end
+        return f(x, y)
+    end
+end
+
+-- like luajit's lib_math.c, which keeps math.log (x, 2) and math.log (x, 10) exact
+function math_traced.log(x, base)
+    if base == nil then
+        return traced(x) and node("log", operand(x)) or math_real.log(x)
+    end
+    if traced(x) or traced(base) then
+        return node("mul", operand(node("log2", operand(x))), operand(1 / node("log2", operand(base))))
+    end
+    return math_real.log(x, base)
+end
+
+function math_traced.deg(x)
+    return traced(x) and x * (180 / math_real.pi) or math_real.deg(x)
+end
+
+function math_traced.rad(x)
+    return traced(x) and x * (math_real.pi / 180) or math_real.rad(x)
+end
+
+for _, name in ipairs({ "min", "max" }) do
+    local f = math_real[name]
+    math_traced[name] = function(x, ...)
+        local v = x
+        for i = 1, select("#", ...) do
+            local y = select(i, ...)
+            if traced(v) or traced(y) then
+                v = node(name, operand(v), operand(y))
+            else
+                v = f(v, y)
+            end
+        end
+        return v
+    end
+end
+
+math = math_traced
+package.loaded.math = math_traced
+chunk()
+
+for _, name in ipairs({ "frame", "rgb_row", "setup", "shade" }) do
+    if type(_G[name]) == "function" then
+        error(name .. "() can't be traced, only rgb(n, m, t)", 0)
+    end
+end
+if type(rgb) ~= "function" then
+    error("the script has no rgb(n, m, t) function", 0)
+end
+
+local color = { pcall(rgb, node("x"), node("y"), node("t")) }
+if not color[1] then
+    error(tostring(color[2]) .. ". only arithmetic and math.* on x, y and t can be traced", 0)
+end
+
+local out = {}
+for i = 1, 3 do
+    local v = color[i + 1]
+    if not traced(v) and type(v) ~= "number" then
+        error(string.format("rgb returned a %s as its %s value", type(v), ({ "r", "g", "b" })[i]), 0)
+    end
+    out[i] = operand(v)
+end
+
+return { op = op, a = a, b = b, k = k, out = out }, rgb
@@ -1,27 +1,228 @@
 do
+    local ffi = require("ffi")
     local _rgb = rgb
-    local width = dgfx.width
+    local _rgb_row = rgb_row
+    local _frame = frame
+    local _setup = type(shade) == "function" and setup or nil
+    local _shade = shade
     local s_char = string.char
     local t_concat = table.concat
-
-    local start = dgfx.worker.start
-    local count = dgfx.worker.len
+    local m_min, m_max = math.min, math.max
+    local u8_ptr = ffi.typeof("uint8_t *")
+    local f32_ptr = ffi.typeof("float *")
 
     local out = {}
-    for i = 1, count do -- pre-allocate
+    for i = 1, dgfx.worker.tile_w * dgfx.worker.tile_h do -- pre-allocate
         out[i] = "\xFF\xFF\xFF\xFF"
     end
 
-    function __dgfx_worker_cb(t)
-        for i = 1, count do
-            local pixel_idx = start + i - 1
-            local x = pixel_idx % width
-            local y = (pixel_idx - x) / width
+    -- rgb_row(y, x0, x1, t, row, f) shades pixels x0..x1 of line y in one call, storing the r, g, b of pixel x
+    -- at row[(x - x0) * 3], row[(x - x0) * 3 + 1] and row[(x - x0) * 3 + 2]. used instead of rgb when defined.
+    local row = ffi.new("float[?]", dgfx.worker.tile_w * 3)
+
+    -- frame(t) is called once per worker and frame, before the worker's first tile of that frame. whatever it
+    -- returns is handed to rgb as its 4th (rgb_row: 6th) argument, so values that only depend on t are not
+    -- recomputed for every pixel. keyed on t rather than counted, because in --parallel frames a worker may
+    -- shade tiles of several frames.
+    local frame_t, frame_v
+    local function frame_state(t)
+        if _frame and t ~= frame_t then
+            frame_v = _frame(t)
+            frame_t = t
+        end
+
+        return frame_v
+    end
+
+    -- setup(x, y) runs once per pixel and returns values that do not depend on t. C keeps them (see
+    -- dgfx_setup_cache_init) and hands every call the tile's block as `state`, with `fill` set the first time.
+    -- shade(x, y, t, f, ...) then gets them back as extra arguments every frame. the loops are generated for
+    -- the number of values setup() returns, so they stay in locals instead of being packed into tables.
+    if _setup then
+        local k = select("#", _setup(0, 0))
+        if k == 0 then
+            error("setup(x, y) must return at least one value")
+        end
+        dgfx.setup_floats = k
+
+        local vars, stores, loads = {}, {}, {}
+        for j = 0, k - 1 do
+            vars[#vars + 1] = "v" .. j
+            stores[#stores + 1] = "s[" .. j .. " * n + i] = v" .. j
+            loads[#loads + 1] = "s[" .. j .. " * n + i]"
+        end
+
+        local head = [[
+            local ffi, _setup, _shade, frame_state, u8_ptr, f32_ptr, out, s_char, t_concat, m_min, m_max = ...
+            return function(t, x0, y0, w, h, dst, pitch, state, fill)
+                local f = frame_state(t)
+                local s = ffi.cast(f32_ptr, state)
+                local n = w * h
+                if fill then
+                    local i = 0
+                    for y = y0, y0 + h - 1 do
+                        for x = x0, x0 + w - 1 do
+                            local $VARS = _setup(x, y)
+                            $STORES
+                            i = i + 1
+                        end
+                    end
+                end
+                local i = 0
+        ]]
+
+        local bodies = {
+            __dgfx_worker_cb = [[
+                for y = y0, y0 + h - 1 do
+                    for x = x0, x0 + w - 1 do
+                        local r, g, b = _shade(x, y, t, f, $LOADS)
+                        out[i + 1] = s_char(r * 255, g * 255, b * 255, 255)
+                        i = i + 1
+                    end
+                end
+                return t_concat(out, "", 1, n)
+            end
+            ]],
+            __dgfx_worker_cb_ffi = [[
+                local p = ffi.cast(u8_ptr, dst)
+                for y = y0, y0 + h - 1 do
+                    local o = 0
+                    for x = x0, x0 + w - 1 do
+                        local r, g, b = _shade(x, y, t, f, $LOADS)
+                        p[o] = m_min(m_max(r * 255, 0), 255)
+                        p[o + 1] = m_min(m_max(g * 255, 0), 255)
+                        p[o + 2] = m_min(m_max(b * 255, 0), 255)
+                        p[o + 3] = 255
+                        o = o + 4
+                        i = i + 1
+                    end
+                    p = p + pitch
+                end
+            end
+            ]],
+            __dgfx_worker_cb_hdr = [[
+                local p = ffi.cast(f32_ptr, dst)
+                for y = y0, y0 + h - 1 do
+                    local o = 0
+                    for x = x0, x0 + w - 1 do
+                        p[o], p[o + 1], p[o + 2] = _shade(x, y, t, f, $LOADS)
+                        o = o + 4
+                        i = i + 1
+                    end
+                    p = p + pitch
+                end
+            end
+            ]],
+        }
+
+        local subst = { VARS = table.concat(vars, ", "), STORES = table.concat(stores, "; "),
+                        LOADS = table.concat(loads, ", ") }
+        for name, body in pairs(bodies) do
+            local src = (head .. body):gsub("%$(%u+)", subst)
+            local gen = assert(loadstring(src, "=" .. name))
+            _G[name] = gen(ffi, _setup, _shade, frame_state, u8_ptr, f32_ptr, out, s_char, t_concat, m_min, m_max)
+        end
+
+        return
+    end
+
+    if _rgb_row then
+        function __dgfx_worker_cb(t, x0, y0, w, h)
+            local f = frame_state(t)
+            local i = 1
+            for y = y0, y0 + h - 1 do
+                _rgb_row(y, x0, x0 + w - 1, t, row, f)
+                for j = 0, w * 3 - 1, 3 do
+                    out[i] = s_char(row[j] * 255, row[j + 1] * 255, row[j + 2] * 255, 255)
+                    i = i + 1
+                end
+            end
+
+            return t_concat(out, "", 1, w * h)
+        end
+
+        function __dgfx_worker_cb_ffi(t, x0, y0, w, h, dst, pitch)
+            local f = frame_state(t)
+            local p = ffi.cast(u8_ptr, dst)
+            for y = y0, y0 + h - 1 do
+                _rgb_row(y, x0, x0 + w - 1, t, row, f)
+                local o = 0
+                for j = 0, w * 3 - 1, 3 do
+                    p[o] = m_min(m_max(row[j] * 255, 0), 255)
+                    p[o + 1] = m_min(m_max(row[j + 1] * 255, 0), 255)
+                    p[o + 2] = m_min(m_max(row[j + 2] * 255, 0), 255)
+                    p[o + 3] = 255
+                    o = o + 4
+                end
+                p = p + pitch
+            end
+        end
 
-            local r, g, b = _rgb(x, y, t)
-            out[i] = s_char(r * 255, g * 255, b * 255, 255)
+        function __dgfx_worker_cb_hdr(t, x0, y0, w, h, dst, pitch)
+            local f = frame_state(t)
+            local p = ffi.cast(f32_ptr, dst)
+            for y = y0, y0 + h - 1 do
+                _rgb_row(y, x0, x0 + w - 1, t, row, f)
+                local o = 0
+                for j = 0, w * 3 - 1, 3 do
+                    p[o] = row[j]
+                    p[o + 1] = row[j + 1]
+                    p[o + 2] = row[j + 2]
+                    o = o + 4
+                end
+                p = p + pitch
+            end
         end
 
-        return t_concat(out)
+        return
+    end
+
+    function __dgfx_worker_cb(t, x0, y0, w, h)
+        local f = frame_state(t)
+        local i = 1
+        for y = y0, y0 + h - 1 do
+            for x = x0, x0 + w - 1 do
+                local r, g, b = _rgb(x, y, t, f)
+                out[i] = s_char(r * 255, g * 255, b * 255, 255)
+                i = i + 1
+            end
+        end
+
+        return t_concat(out, "", 1, w * h) -- edge tiles are smaller than the pre-allocated table
+    end
+
+    -- --write-path ffi: `dst` is a lightuserdata pointing at the tile's top left pixel, rows are `pitch` bytes apart.
+    -- nothing is allocated per pixel or per tile, and the loop compiles down to plain byte stores. colors are
+    -- clamped to 0-1 first (NaN gives 0), a byte store alone would wrap 1.2 around to 50.
+    function __dgfx_worker_cb_ffi(t, x0, y0, w, h, dst, pitch)
+        local f = frame_state(t)
+        local p = ffi.cast(u8_ptr, dst)
+        for y = y0, y0 + h - 1 do
+            local o = 0
+            for x = x0, x0 + w - 1 do
+                local r, g, b = _rgb(x, y, t, f)
+                p[o] = m_min(m_max(r * 255, 0), 255)
+                p[o + 1] = m_min(m_max(g * 255, 0), 255)
+                p[o + 2] = m_min(m_max(b * 255, 0), 255)
+                p[o + 3] = 255
+                o = o + 4
+            end
+            p = p + pitch
+        end
+    end
+
+    -- --hdr: like the ffi path, but `dst` points at float r, g, b, (unused) per pixel and `pitch` counts floats.
+    -- values are stored as they come, clamping and quantization happen in C.
+    function __dgfx_worker_cb_hdr(t, x0, y0, w, h, dst, pitch)
+        local f = frame_state(t)
+        local p = ffi.cast(f32_ptr, dst)
+        for y = y0, y0 + h - 1 do
+            local o = 0
+            for x = x0, x0 + w - 1 do
+                p[o], p[o + 1], p[o + 2] = _rgb(x, y, t, f)
+                o = o + 4
+            end
+            p = p + pitch
+        end
     end
 end